@@ -0,0 +1,71 @@
+/* ----------------------------------------------------------------------------
+Copyright (c) 2018-2023, Microsoft Research, Daan Leijen
+This is free software; you can redistribute it and/or modify it under the
+terms of the MIT license. A copy of the license can be found in the file
+"LICENSE" at the root of this distribution.
+-----------------------------------------------------------------------------*/
+
+/* Size mix in the style of `alloc-test` (OLogN Technologies). Each thread keeps
+   a large working set and replaces random entries with blocks from a size mix
+   that is dominated by small objects but has a tail of medium and large ones:
+   60% of 8-64 bytes, 30% of 64B-1KiB, 9% of 1-16KiB, and 1% of 16-128KiB.
+   Every allocated block is written to (one word per 4KiB) and checked when freed.
+*/
+
+#include "bench.h"
+
+#define WORKING_SET   (16*1024)
+
+static size_t iterations;
+
+static size_t pick_size(random_t r) {
+  const size_t perc = pick(r) % 100;
+  if (perc < 60) return pick_size_skewed(8, 64, r);
+  if (perc < 90) return pick_size_skewed(64, 1024, r);
+  if (perc < 99) return pick_size_skewed(1024, 16*1024, r);
+  return pick_size_skewed(16*1024, 128*1024, r);
+}
+
+static void* alloc_touch(size_t size) {
+  size_t* p = (size_t*)custom_malloc(size);
+  for (size_t i = 0; i < size / sizeof(size_t); i += 4096 / sizeof(size_t)) {
+    p[i] = size;
+  }
+  return p;
+}
+
+static void free_check(void* p) {
+  if (p == NULL) return;
+  const size_t size = ((size_t*)p)[0];
+  if (size < sizeof(size_t) || size > 128*1024) {
+    fprintf(stderr, "memory corruption at block %p\n", p);
+    abort();
+  }
+  custom_free(p);
+}
+
+static void alloc_test_thread(intptr_t tid) {
+  uintptr_t r = ((uintptr_t)tid + 1) * 43;
+  void** ws = (void**)custom_calloc(WORKING_SET, sizeof(void*));
+  for (size_t i = 0; i < iterations; i++) {
+    const size_t idx = pick(&r) % WORKING_SET;
+    free_check(ws[idx]);
+    ws[idx] = alloc_touch(pick_size(&r));
+  }
+  for (size_t i = 0; i < WORKING_SET; i++) {
+    free_check(ws[i]);
+  }
+  custom_free(ws);
+}
+
+static void alloc_test(bench_result_t* result) {
+  iterations = 100000 * (size_t)SCALE;
+  const double start = bench_clock_now();
+  bench_run_threads(THREADS, &alloc_test_thread);
+  result->seconds = bench_clock_now() - start;
+  result->ops = (size_t)THREADS * iterations;
+}
+
+int main(int argc, char** argv) {
+  return bench_main("alloc-test", argc, argv, &alloc_test);
+}
@@ -0,0 +1,300 @@
+/* ----------------------------------------------------------------------------
+Copyright (c) 2018-2023, Microsoft Research, Daan Leijen
+This is free software; you can redistribute it and/or modify it under the
+terms of the MIT license. A copy of the license can be found in the file
+"LICENSE" at the root of this distribution.
+-----------------------------------------------------------------------------*/
+#pragma once
+#ifndef MIMALLOC_BENCH_H
+#define MIMALLOC_BENCH_H
+
+/* ----------------------------------------------------------------------------
+Shared support for the benchmarks in this directory. Each benchmark is a
+single C file that is built twice: `mimalloc-bench-<name>` uses mimalloc and
+`mimalloc-bench-<name>-sys` is compiled with `USE_STD_MALLOC` and uses the
+system allocator. All benchmarks take the same arguments:
+
+  > mimalloc-bench-<name> [THREADS] [SCALE]
+
+and print a single JSON object with the throughput, peak RSS, and final RSS
+(at the end of the benchmark) on `stdout`. If THREADS is not given, the number
+of processors is used.
+-----------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#ifdef USE_STD_MALLOC
+#define BENCH_ALLOCATOR          "sys"
+#define custom_malloc(s)         malloc(s)
+#define custom_calloc(n,s)       calloc(n,s)
+#define custom_realloc(p,s)      realloc(p,s)
+#define custom_free(p)           free(p)
+#else
+#include <mimalloc.h>
+#define BENCH_ALLOCATOR          "mimalloc"
+#define custom_malloc(s)         mi_malloc(s)
+#define custom_calloc(n,s)       mi_calloc(n,s)
+#define custom_realloc(p,s)      mi_realloc(p,s)
+#define custom_free(p)           mi_free(p)
+#endif
+
+// argument defaults (set by `bench_main`)
+static int THREADS = 0;    // 0: number of processors
+static int SCALE   = 10;   // scaling factor
+
+
+// ------------------------------------------------------
+// Deterministic randomness
+// ------------------------------------------------------
+
+typedef uintptr_t* random_t;
+
+static inline uintptr_t pick(random_t r) {
+  uintptr_t x = *r;
+#if (UINTPTR_MAX > UINT32_MAX)
+  // by Sebastiano Vigna, see: <http://xoshiro.di.unimi.it/splitmix64.c>
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9UL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebUL;
+  x ^= x >> 31;
+#else
+  // by Chris Wellons, see: <https://nullprogram.com/blog/2018/07/31/>
+  x ^= x >> 16;
+  x *= 0x7feb352dUL;
+  x ^= x >> 15;
+  x *= 0x846ca68bUL;
+  x ^= x >> 16;
+#endif
+  *r = x;
+  return x;
+}
+
+static inline bool chance(size_t perc, random_t r) {
+  return (pick(r) % 100 < perc);
+}
+
+// a random size in `[min,max]` with a probability inversely proportional to the size
+// (most allocations in real programs are small)
+static inline size_t pick_size_skewed(size_t min, size_t max, random_t r) {
+  size_t bits = 0;
+  for (size_t n = max / (min == 0 ? 1 : min); n > 1; n /= 2) { bits++; }
+  const size_t lo = min << (pick(r) % (bits + 1));
+  const size_t hi = (lo*2 > max ? max : lo*2);
+  return lo + (pick(r) % (hi - lo + 1));
+}
+
+
+// ------------------------------------------------------
+// Platform: time, memory usage, threads, and atomics
+// ------------------------------------------------------
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <psapi.h>
+
+static inline double bench_clock_now(void) {
+  static LARGE_INTEGER freq = { 0 };
+  if (freq.QuadPart == 0) { QueryPerformanceFrequency(&freq); }
+  LARGE_INTEGER t;
+  QueryPerformanceCounter(&t);
+  return ((double)t.QuadPart / (double)freq.QuadPart);
+}
+
+static inline void bench_process_rss(size_t* current, size_t* peak) {
+  PROCESS_MEMORY_COUNTERS info;
+  memset(&info, 0, sizeof(info));
+  GetProcessMemoryInfo(GetCurrentProcess(), &info, sizeof(info));
+  *current = (size_t)info.WorkingSetSize;
+  *peak = (size_t)info.PeakWorkingSetSize;
+}
+
+static inline int bench_processors(void) {
+  SYSTEM_INFO si;
+  GetSystemInfo(&si);
+  return (int)si.dwNumberOfProcessors;
+}
+
+static inline void bench_yield(void) {
+  SwitchToThread();
+}
+
+static inline void bench_sleep_ms(unsigned long msecs) {
+  Sleep((DWORD)msecs);
+}
+
+static inline void* bench_atomic_load_ptr(void* volatile* p) {
+  return InterlockedCompareExchangePointer(p, NULL, NULL);
+}
+static inline void bench_atomic_store_ptr(void* volatile* p, void* newval) {
+  InterlockedExchangePointer(p, newval);
+}
+static inline void* bench_atomic_exchange_ptr(void* volatile* p, void* newval) {
+  return InterlockedExchangePointer(p, newval);
+}
+static inline bool bench_atomic_cas_ptr(void* volatile* p, void* expected, void* desired) {
+  return (InterlockedCompareExchangePointer(p, desired, expected) == expected);
+}
+static inline intptr_t bench_atomic_add(volatile intptr_t* p, intptr_t add) {
+#if (INTPTR_MAX == INT32_MAX)
+  return (intptr_t)InterlockedExchangeAdd((volatile LONG*)p, (LONG)add);
+#else
+  return (intptr_t)InterlockedExchangeAdd64((volatile LONG64*)p, (LONG64)add);
+#endif
+}
+
+static void (*bench_thread_fun)(intptr_t) = NULL;
+
+static DWORD WINAPI bench_thread_entry(LPVOID param) {
+  bench_thread_fun((intptr_t)param);
+  return 0;
+}
+
+static inline void bench_run_threads(size_t nthreads, void (*fun)(intptr_t tid)) {
+  bench_thread_fun = fun;
+  HANDLE* thandles = (HANDLE*)calloc(nthreads, sizeof(HANDLE));
+  for (size_t i = 0; i < nthreads; i++) {
+    thandles[i] = CreateThread(0, 0, &bench_thread_entry, (void*)(i), 0, NULL);
+  }
+  for (size_t i = 0; i < nthreads; i++) {
+    WaitForSingleObject(thandles[i], INFINITE);
+    CloseHandle(thandles[i]);
+  }
+  free(thandles);
+}
+
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+static inline double bench_clock_now(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return ((double)t.tv_sec + (double)t.tv_nsec * 1.0e-9);
+}
+
+static inline void bench_process_rss(size_t* current, size_t* peak) {
+  struct rusage rusage;
+  getrusage(RUSAGE_SELF, &rusage);
+  #if defined(__APPLE__)
+  *peak = (size_t)rusage.ru_maxrss;          // in bytes
+  #else
+  *peak = (size_t)rusage.ru_maxrss * 1024;   // in KiB
+  #endif
+  *current = 0;
+  #if defined(__linux__)
+  FILE* f = fopen("/proc/self/statm", "r");
+  if (f != NULL) {
+    unsigned long size = 0;
+    unsigned long resident = 0;
+    if (fscanf(f, "%lu %lu", &size, &resident) == 2) {
+      *current = (size_t)resident * (size_t)sysconf(_SC_PAGESIZE);
+    }
+    fclose(f);
+  }
+  #endif
+}
+
+static inline int bench_processors(void) {
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return (n <= 0 ? 1 : (int)n);
+}
+
+static inline void bench_yield(void) {
+  sched_yield();
+}
+
+static inline void bench_sleep_ms(unsigned long msecs) {
+  struct timespec t;
+  t.tv_sec = (time_t)(msecs / 1000);
+  t.tv_nsec = (long)(msecs % 1000) * 1000000L;
+  nanosleep(&t, NULL);
+}
+
+#include <stdatomic.h>
+static inline void* bench_atomic_load_ptr(void* volatile* p) {
+  return atomic_load_explicit((volatile _Atomic(void*)*)p, memory_order_acquire);
+}
+static inline void bench_atomic_store_ptr(void* volatile* p, void* newval) {
+  atomic_store_explicit((volatile _Atomic(void*)*)p, newval, memory_order_release);
+}
+static inline void* bench_atomic_exchange_ptr(void* volatile* p, void* newval) {
+  return atomic_exchange((volatile _Atomic(void*)*)p, newval);
+}
+static inline bool bench_atomic_cas_ptr(void* volatile* p, void* expected, void* desired) {
+  return atomic_compare_exchange_strong((volatile _Atomic(void*)*)p, &expected, desired);
+}
+static inline intptr_t bench_atomic_add(volatile intptr_t* p, intptr_t add) {
+  return atomic_fetch_add((volatile _Atomic(intptr_t)*)p, add);
+}
+
+static void (*bench_thread_fun)(intptr_t) = NULL;
+
+static void* bench_thread_entry(void* param) {
+  bench_thread_fun((intptr_t)param);
+  return NULL;
+}
+
+static inline void bench_run_threads(size_t nthreads, void (*fun)(intptr_t tid)) {
+  bench_thread_fun = fun;
+  pthread_t* threads = (pthread_t*)calloc(nthreads, sizeof(pthread_t));
+  for (size_t i = 0; i < nthreads; i++) {
+    pthread_create(&threads[i], NULL, &bench_thread_entry, (void*)i);
+  }
+  for (size_t i = 0; i < nthreads; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  free(threads);
+}
+#endif
+
+
+// ------------------------------------------------------
+// Arguments and results
+// ------------------------------------------------------
+
+typedef struct bench_result_s {
+  size_t ops;          // number of operations (usually allocations)
+  double seconds;      // elapsed wall-clock time
+  size_t live;         // bytes still allocated by the benchmark at the end (0 if not applicable)
+} bench_result_t;
+
+// Parse `[THREADS] [SCALE]`, run `bench`, and print the result as JSON.
+static inline int bench_main(const char* name, int argc, char** argv, void (*bench)(bench_result_t* result)) {
+  if (argc >= 2) {
+    long n = strtol(argv[1], NULL, 10);
+    if (n > 0) THREADS = (int)n;
+  }
+  if (argc >= 3) {
+    long n = strtol(argv[2], NULL, 10);
+    if (n > 0) SCALE = (int)n;
+  }
+  if (THREADS <= 0) { THREADS = bench_processors(); }
+
+  bench_result_t result;
+  memset(&result, 0, sizeof(result));
+  const double start = bench_clock_now();
+  bench(&result);
+  if (result.seconds <= 0.0) { result.seconds = bench_clock_now() - start; }
+
+  size_t rss = 0;
+  size_t peak_rss = 0;
+  bench_process_rss(&rss, &peak_rss);
+  if (peak_rss < rss) { peak_rss = rss; }   // the peak may be sampled less precisely
+  printf("{\"bench\": \"%s\", \"allocator\": \"%s\", \"threads\": %d, \"scale\": %d, "
+         "\"ops\": %zu, \"seconds\": %.6f, \"ops_per_sec\": %.1f, \"peak_rss\": %zu, \"final_rss\": %zu",
+         name, BENCH_ALLOCATOR, THREADS, SCALE,
+         result.ops, result.seconds, (result.seconds > 0.0 ? (double)result.ops / result.seconds : 0.0), peak_rss, rss);
+  if (result.live > 0) { printf(", \"live\": %zu", result.live); }
+  printf("}\n");
+  return 0;
+}
+
+#endif
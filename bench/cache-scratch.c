@@ -0,0 +1,52 @@
+/* ----------------------------------------------------------------------------
+Copyright (c) 2018-2023, Microsoft Research, Daan Leijen
+This is free software; you can redistribute it and/or modify it under the
+terms of the MIT license. A copy of the license can be found in the file
+"LICENSE" at the root of this distribution.
+-----------------------------------------------------------------------------*/
+
+/* Passive false sharing in the style of the `cache-scratch` benchmark of Hoard
+   (Berger et al., ASPLOS'00). The main thread allocates one small object per
+   thread, so they are likely to be on the same cache line. Each thread frees the
+   object it was handed and then repeatedly allocates a small object and writes to
+   it. An allocator that hands the freed (shared) memory back to the thread that
+   freed it makes the threads write to the same cache lines.
+*/
+
+#include "bench.h"
+
+#define OBJECT_SIZE   (8)
+#define REPETITIONS   (500)
+
+static void** objects;
+static size_t iterations;
+
+static void cache_scratch_thread(intptr_t tid) {
+  custom_free(objects[tid]);
+  for (size_t i = 0; i < iterations; i++) {
+    volatile char* p = (volatile char*)custom_malloc(OBJECT_SIZE);
+    for (size_t j = 0; j < REPETITIONS; j++) {
+      for (size_t k = 0; k < OBJECT_SIZE; k++) {
+        p[k] = (char)(p[k] + 1);
+      }
+    }
+    custom_free((void*)p);
+  }
+}
+
+static void cache_scratch(bench_result_t* result) {
+  iterations = 1000 * (size_t)SCALE;
+  objects = (void**)custom_calloc(THREADS, sizeof(void*));
+  for (int t = 0; t < THREADS; t++) {
+    objects[t] = custom_malloc(OBJECT_SIZE);
+  }
+  const double start = bench_clock_now();
+  bench_run_threads(THREADS, &cache_scratch_thread);
+  result->seconds = bench_clock_now() - start;
+  result->ops = (size_t)THREADS * iterations;
+  custom_free(objects);
+}
+
+int main(int argc, char** argv) {
+  return bench_main("cache-scratch", argc, argv, &cache_scratch);
+}
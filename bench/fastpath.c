@@ -0,0 +1,275 @@
+/* ----------------------------------------------------------------------------
+Copyright (c) 2018-2023, Microsoft Research, Daan Leijen
+This is free software; you can redistribute it and/or modify it under the
+terms of the MIT license. A copy of the license can be found in the file
+"LICENSE" at the root of this distribution.
+-----------------------------------------------------------------------------*/
+
+/* Microbenchmark of the allocation and free paths for every size class (bin).
+   For each bin it measures the time (ns/op) and, on Linux when `perf_event_open`
+   is permitted, the retired user-space instructions (instr/op) of:
+
+   - `malloc`, `free`:     batches that are served by the fast path (`pages_free_direct`
+                           and `_mi_page_malloc` for small sizes) and freed locally;
+   - `find_free_page`:     a free and malloc on a full page, so every malloc goes through
+                           `mi_malloc_generic` and `mi_find_free_page` (and collects the
+                           single freed block);
+   - `extend_free`:        single mallocs that need `mi_page_extend_free` on a fresh page;
+   - `xthread_free`:       frees from another thread (`_mi_free_block_mt`).
+
+   Each measurement is the minimum over many repeats with the measurement overhead
+   subtracted, which makes the instruction counts exact and repeatable: a change of
+   even a single instruction on a path shows up. Timings are more stable when the
+   process is pinned to a core (e.g. `taskset -c 2`).
+
+   > mimalloc-bench-fastpath [REPEATS]
+
+   This uses the internal API and is built only against the static library.
+*/
+
+#include "bench.h"
+#include "mimalloc/internal.h"
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
+
+#define BATCH    (32)
+
+static size_t REPEATS = 200;
+
+typedef struct measure_s {
+  double ns;       // per operation
+  double instr;    // per operation (or negative if not available)
+} measure_t;
+
+
+// ------------------------------------------------------
+// Counters
+// ------------------------------------------------------
+
+static int counter_open(void) {
+  #if defined(__linux__)
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.size = sizeof(attr);
+  attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return (int)syscall(__NR_perf_event_open, &attr, 0 /* this thread */, -1 /* any cpu */, -1, 0);
+  #else
+  return -1;
+  #endif
+}
+
+static void counter_close(int fd) {
+  #if defined(__linux__)
+  if (fd >= 0) { close(fd); }
+  #else
+  (void)fd;
+  #endif
+}
+
+static inline uint64_t counter_read(int fd) {
+  uint64_t count = 0;
+  #if defined(__linux__)
+  if (fd >= 0 && read(fd, &count, sizeof(count)) != sizeof(count)) { count = 0; }
+  #else
+  (void)fd;
+  #endif
+  return count;
+}
+
+typedef struct sample_s {
+  int      fd;
+  uint64_t instr;
+  double   start;
+} sample_t;
+
+static measure_t overhead;   // of an empty measurement
+
+static inline void sample_start(sample_t* s) {
+  s->instr = counter_read(s->fd);
+  s->start = bench_clock_now();
+}
+
+// update the minimum per-operation measure in `m`
+static inline void sample_end(sample_t* s, size_t ops, measure_t* m) {
+  const double end = bench_clock_now();
+  const uint64_t instr = counter_read(s->fd);
+  const double ns = ((end - s->start) * 1.0e9 - overhead.ns) / (double)ops;
+  if (ns < m->ns) { m->ns = ns; }
+  if (s->fd >= 0) {
+    const double in = ((double)(instr - s->instr) - overhead.instr) / (double)ops;
+    if (m->instr < 0 || in < m->instr) { m->instr = in; }
+  }
+}
+
+static inline measure_t measure_init(void) {
+  measure_t m = { 1.0e18, -1.0 };
+  return m;
+}
+
+static void measure_overhead(int fd) {
+  overhead.ns = 0;
+  overhead.instr = 0;
+  measure_t m = measure_init();
+  sample_t s = { fd, 0, 0 };
+  for (size_t r = 0; r < 1000; r++) {
+    sample_start(&s);
+    sample_end(&s, 1, &m);
+  }
+  overhead.ns = m.ns;
+  overhead.instr = (m.instr < 0 ? 0 : m.instr);
+}
+
+
+// ------------------------------------------------------
+// Paths
+// ------------------------------------------------------
+
+// fast path: batches of mallocs and local frees on a page with free blocks
+static void measure_fast(int fd, size_t size, measure_t* malloc_m, measure_t* free_m) {
+  void* blocks[BATCH];
+  sample_t s = { fd, 0, 0 };
+  for (size_t r = 0; r < REPEATS; r++) {
+    sample_start(&s);
+    for (size_t i = 0; i < BATCH; i++) { blocks[i] = mi_malloc(size); }
+    sample_end(&s, BATCH, malloc_m);
+    sample_start(&s);
+    for (size_t i = 0; i < BATCH; i++) { mi_free(blocks[i]); }
+    sample_end(&s, BATCH, free_m);
+  }
+}
+
+// generic path: a full page where each malloc needs `mi_find_free_page` to collect the one free block
+static void measure_find_free_page(int fd, size_t size, measure_t* m) {
+  mi_heap_t* heap = mi_heap_new();
+  void* p = mi_heap_malloc(heap, size);
+  const mi_page_t* page = _mi_ptr_page(p);
+  while (page->used < page->reserved) {
+    p = mi_heap_malloc(heap, size);
+  }
+  if (_mi_ptr_page(p) == page) {
+    sample_t s = { fd, 0, 0 };
+    for (size_t r = 0; r < REPEATS; r++) {
+      sample_start(&s);
+      for (size_t i = 0; i < BATCH; i++) {
+        mi_free(p);
+        p = mi_heap_malloc(heap, size);
+      }
+      sample_end(&s, BATCH, m);
+    }
+  }
+  mi_heap_destroy(heap);
+}
+
+// extend path: single mallocs on a fresh page that need `mi_page_extend_free`
+static void measure_extend_free(int fd, size_t size, measure_t* m) {
+  sample_t s = { fd, 0, 0 };
+  size_t samples = 0;
+  while (samples < REPEATS) {
+    mi_heap_t* heap = mi_heap_new();
+    void* p = mi_heap_malloc(heap, size);
+    const mi_page_t* page = _mi_ptr_page(p);
+    if (page->capacity >= page->reserved) {
+      // the page is fully extended at once for this size
+      mi_heap_destroy(heap);
+      return;
+    }
+    while (page->capacity < page->reserved && samples < REPEATS) {
+      if (page->free == NULL && page->local_free == NULL) {
+        sample_start(&s);
+        p = mi_heap_malloc(heap, size);
+        sample_end(&s, 1, m);
+        samples++;
+      }
+      else {
+        p = mi_heap_malloc(heap, size);
+      }
+    }
+    mi_heap_destroy(heap);
+  }
+}
+
+// cross-thread free: free blocks that were allocated by another thread
+static void*     xthread_blocks[BATCH];
+static measure_t xthread_measure;
+
+static void xthread_free(intptr_t tid) {
+  (void)tid;
+  sample_t s = { counter_open(), 0, 0 };
+  sample_start(&s);
+  for (size_t i = 0; i < BATCH; i++) { mi_free(xthread_blocks[i]); }
+  sample_end(&s, BATCH, &xthread_measure);
+  counter_close(s.fd);
+}
+
+static void measure_xthread_free(size_t size, measure_t* m) {
+  xthread_measure = *m;
+  for (size_t r = 0; r < REPEATS / 10 + 1; r++) {
+    for (size_t i = 0; i < BATCH; i++) { xthread_blocks[i] = mi_malloc(size); }
+    bench_run_threads(1, &xthread_free);
+  }
+  *m = xthread_measure;
+}
+
+
+// ------------------------------------------------------
+// Main
+// ------------------------------------------------------
+
+static void print_measure(const char* name, measure_t m, bool last) {
+  if (m.ns >= 1.0e18) {
+    printf("\"%s\": null%s", name, (last ? "" : ", "));
+  }
+  else if (m.instr < 0) {
+    printf("\"%s\": {\"ns\": %.2f, \"instr\": null}%s", name, m.ns, (last ? "" : ", "));
+  }
+  else {
+    printf("\"%s\": {\"ns\": %.2f, \"instr\": %.2f}%s", name, m.ns, m.instr, (last ? "" : ", "));
+  }
+}
+
+int main(int argc, char** argv) {
+  if (argc >= 2) {
+    long n = strtol(argv[1], NULL, 10);
+    if (n > 0) REPEATS = (size_t)n;
+  }
+  const int fd = counter_open();
+  measure_overhead(fd);
+
+  printf("{\"bench\": \"fastpath\", \"repeats\": %zu, \"instructions\": %s, \"bins\": [\n", REPEATS, (fd >= 0 ? "true" : "false"));
+  // visit each bin with the largest request size that still fits in it
+  bool first = true;
+  for (size_t size = 1; size <= MI_MEDIUM_OBJ_SIZE_MAX - MI_PADDING_SIZE; ) {
+    const uint8_t bin = _mi_bin(size + MI_PADDING_SIZE);
+    const size_t block_size = _mi_bin_size(bin);
+    const size_t req_size = block_size - MI_PADDING_SIZE;
+
+    measure_t malloc_m = measure_init();
+    measure_t free_m = measure_init();
+    measure_t find_m = measure_init();
+    measure_t extend_m = measure_init();
+    measure_t xthread_m = measure_init();
+    measure_fast(fd, req_size, &malloc_m, &free_m);
+    measure_find_free_page(fd, req_size, &find_m);
+    measure_extend_free(fd, req_size, &extend_m);
+    measure_xthread_free(req_size, &xthread_m);
+
+    printf("%s  {\"bin\": %u, \"size\": %zu, \"block_size\": %zu, ", (first ? "" : ",\n"), (unsigned)bin, req_size, block_size);
+    print_measure("malloc", malloc_m, false);
+    print_measure("free", free_m, false);
+    print_measure("find_free_page", find_m, false);
+    print_measure("extend_free", extend_m, false);
+    print_measure("xthread_free", xthread_m, true);
+    printf("}");
+    first = false;
+    size = req_size + 1;
+  }
+  printf("\n]}\n");
+  counter_close(fd);
+  return 0;
+}
@@ -0,0 +1,79 @@
+/* ----------------------------------------------------------------------------
+Copyright (c) 2018-2023, Microsoft Research, Daan Leijen
+This is free software; you can redistribute it and/or modify it under the
+terms of the MIT license. A copy of the license can be found in the file
+"LICENSE" at the root of this distribution.
+-----------------------------------------------------------------------------*/
+
+/* Long running fragmentation churn. Each thread runs many rounds where it
+   allocates a burst of blocks of one size, frees most of them, and keeps a few
+   survivors that replace random older survivors. The size changes every round,
+   so the pages of earlier rounds are only kept alive by scattered survivors.
+   The survivors are still live when the result is reported: compare the
+   `final_rss` with the `live` bytes to see the fragmentation overhead.
+*/
+
+#include "bench.h"
+
+#define BURST         (10000)
+#define SURVIVORS     (20000)
+#define SURVIVE_PERC  (3)
+
+static const size_t round_sizes[] = { 24, 48, 100, 200, 360, 720, 1500, 3000, 6000, 12000 };
+#define ROUND_SIZES   (sizeof(round_sizes)/sizeof(round_sizes[0]))
+
+static size_t rounds;
+static volatile intptr_t live;
+
+typedef struct block_s {
+  size_t size;
+} block_t;
+
+static void* alloc_block(size_t size) {
+  block_t* b = (block_t*)custom_malloc(size);
+  memset(b, 0, size);
+  b->size = size;
+  return b;
+}
+
+static void frag_churn_thread(intptr_t tid) {
+  uintptr_t r = ((uintptr_t)tid + 1) * 43;
+  void** survivors = (void**)custom_calloc(SURVIVORS, sizeof(void*));
+  void** burst = (void**)custom_calloc(BURST, sizeof(void*));
+  intptr_t live_local = 0;
+  for (size_t round = 0; round < rounds; round++) {
+    const size_t base = round_sizes[(round + (size_t)tid) % ROUND_SIZES];
+    for (size_t i = 0; i < BURST; i++) {
+      burst[i] = alloc_block(base + (pick(&r) % (base/8 + 1)));
+    }
+    for (size_t i = 0; i < BURST; i++) {
+      if (chance(SURVIVE_PERC, &r)) {
+        // replace a random older survivor
+        const size_t idx = pick(&r) % SURVIVORS;
+        block_t* old = (block_t*)survivors[idx];
+        if (old != NULL) { live_local -= (intptr_t)old->size; custom_free(old); }
+        survivors[idx] = burst[i];
+        live_local += (intptr_t)((block_t*)burst[i])->size;
+      }
+      else {
+        custom_free(burst[i]);
+      }
+    }
+  }
+  custom_free(burst);
+  // the survivors stay allocated (and are not freed)
+  bench_atomic_add(&live, live_local);
+}
+
+static void frag_churn(bench_result_t* result) {
+  rounds = 20 * (size_t)SCALE;
+  const double start = bench_clock_now();
+  bench_run_threads(THREADS, &frag_churn_thread);
+  result->seconds = bench_clock_now() - start;
+  result->ops = (size_t)THREADS * rounds * BURST;
+  result->live = (size_t)live;
+}
+
+int main(int argc, char** argv) {
+  return bench_main("frag-churn", argc, argv, &frag_churn);
+}
@@ -0,0 +1,61 @@
+/* ----------------------------------------------------------------------------
+Copyright (c) 2018-2023, Microsoft Research, Daan Leijen
+This is free software; you can redistribute it and/or modify it under the
+terms of the MIT license. A copy of the license can be found in the file
+"LICENSE" at the root of this distribution.
+-----------------------------------------------------------------------------*/
+
+/* The `bench-malloc-thread` workload of the glibc benchtests: each thread
+   keeps a working set of 1024 blocks and replaces a random one at each step
+   with a block of a random size between 4 bytes and 32KiB, where the
+   probability of a size is inversely proportional to its square.
+*/
+
+#include "bench.h"
+
+#define WORKING_SET   (1024)
+#define MIN_SIZE      (4)
+#define MAX_SIZE      (32768)
+#define SIZE_COUNT    (4096)
+
+static size_t iterations;
+static size_t sizes[SIZE_COUNT];    // precomputed random sizes (as in glibc)
+
+static void init_sizes(void) {
+  // inverse transform sampling of the density `1/size^2` on `[MIN_SIZE,MAX_SIZE]`
+  uintptr_t r = 42;
+  const double a = 1.0 / MIN_SIZE;
+  const double b = 1.0 / MAX_SIZE;
+  for (size_t i = 0; i < SIZE_COUNT; i++) {
+    const double u = (double)(pick(&r) % 1000000) / 1000000.0;
+    sizes[i] = (size_t)(1.0 / (a - u*(a - b)));
+  }
+}
+
+static void glibc_bench_thread(intptr_t tid) {
+  uintptr_t r = ((uintptr_t)tid + 1) * 43;
+  void** ws = (void**)custom_calloc(WORKING_SET, sizeof(void*));
+  for (size_t i = 0; i < iterations; i++) {
+    const size_t x = pick(&r);
+    const size_t idx = x % WORKING_SET;
+    custom_free(ws[idx]);
+    ws[idx] = custom_malloc(sizes[(x >> 16) % SIZE_COUNT]);
+  }
+  for (size_t i = 0; i < WORKING_SET; i++) {
+    custom_free(ws[i]);
+  }
+  custom_free(ws);
+}
+
+static void glibc_bench(bench_result_t* result) {
+  iterations = 1000000 * (size_t)SCALE;
+  init_sizes();
+  const double start = bench_clock_now();
+  bench_run_threads(THREADS, &glibc_bench_thread);
+  result->seconds = bench_clock_now() - start;
+  result->ops = (size_t)THREADS * iterations;
+}
+
+int main(int argc, char** argv) {
+  return bench_main("glibc-bench", argc, argv, &glibc_bench);
+}
@@ -0,0 +1,67 @@
+/* ----------------------------------------------------------------------------
+Copyright (c) 2018-2023, Microsoft Research, Daan Leijen
+This is free software; you can redistribute it and/or modify it under the
+terms of the MIT license. A copy of the license can be found in the file
+"LICENSE" at the root of this distribution.
+-----------------------------------------------------------------------------*/
+
+/* Server workload in the style of Larson and Krishnan ("Memory allocation for
+   long-running server applications", ISMM'98). Each thread owns a set of slots
+   and repeatedly frees a random slot and allocates a new block of a random size
+   into it. After a number of rounds each thread exits and a new thread takes
+   over its slots, so the blocks allocated by the old thread are freed by the new
+   one (like a request handed from one worker to the next).
+*/
+
+#include "bench.h"
+
+#define MIN_SIZE     (8)
+#define MAX_SIZE     (1000)
+#define GENERATIONS  (10)
+
+static void*** slots;
+static size_t  slot_count;
+static size_t  rounds;
+static int     generation;
+
+static void larson_thread(intptr_t tid) {
+  void** s = slots[tid];
+  uintptr_t r = ((uintptr_t)tid + 1) * 43 + (uintptr_t)generation;
+  for (size_t i = 0; i < rounds; i++) {
+    for (size_t j = 0; j < slot_count; j++) {
+      const size_t idx = pick(&r) % slot_count;
+      custom_free(s[idx]);
+      const size_t size = MIN_SIZE + (pick(&r) % (MAX_SIZE - MIN_SIZE + 1));
+      s[idx] = custom_malloc(size);
+      ((char*)s[idx])[0] = (char)j;   // touch
+    }
+  }
+}
+
+static void larson(bench_result_t* result) {
+  slot_count = 1000;
+  rounds = 10 * (size_t)SCALE;
+  uintptr_t r = 42;
+  slots = (void***)custom_calloc(THREADS, sizeof(void**));
+  for (int t = 0; t < THREADS; t++) {
+    slots[t] = (void**)custom_calloc(slot_count, sizeof(void*));
+    for (size_t i = 0; i < slot_count; i++) {
+      slots[t][i] = custom_malloc(MIN_SIZE + (pick(&r) % (MAX_SIZE - MIN_SIZE + 1)));
+    }
+  }
+  const double start = bench_clock_now();
+  for (generation = 0; generation < GENERATIONS; generation++) {
+    bench_run_threads(THREADS, &larson_thread);   // fresh threads inherit the slots of the previous ones
+  }
+  result->seconds = bench_clock_now() - start;
+  result->ops = (size_t)THREADS * GENERATIONS * rounds * slot_count;
+  for (int t = 0; t < THREADS; t++) {
+    for (size_t i = 0; i < slot_count; i++) { custom_free(slots[t][i]); }
+    custom_free(slots[t]);
+  }
+  custom_free(slots);
+}
+
+int main(int argc, char** argv) {
+  return bench_main("larson", argc, argv, &larson);
+}
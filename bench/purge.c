@@ -0,0 +1,307 @@
+/* ----------------------------------------------------------------------------
+Copyright (c) 2018-2023, Microsoft Research, Daan Leijen
+This is free software; you can redistribute it and/or modify it under the
+terms of the MIT license. A copy of the license can be found in the file
+"LICENSE" at the root of this distribution.
+-----------------------------------------------------------------------------*/
+
+/* How quickly is memory returned to the OS after a load spike? The benchmark runs
+   four phases on all threads:
+
+   - `ramp`:   the live set grows linearly to its peak (with some churn);
+   - `steady`: full speed churn at the peak live set;
+   - `drop`:   90% of the live set is freed at once;
+   - `idle`:   a light load (a few operations per millisecond) on the remaining live set.
+               Delayed purges in mimalloc only run on allocator calls, so the light load
+               is what returns the memory over time.
+
+   Every few milliseconds it samples the RSS, the `committed` and `purged` statistics,
+   and the purge/commit system calls, and prints the time series and a summary as JSON.
+   The `committed` statistic drops on every purge, but does not rise again when purged
+   memory is reused without a recommit (e.g. after `MADV_DONTNEED`), so only its drop
+   after the load spike is meaningful (`drop_committed` to `idle_committed`).
+   `return_50_ms` and `return_90_ms` are the times after the drop until the RSS has
+   returned 50% and 90% of the way to the baseline RSS plus the remaining live bytes
+   (or `null` if it never did).
+
+   > mimalloc-bench-purge [THREADS] [SCALE] [OPTION=VALUE]...
+
+   where OPTION is one of `purge_delay`, `purge_extend_delay`, `arena_purge_mult`,
+   `purge_decommits`, or `eager_commit_delay` (the `MIMALLOC_` environment variables
+   work as well). This benchmark uses the mimalloc options and statistics and has no
+   system allocator variant.
+*/
+
+#include "bench.h"
+
+#define RAMP_MS     (500)
+#define STEADY_MS   (1000)
+#define IDLE_MS     (2000)
+#define SAMPLE_MS   (5)
+#define IDLE_OPS    (8)         // operations per thread per millisecond in the idle phase
+#define KEEP_PERC   (10)        // percentage of the live set that is kept after the drop
+
+typedef enum phase_e { PHASE_RAMP, PHASE_STEADY, PHASE_DROP, PHASE_IDLE, PHASE_DONE } phase_t;
+static const char* phase_names[] = { "ramp", "steady", "drop", "idle", "done" };
+
+static volatile intptr_t phase = PHASE_RAMP;
+static double phase_start;      // of the ramp
+
+typedef struct thread_data_s {
+  void**            objects;
+  size_t*           sizes;
+  size_t            count;      // live objects are in `[0,count)`
+  volatile intptr_t live;       // bytes
+  size_t            kept;       // live bytes right after the drop
+  size_t            ops;
+  uint8_t           padding[64];
+} thread_data_t;
+
+static thread_data_t* tdata;
+static size_t objects_per_thread;
+
+typedef struct sample_s {
+  double  t;                    // milliseconds since the start of the ramp
+  phase_t phase;
+  size_t  rss;
+  int64_t committed;
+  int64_t purged;               // total bytes
+  int64_t purge_calls;
+  int64_t commit_calls;
+} sample_t;
+
+static sample_t* samples;
+static size_t    sample_count;
+static size_t    sample_max;
+
+
+// ------------------------------------------------------
+// Workers
+// ------------------------------------------------------
+
+static size_t pick_size(random_t r) {
+  const size_t perc = pick(r) % 1000;
+  if (perc < 950) return pick_size_skewed(16, 8*1024, r);                  // small
+  if (perc < 995) return pick_size_skewed(8*1024, 256*1024, r);            // medium and large
+  return (256*1024) + (pick(r) % (768*1024));                              // huge
+}
+
+static void obj_alloc(thread_data_t* td, size_t i, random_t r) {
+  const size_t size = pick_size(r);
+  void* p = custom_malloc(size);
+  if (p != NULL) { memset(p, 0, (size > 4096 ? 4096 : size)); }
+  td->objects[i] = p;
+  td->sizes[i] = size;
+  td->live += (intptr_t)size;
+  td->ops++;
+}
+
+static void obj_free(thread_data_t* td, size_t i) {
+  custom_free(td->objects[i]);
+  td->live -= (intptr_t)td->sizes[i];
+  td->objects[i] = NULL;
+  td->ops++;
+}
+
+// replace a random live object
+static void obj_churn(thread_data_t* td, random_t r) {
+  if (td->count == 0) return;
+  const size_t i = pick(r) % td->count;
+  obj_free(td, i);
+  obj_alloc(td, i, r);
+}
+
+static void worker(intptr_t tid) {
+  thread_data_t* td = &tdata[tid];
+  uintptr_t rnd = (uintptr_t)(tid + 1) * 0x9E3779B97F4A7C15ULL;
+  random_t r = &rnd;
+  bool dropped = false;
+  while (phase != PHASE_DONE) {
+    switch (phase) {
+      case PHASE_RAMP: {
+        const double elapsed = (bench_clock_now() - phase_start) * 1000.0;
+        size_t target = (size_t)((double)objects_per_thread * elapsed / RAMP_MS);
+        if (target > objects_per_thread) target = objects_per_thread;
+        for (size_t n = 0; n < 64; n++) {
+          if (td->count < target) { obj_alloc(td, td->count, r); td->count++; }
+          else { obj_churn(td, r); }
+        }
+        break;
+      }
+      case PHASE_STEADY:
+        while (td->count < objects_per_thread) { obj_alloc(td, td->count, r); td->count++; }
+        for (size_t n = 0; n < 64; n++) { obj_churn(td, r); }
+        break;
+      case PHASE_DROP:
+      case PHASE_IDLE:
+        if (!dropped) {
+          const size_t keep = (objects_per_thread * KEEP_PERC) / 100;
+          while (td->count > keep) { td->count--; obj_free(td, td->count); }
+          td->kept = (size_t)td->live;
+          dropped = true;
+        }
+        for (size_t n = 0; n < IDLE_OPS; n++) { obj_churn(td, r); }
+        bench_sleep_ms(1);
+        break;
+      default:
+        break;
+    }
+  }
+  while (td->count > 0) { td->count--; obj_free(td, td->count); }
+}
+
+
+// ------------------------------------------------------
+// Sampling
+// ------------------------------------------------------
+
+static void take_sample(double now) {
+  if (sample_count >= sample_max) return;
+  mi_stats_snapshot_t stats;
+  mi_stats_get(&stats, sizeof(stats));
+  sample_t* s = &samples[sample_count++];
+  size_t peak_rss;
+  s->t = (now - phase_start) * 1000.0;
+  s->phase = (phase_t)phase;
+  bench_process_rss(&s->rss, &peak_rss);
+  s->committed = stats.committed.current;
+  s->purged = stats.purged.allocated;
+  s->purge_calls = stats.purge_calls.total;
+  s->commit_calls = stats.commit_calls.total;
+}
+
+// the sampler is the last thread and also drives the phases
+static void sampler(void) {
+  const double ramp_end   = phase_start + RAMP_MS / 1000.0;
+  const double steady_end = ramp_end + STEADY_MS / 1000.0;
+  const double idle_end   = steady_end + IDLE_MS / 1000.0;
+  double now;
+  while ((now = bench_clock_now()) < idle_end) {
+    if (now >= steady_end) {
+      if (phase == PHASE_STEADY) { phase = PHASE_DROP; }
+      else if (phase == PHASE_DROP && now >= steady_end + SAMPLE_MS / 1000.0) { phase = PHASE_IDLE; }
+    }
+    else if (now >= ramp_end) { phase = PHASE_STEADY; }
+    take_sample(now);
+    bench_sleep_ms(SAMPLE_MS);
+  }
+  phase = PHASE_DONE;
+}
+
+static void bench_thread(intptr_t tid) {
+  if (tid == THREADS) { sampler(); }
+  else { worker(tid); }
+}
+
+
+// ------------------------------------------------------
+// Main
+// ------------------------------------------------------
+
+static const struct { const char* name; mi_option_t option; } options[] = {
+  { "purge_delay",        mi_option_purge_delay },
+  { "purge_extend_delay", mi_option_purge_extend_delay },
+  { "arena_purge_mult",   mi_option_arena_purge_mult },
+  { "purge_decommits",    mi_option_purge_decommits },
+  { "eager_commit_delay", mi_option_eager_commit_delay },
+};
+#define OPTION_COUNT  (sizeof(options)/sizeof(options[0]))
+
+static bool set_option(const char* arg) {
+  const char* eq = strchr(arg, '=');
+  if (eq == NULL) return false;
+  for (size_t i = 0; i < OPTION_COUNT; i++) {
+    if (strlen(options[i].name) == (size_t)(eq - arg) && strncmp(arg, options[i].name, (size_t)(eq - arg)) == 0) {
+      mi_option_set(options[i].option, strtol(eq + 1, NULL, 10));
+      return true;
+    }
+  }
+  return false;
+}
+
+// the time after the drop until the RSS returned `perc` percent of the way to `target`
+static void print_return_time(const char* name, size_t drop_index, size_t target, int perc) {
+  const size_t drop_rss = samples[drop_index].rss;
+  for (size_t i = drop_index; i < sample_count && drop_rss > target; i++) {
+    const size_t rss = (samples[i].rss < target ? target : samples[i].rss);
+    if (rss < drop_rss && (drop_rss - rss) * 100 >= (drop_rss - target) * (size_t)perc) {
+      printf("\"%s\": %.1f, ", name, samples[i].t - samples[drop_index].t);
+      return;
+    }
+  }
+  printf("\"%s\": null, ", name);
+}
+
+int main(int argc, char** argv) {
+  if (argc >= 2) {
+    long n = strtol(argv[1], NULL, 10);
+    if (n > 0) THREADS = (int)n;
+  }
+  if (argc >= 3) {
+    long n = strtol(argv[2], NULL, 10);
+    if (n > 0) SCALE = (int)n;
+  }
+  for (int i = 3; i < argc; i++) {
+    if (!set_option(argv[i])) {
+      fprintf(stderr, "error: unknown option \"%s\"\n", argv[i]);
+      return 1;
+    }
+  }
+  if (THREADS <= 0) { THREADS = bench_processors(); }
+
+  objects_per_thread = (size_t)SCALE * 200;
+  tdata = (thread_data_t*)custom_calloc((size_t)THREADS, sizeof(thread_data_t));
+  for (int t = 0; t < THREADS; t++) {
+    tdata[t].objects = (void**)custom_calloc(objects_per_thread, sizeof(void*));
+    tdata[t].sizes = (size_t*)custom_calloc(objects_per_thread, sizeof(size_t));
+  }
+  sample_max = (RAMP_MS + STEADY_MS + IDLE_MS) / SAMPLE_MS + 64;
+  samples = (sample_t*)custom_calloc(sample_max, sizeof(sample_t));
+
+  size_t baseline_rss, peak_rss;
+  bench_process_rss(&baseline_rss, &peak_rss);
+  phase_start = bench_clock_now();
+  bench_run_threads((size_t)THREADS + 1, &bench_thread);
+
+  // summary: the drop starts at the last sample of the steady state
+  size_t drop_index = 0;
+  size_t max_rss = 0;
+  for (size_t i = 0; i < sample_count; i++) {
+    if (samples[i].rss > max_rss) { max_rss = samples[i].rss; }
+    if (samples[i].phase < PHASE_DROP) { drop_index = i; }
+  }
+  size_t ops = 0;
+  size_t kept_live = 0;
+  for (int t = 0; t < THREADS; t++) {
+    ops += tdata[t].ops;
+    kept_live += tdata[t].kept;
+  }
+  const size_t target = baseline_rss + kept_live;
+  size_t elapsed, utime, stime, rss, commit, peak_commit, faults;
+  mi_process_info(&elapsed, &utime, &stime, &rss, &peak_rss, &commit, &peak_commit, &faults);
+  const sample_t* last = &samples[sample_count - 1];
+
+  printf("{\"bench\": \"purge\", \"allocator\": \"%s\", \"threads\": %d, \"scale\": %d, \"ops\": %zu, ",
+         BENCH_ALLOCATOR, THREADS, SCALE, ops);
+  printf("\"options\": {");
+  for (size_t i = 0; i < OPTION_COUNT; i++) {
+    printf("%s\"%s\": %ld", (i == 0 ? "" : ", "), options[i].name, mi_option_get(options[i].option));
+  }
+  printf("}, \"baseline_rss\": %zu, \"peak_rss\": %zu, \"drop_rss\": %zu, \"idle_rss\": %zu, \"kept_live\": %zu, ",
+         baseline_rss, max_rss, samples[drop_index].rss, last->rss, kept_live);
+  printf("\"drop_committed\": %lld, \"idle_committed\": %lld, ",
+         (long long)samples[drop_index].committed, (long long)last->committed);
+  print_return_time("return_50_ms", drop_index, target, 50);
+  print_return_time("return_90_ms", drop_index, target, 90);
+  printf("\"purged\": %lld, \"purge_calls\": %lld, \"commit_calls\": %lld, \"user_ms\": %zu, \"system_ms\": %zu,\n",
+         (long long)last->purged, (long long)last->purge_calls, (long long)last->commit_calls, utime, stime);
+  printf(" \"series\": [\n");
+  for (size_t i = 0; i < sample_count; i++) {
+    const sample_t* s = &samples[i];
+    printf("  {\"t\": %.1f, \"phase\": \"%s\", \"rss\": %zu, \"committed\": %lld, \"purged\": %lld, \"purge_calls\": %lld, \"commit_calls\": %lld}%s\n",
+           s->t, phase_names[s->phase], s->rss, (long long)s->committed, (long long)s->purged,
+           (long long)s->purge_calls, (long long)s->commit_calls, (i + 1 < sample_count ? "," : ""));
+  }
+  printf("]}\n");
+  return 0;
+}
@@ -0,0 +1,276 @@
+/* ----------------------------------------------------------------------------
+Copyright (c) 2018-2023, Microsoft Research, Daan Leijen
+This is free software; you can redistribute it and/or modify it under the
+terms of the MIT license. A copy of the license can be found in the file
+"LICENSE" at the root of this distribution.
+-----------------------------------------------------------------------------*/
+
+/* Replay an allocation trace recorded with the `mimalloc-trace` preload library:
+
+   > LD_PRELOAD=libmimalloc-trace.so MIMALLOC_TRACE_FILE=app.%p.trace ./app
+   > mimalloc-replay app.4242.trace
+
+   Each traced process writes its own file (`%p` is replaced by its process id), and
+   only the standard entry points (`malloc`, `free`, etc.) are recorded, not direct
+   calls to the `mi_` functions.
+
+   Each thread of the trace is replayed by its own thread in the original order.
+   When a thread frees (or reallocates) an object that another thread allocates,
+   it waits until that allocation has been replayed, so the cross-thread frees of
+   the original program are preserved. Allocated memory is touched once per 4KiB
+   (as a program would initialize it).
+
+   The tool reports the replay time, the peak and final RSS, and the peak and
+   final live bytes as JSON. The RSS after loading the trace is reported as the
+   `baseline_rss`, and the fragmentation is `(peak_rss - baseline_rss) / peak_live`.
+   `mimalloc-replay-sys` replays the trace against the system allocator, and any
+   mimalloc configuration can be evaluated using the `MIMALLOC_` environment options.
+*/
+
+#include "bench.h"
+#include "mimalloc/alloc-trace.h"
+
+#ifdef USE_STD_MALLOC
+static void* custom_aligned_alloc(size_t alignment, size_t size) {
+  #ifdef _WIN32
+  (void)alignment;    // cannot be freed with `free` if aligned with `_aligned_malloc`
+  return malloc(size);
+  #else
+  void* p = NULL;
+  if (alignment < sizeof(void*)) { alignment = sizeof(void*); }
+  return (posix_memalign(&p, alignment, size) == 0 ? p : NULL);
+  #endif
+}
+#else
+#define custom_aligned_alloc(a,s)  mi_malloc_aligned(s,a)
+#endif
+
+#define OBJ_PENDING   ((void*)1)   // allocated later in the trace
+#define OBJ_FAILED    ((void*)2)   // the allocation returned NULL
+
+typedef struct object_s {
+  void* volatile p;      // NULL if never allocated in the trace (or freed)
+  size_t         size;
+} object_t;
+
+typedef struct replay_thread_s {
+  mi_trace_record_t* records;
+  size_t             count;
+  object_t*          objects;     // indexed by the sequence number of the objects allocated by this thread
+  size_t             object_count;
+  volatile intptr_t  live;        // live bytes allocated or freed by this thread
+  intptr_t           peak_live;   // maximum of `live`
+  uint8_t            padding[64];
+} replay_thread_t;
+
+static replay_thread_t* threads;
+static size_t           thread_count;
+static volatile intptr_t threads_done;
+
+static size_t peak_live;
+static size_t peak_sampled_rss;
+
+
+// ------------------------------------------------------
+// Loading
+// ------------------------------------------------------
+
+static object_t* object_of(uint64_t id) {
+  const size_t t = (size_t)(id >> MI_TRACE_ID_THREAD_SHIFT);
+  const size_t seq = (size_t)(id & ((1ULL << MI_TRACE_ID_THREAD_SHIFT) - 1));
+  if (t >= thread_count || seq >= threads[t].object_count) return NULL;
+  return &threads[t].objects[seq];
+}
+
+static bool is_alloc(uint8_t op) {
+  return (op == MI_TRACE_MALLOC || op == MI_TRACE_CALLOC || op == MI_TRACE_ALIGNED || op == MI_TRACE_REALLOC);
+}
+
+static size_t load_trace(const char* fname) {
+  FILE* f = fopen(fname, "rb");
+  if (f == NULL) { fprintf(stderr, "error: cannot open trace \"%s\"\n", fname); exit(1); }
+  mi_trace_header_t header;
+  if (fread(&header, sizeof(header), 1, f) != 1 || memcmp(header.magic, MI_TRACE_MAGIC, sizeof(header.magic)) != 0 ||
+      header.version != MI_TRACE_VERSION || header.record_size != sizeof(mi_trace_record_t)) {
+    fprintf(stderr, "error: \"%s\" is not an allocation trace (of version %d)\n", fname, MI_TRACE_VERSION);
+    exit(1);
+  }
+  fseek(f, 0, SEEK_END);
+  const long fsize = ftell(f);
+  fseek(f, (long)sizeof(header), SEEK_SET);
+  const size_t count = (size_t)(fsize - (long)sizeof(header)) / sizeof(mi_trace_record_t);
+  mi_trace_record_t* records = (mi_trace_record_t*)custom_malloc((count == 0 ? 1 : count) * sizeof(mi_trace_record_t));
+  if (records == NULL || fread(records, sizeof(mi_trace_record_t), count, f) != count) {
+    fprintf(stderr, "error: cannot read the trace \"%s\"\n", fname);
+    exit(1);
+  }
+  fclose(f);
+
+  // count the threads, their records, and the objects they allocate
+  thread_count = 0;
+  for (size_t i = 0; i < count; i++) {
+    const size_t t = (size_t)records[i].thread;
+    const size_t t_alloc = (size_t)(records[i].id >> MI_TRACE_ID_THREAD_SHIFT);
+    if (t + 1 > thread_count) thread_count = t + 1;
+    if (t_alloc + 1 > thread_count) thread_count = t_alloc + 1;
+  }
+  threads = (replay_thread_t*)custom_calloc(thread_count + 1, sizeof(replay_thread_t));
+  for (size_t i = 0; i < count; i++) {
+    const mi_trace_record_t* rec = &records[i];
+    threads[rec->thread].count++;
+    if (is_alloc(rec->op)) {
+      replay_thread_t* owner = &threads[rec->id >> MI_TRACE_ID_THREAD_SHIFT];
+      const size_t seq = (size_t)(rec->id & ((1ULL << MI_TRACE_ID_THREAD_SHIFT) - 1));
+      if (seq + 1 > owner->object_count) owner->object_count = seq + 1;
+    }
+  }
+  for (size_t t = 0; t < thread_count; t++) {
+    threads[t].records = (mi_trace_record_t*)custom_malloc((threads[t].count + 1) * sizeof(mi_trace_record_t));
+    threads[t].objects = (object_t*)custom_calloc(threads[t].object_count + 1, sizeof(object_t));
+    threads[t].count = 0;
+  }
+  // mark the objects that are allocated in the trace
+  for (size_t i = 0; i < count; i++) {
+    if (is_alloc(records[i].op)) { object_of(records[i].id)->p = OBJ_PENDING; }
+  }
+  // split the records per thread, dropping frees of objects that were not allocated in the trace
+  size_t dropped = 0;
+  for (size_t i = 0; i < count; i++) {
+    mi_trace_record_t rec = records[i];
+    if (rec.op == MI_TRACE_FREE || (rec.op == MI_TRACE_REALLOC && rec.old_id != 0)) {
+      const uint64_t id = (rec.op == MI_TRACE_FREE ? rec.id : rec.old_id);
+      const object_t* obj = object_of(id);
+      if (obj == NULL || obj->p == NULL) {
+        dropped++;
+        if (rec.op == MI_TRACE_FREE) continue;
+        rec.old_id = 0;   // treat as a fresh allocation
+      }
+    }
+    threads[rec.thread].records[threads[rec.thread].count++] = rec;
+  }
+  if (dropped > 0) {
+    fprintf(stderr, "warning: %zu frees of objects that were allocated before tracing were dropped\n", dropped);
+  }
+  custom_free(records);
+  return count;
+}
+
+
+// ------------------------------------------------------
+// Replay
+// ------------------------------------------------------
+
+// wait until the object is allocated by its thread, and remove it
+static void* object_take(object_t* obj) {
+  void* p;
+  while ((p = bench_atomic_load_ptr(&obj->p)) == OBJ_PENDING) {
+    bench_yield();
+  }
+  bench_atomic_store_ptr(&obj->p, NULL);
+  return (p == OBJ_FAILED ? NULL : p);
+}
+
+static void live_add(replay_thread_t* thread, intptr_t size) {
+  thread->live += size;
+  if (thread->live > thread->peak_live) { thread->peak_live = thread->live; }
+}
+
+static void object_put(object_t* obj, void* p, size_t size) {
+  if (p != NULL) {
+    for (size_t i = 0; i < size; i += 4096) { ((volatile uint8_t*)p)[i] = 1; }  // touch
+  }
+  obj->size = size;
+  bench_atomic_store_ptr(&obj->p, (p == NULL ? OBJ_FAILED : p));
+}
+
+static void sample(void) {
+  intptr_t live = 0;
+  for (size_t t = 0; t < thread_count; t++) { live += threads[t].live; }
+  if (live > 0 && (size_t)live > peak_live) { peak_live = (size_t)live; }
+  size_t rss, peak_rss;
+  bench_process_rss(&rss, &peak_rss);
+  if (rss > peak_sampled_rss) { peak_sampled_rss = rss; }
+}
+
+static void replay_thread(intptr_t tid) {
+  if ((size_t)tid == thread_count) {
+    // sample the live bytes and RSS until all other threads are done
+    while ((size_t)threads_done < thread_count) {
+      sample();
+      bench_sleep_ms(1);
+    }
+    return;
+  }
+  replay_thread_t* thread = &threads[tid];
+  for (size_t i = 0; i < thread->count; i++) {
+    const mi_trace_record_t* rec = &thread->records[i];
+    const size_t size = (size_t)rec->size;
+    switch (rec->op) {
+      case MI_TRACE_MALLOC:
+        object_put(object_of(rec->id), custom_malloc(size), size);
+        live_add(thread, (intptr_t)size);
+        break;
+      case MI_TRACE_CALLOC:
+        object_put(object_of(rec->id), custom_calloc(1, size), size);
+        live_add(thread, (intptr_t)size);
+        break;
+      case MI_TRACE_ALIGNED:
+        object_put(object_of(rec->id), custom_aligned_alloc((size_t)1 << rec->align_shift, size), size);
+        live_add(thread, (intptr_t)size);
+        break;
+      case MI_TRACE_REALLOC: {
+        void* p = NULL;
+        if (rec->old_id != 0) {
+          object_t* old = object_of(rec->old_id);
+          p = object_take(old);
+          live_add(thread, -(intptr_t)old->size);
+        }
+        object_put(object_of(rec->id), custom_realloc(p, size), size);
+        live_add(thread, (intptr_t)size);
+        break;
+      }
+      case MI_TRACE_FREE: {
+        object_t* obj = object_of(rec->id);
+        custom_free(object_take(obj));
+        live_add(thread, -(intptr_t)obj->size);
+        break;
+      }
+      default:
+        break;
+    }
+  }
+  bench_atomic_add(&threads_done, 1);
+}
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s <trace file>\n", argv[0]);
+    return 1;
+  }
+  const size_t count = load_trace(argv[1]);
+  size_t baseline_rss, load_peak_rss, peak_rss, rss;
+  bench_process_rss(&baseline_rss, &load_peak_rss);
+
+  const double start = bench_clock_now();
+  bench_run_threads(thread_count + 1, &replay_thread);   // one extra thread samples the memory usage
+  const double seconds = bench_clock_now() - start;
+
+  // the sampled peaks are lower bounds; the peak of a single thread is exact
+  sample();
+  intptr_t final_live = 0;
+  for (size_t t = 0; t < thread_count; t++) {
+    final_live += threads[t].live;
+    if (threads[t].peak_live > 0 && (size_t)threads[t].peak_live > peak_live) { peak_live = (size_t)threads[t].peak_live; }
+  }
+  bench_process_rss(&rss, &peak_rss);
+  if (peak_rss <= load_peak_rss) { peak_rss = peak_sampled_rss; }   // the peak was reached while loading the trace
+  if (peak_rss < rss) { peak_rss = rss; }
+  const double frag = (peak_live > 0 && peak_rss > baseline_rss ? (double)(peak_rss - baseline_rss) / (double)peak_live : 0.0);
+  printf("{\"bench\": \"replay\", \"allocator\": \"%s\", \"trace\": \"%s\", \"threads\": %zu, \"ops\": %zu, "
+         "\"seconds\": %.6f, \"ops_per_sec\": %.1f, \"baseline_rss\": %zu, \"peak_rss\": %zu, \"final_rss\": %zu, "
+         "\"peak_live\": %zu, \"final_live\": %lld, \"frag\": %.3f}\n",
+         BENCH_ALLOCATOR, argv[1], thread_count, count,
+         seconds, (seconds > 0.0 ? (double)count / seconds : 0.0), baseline_rss, peak_rss, rss,
+         peak_live, (long long)final_live, frag);
+  return 0;
+}
@@ -0,0 +1,66 @@
+/* ----------------------------------------------------------------------------
+Copyright (c) 2018-2023, Microsoft Research, Daan Leijen
+This is free software; you can redistribute it and/or modify it under the
+terms of the MIT license. A copy of the license can be found in the file
+"LICENSE" at the root of this distribution.
+-----------------------------------------------------------------------------*/
+
+/* Allocation pattern in the style of `rptest` (the rpmalloc benchmark). Each
+   thread repeatedly allocates a batch of blocks of mixed sizes (16 bytes to
+   8KiB, skewed to small), keeps them alive for a short while, and then frees
+   them in a different order than they were allocated. A fraction of the blocks
+   (1 in 8) is handed over to the next thread through its inbox, and the block
+   that was in the inbox slot is freed instead.
+*/
+
+#include "bench.h"
+
+#define BATCH_SIZE    (512)
+#define INBOX_SIZE    (1024)
+#define MIN_SIZE      (16)
+#define MAX_SIZE      (8*1024)
+#define CROSS_RATE    (8)     // 1 in CROSS_RATE blocks is freed by another thread
+
+static void* volatile* inboxes;
+static size_t loops;
+
+static void rptest_thread(intptr_t tid) {
+  uintptr_t r = ((uintptr_t)tid + 1) * 43;
+  void* volatile* next_inbox = &inboxes[(((size_t)tid + 1) % (size_t)THREADS) * INBOX_SIZE];
+  void** batch = (void**)custom_calloc(BATCH_SIZE, sizeof(void*));
+  for (size_t i = 0; i < loops; i++) {
+    for (size_t j = 0; j < BATCH_SIZE; j++) {
+      const size_t size = pick_size_skewed(MIN_SIZE, MAX_SIZE, &r);
+      batch[j] = custom_malloc(size);
+      memset(batch[j], 0, MIN_SIZE);
+    }
+    // free in a different order: start at a random index and stride with an odd step
+    const size_t start = pick(&r) % BATCH_SIZE;
+    const size_t step  = 2*(pick(&r) % (BATCH_SIZE/2)) + 1;
+    for (size_t j = 0; j < BATCH_SIZE; j++) {
+      void* p = batch[(start + j*step) % BATCH_SIZE];
+      if (pick(&r) % CROSS_RATE == 0) {
+        p = bench_atomic_exchange_ptr(&next_inbox[pick(&r) % INBOX_SIZE], p);
+      }
+      custom_free(p);
+    }
+  }
+  custom_free(batch);
+}
+
+static void rptest(bench_result_t* result) {
+  loops = 200 * (size_t)SCALE;
+  inboxes = (void* volatile*)custom_calloc((size_t)THREADS * INBOX_SIZE, sizeof(void*));
+  const double start = bench_clock_now();
+  bench_run_threads(THREADS, &rptest_thread);
+  result->seconds = bench_clock_now() - start;
+  result->ops = (size_t)THREADS * loops * BATCH_SIZE;
+  for (size_t i = 0; i < (size_t)THREADS * INBOX_SIZE; i++) {
+    custom_free(inboxes[i]);
+  }
+  custom_free((void*)inboxes);
+}
+
+int main(int argc, char** argv) {
+  return bench_main("rptest", argc, argv, &rptest);
+}
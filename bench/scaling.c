@@ -0,0 +1,188 @@
+/* ----------------------------------------------------------------------------
+Copyright (c) 2018-2023, Microsoft Research, Daan Leijen
+This is free software; you can redistribute it and/or modify it under the
+terms of the MIT license. A copy of the license can be found in the file
+"LICENSE" at the root of this distribution.
+-----------------------------------------------------------------------------*/
+
+/* Thread scaling with a configurable ratio of cross-thread (remote) frees.
+   It sweeps the number of threads (1, 2, 4, ..., THREADS), the percentage of
+   remote frees (0, 25, 50, 75, and 100%), and small (8B-1KiB), medium (1KiB-128KiB),
+   and large (128KiB-512KiB) block sizes.
+
+   Each thread allocates blocks and keeps the last few in a local window; a block that
+   leaves the window is freed by the same thread. With the remote percentage, a block is
+   instead exchanged with a random slot that is shared by all threads, and the block that
+   was in that slot is freed, which is usually a block of another thread (with N threads
+   about (N-1)/N of those frees are remote).
+
+   For each run it reports the throughput and, in builds with statistics (`MI_STAT>0`,
+   as in debug builds), the contention of the cross-thread frees in `_mi_free_block_mt`:
+   the number of remote frees (`free_mt`), the failed CAS operations on the page
+   `xthread_free` list and the heap `thread_delayed_free` list (`free_mt_retries`), and the
+   remote frees that had to use the delayed free list of the heap as the page was full
+   (`free_delayed`, see `MI_USE_DELAYED_FREE`).
+
+   > mimalloc-bench-scaling [THREADS] [SCALE]
+*/
+
+#include "bench.h"
+
+#define WINDOW        (64)    // blocks kept locally per thread
+#define SLOTS_PER_THREAD  (64)
+
+typedef struct dist_s {
+  const char* name;
+  size_t      min_size;
+  size_t      max_size;
+  size_t      ops_div;        // fewer operations for larger sizes
+} dist_t;
+
+static const dist_t dists[] = {
+  { "small",  8,          1024,       1 },
+  { "medium", 1024,       128*1024,   4 },
+  { "large",  128*1024,   512*1024,   16 },
+};
+
+static const size_t remote_percs[] = { 0, 25, 50, 75, 100 };
+
+// parameters of the current run
+static const dist_t*  run_dist;
+static size_t         run_remote;
+static size_t         run_ops;         // per thread
+static void* volatile* slots;          // shared by all threads
+static size_t         slot_count;
+static volatile intptr_t ready;        // threads that are waiting to start
+static intptr_t       run_threads;
+
+
+// ------------------------------------------------------
+// Workload
+// ------------------------------------------------------
+
+static void run_thread(intptr_t tid) {
+  uintptr_t rnd = ((uintptr_t)tid + 1) * 0x9E3779B97F4A7C15ULL;
+  random_t r = &rnd;
+  void* window[WINDOW];
+  memset(window, 0, sizeof(window));
+  // start all threads at the same time so they run concurrently
+  bench_atomic_add(&ready, 1);
+  while (ready < run_threads) { bench_yield(); }
+  for (size_t i = 0; i < run_ops; i++) {
+    const size_t size = pick_size_skewed(run_dist->min_size, run_dist->max_size, r);
+    void* p = custom_malloc(size);
+    if (p != NULL) { *(volatile uint8_t*)p = (uint8_t)i; }
+    void* q;
+    if (run_remote > 0 && chance(run_remote, r)) {
+      q = bench_atomic_exchange_ptr(&slots[pick(r) % slot_count], p);
+    }
+    else {
+      q = window[i % WINDOW];
+      window[i % WINDOW] = p;
+    }
+    custom_free(q);
+  }
+  for (size_t i = 0; i < WINDOW; i++) { custom_free(window[i]); }
+}
+
+typedef struct counts_s {
+  int64_t free_mt;
+  int64_t free_mt_retries;
+  int64_t free_delayed;
+} counts_t;
+
+static counts_t counts_get(void) {
+  counts_t c = { 0, 0, 0 };
+  #ifndef USE_STD_MALLOC
+  mi_stats_snapshot_t stats;
+  if (mi_stats_get(&stats, sizeof(stats)) && stats.size >= sizeof(stats)) {
+    c.free_mt = stats.free_mt.count;
+    c.free_mt_retries = stats.free_mt_retries.count;
+    c.free_delayed = stats.free_delayed.count;
+  }
+  #endif
+  return c;
+}
+
+
+// are the counters maintained? (only in builds with statistics)
+static void* probe_block;
+static void probe_free(intptr_t tid) {
+  (void)tid;
+  custom_free(probe_block);
+}
+
+static bool counts_probe(void) {
+  const counts_t before = counts_get();
+  probe_block = custom_malloc(16);
+  bench_run_threads(1, &probe_free);
+  return (counts_get().free_mt > before.free_mt);
+}
+
+
+// ------------------------------------------------------
+// Main
+// ------------------------------------------------------
+
+int main(int argc, char** argv) {
+  if (argc >= 2) {
+    long n = strtol(argv[1], NULL, 10);
+    if (n > 0) THREADS = (int)n;
+  }
+  if (argc >= 3) {
+    long n = strtol(argv[2], NULL, 10);
+    if (n > 0) SCALE = (int)n;
+  }
+  if (THREADS <= 0) { THREADS = bench_processors(); }
+
+  // thread counts 1, 2, 4, ..., THREADS
+  int thread_counts[64];
+  size_t thread_runs = 0;
+  for (int n = 1; n < THREADS && thread_runs < 63; n *= 2) { thread_counts[thread_runs++] = n; }
+  thread_counts[thread_runs++] = THREADS;
+
+  slots = (void* volatile*)custom_calloc((size_t)THREADS * SLOTS_PER_THREAD, sizeof(void*));
+  const bool have_counts = counts_probe();
+  printf("{\"bench\": \"scaling\", \"allocator\": \"%s\", \"threads\": %d, \"scale\": %d, \"counts\": %s, \"runs\": [\n",
+         BENCH_ALLOCATOR, THREADS, SCALE, (have_counts ? "true" : "false"));
+  bool first = true;
+  for (size_t d = 0; d < sizeof(dists)/sizeof(dists[0]); d++) {
+    for (size_t rp = 0; rp < sizeof(remote_percs)/sizeof(remote_percs[0]); rp++) {
+      for (size_t tr = 0; tr < thread_runs; tr++) {
+        const int nthreads = thread_counts[tr];
+        run_dist = &dists[d];
+        run_remote = remote_percs[rp];
+        run_ops = (size_t)SCALE * 50000 / dists[d].ops_div;
+        run_threads = nthreads;
+        ready = 0;
+        slot_count = (size_t)nthreads * SLOTS_PER_THREAD;
+
+        const counts_t before = counts_get();
+        const double start = bench_clock_now();
+        bench_run_threads((size_t)nthreads, &run_thread);
+        const double seconds = bench_clock_now() - start;
+        const counts_t after = counts_get();
+        for (size_t i = 0; i < slot_count; i++) {
+          custom_free(slots[i]);
+          slots[i] = NULL;
+        }
+
+        const size_t ops = run_ops * (size_t)nthreads;
+        printf("%s  {\"threads\": %d, \"remote\": %zu, \"sizes\": \"%s\", \"ops\": %zu, \"seconds\": %.6f, \"ops_per_sec\": %.1f",
+               (first ? "" : ",\n"), nthreads, run_remote, run_dist->name, ops, seconds, (seconds > 0.0 ? (double)ops / seconds : 0.0));
+        if (have_counts) {
+          printf(", \"free_mt\": %lld, \"free_mt_retries\": %lld, \"free_delayed\": %lld}",
+                 (long long)(after.free_mt - before.free_mt), (long long)(after.free_mt_retries - before.free_mt_retries),
+                 (long long)(after.free_delayed - before.free_delayed));
+        }
+        else {
+          printf(", \"free_mt\": null, \"free_mt_retries\": null, \"free_delayed\": null}");
+        }
+        first = false;
+      }
+    }
+  }
+  printf("\n]}\n");
+  custom_free((void*)slots);
+  return 0;
+}
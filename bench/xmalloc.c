@@ -0,0 +1,82 @@
+/* ----------------------------------------------------------------------------
+Copyright (c) 2018-2023, Microsoft Research, Daan Leijen
+This is free software; you can redistribute it and/or modify it under the
+terms of the MIT license. A copy of the license can be found in the file
+"LICENSE" at the root of this distribution.
+-----------------------------------------------------------------------------*/
+
+/* Producer/consumer workload in the style of `xmalloc-test` (Lever and Boreham,
+   "malloc() performance in a multithreaded Linux environment", USENIX'00).
+   THREADS producer threads allocate batches of small blocks and hand them off
+   through a shared queue to THREADS consumer threads that free them, so (almost)
+   every free is a free from another thread.
+*/
+
+#include "bench.h"
+
+#define BATCH_SIZE    (64)
+#define MAX_SIZE      (128)
+#define QUEUE_SIZE    (256)
+
+typedef struct batch_s {
+  size_t count;
+  void*  blocks[BATCH_SIZE];
+} batch_t;
+
+static void* volatile queue[QUEUE_SIZE];
+static size_t batches_per_producer;
+static volatile intptr_t batches_left;
+
+static void producer(intptr_t tid) {
+  uintptr_t r = ((uintptr_t)tid + 1) * 43;
+  size_t slot = (size_t)tid;
+  for (size_t i = 0; i < batches_per_producer; i++) {
+    batch_t* batch = (batch_t*)custom_malloc(sizeof(batch_t));
+    batch->count = BATCH_SIZE;
+    for (size_t j = 0; j < BATCH_SIZE; j++) {
+      const size_t size = 1 + (pick(&r) % MAX_SIZE);
+      batch->blocks[j] = custom_malloc(size);
+      memset(batch->blocks[j], (int)j, size);
+    }
+    // find an empty slot in the queue
+    while (!bench_atomic_cas_ptr(&queue[slot % QUEUE_SIZE], NULL, batch)) {
+      slot++;
+      if (slot % QUEUE_SIZE == 0) { bench_yield(); }
+    }
+  }
+}
+
+static void consumer(intptr_t tid) {
+  size_t slot = (size_t)tid;
+  while (batches_left > 0) {
+    batch_t* batch = (batch_t*)bench_atomic_exchange_ptr(&queue[slot % QUEUE_SIZE], NULL);
+    slot++;
+    if (batch == NULL) {
+      if (slot % QUEUE_SIZE == 0) { bench_yield(); }
+      continue;
+    }
+    for (size_t j = 0; j < batch->count; j++) {
+      custom_free(batch->blocks[j]);
+    }
+    custom_free(batch);
+    bench_atomic_add(&batches_left, -1);
+  }
+}
+
+static void producer_consumer(intptr_t tid) {
+  if (tid % 2 == 0) { producer(tid / 2); }
+               else { consumer(tid / 2); }
+}
+
+static void xmalloc(bench_result_t* result) {
+  batches_per_producer = 1000 * (size_t)SCALE;
+  batches_left = (intptr_t)(batches_per_producer * (size_t)THREADS);
+  const double start = bench_clock_now();
+  bench_run_threads(2 * (size_t)THREADS, &producer_consumer);
+  result->seconds = bench_clock_now() - start;
+  result->ops = (size_t)THREADS * batches_per_producer * (BATCH_SIZE + 1);
+}
+
+int main(int argc, char** argv) {
+  return bench_main("xmalloc", argc, argv, &xmalloc);
+}
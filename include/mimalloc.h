@@ -151,6 +151,30 @@ mi_decl_export void mi_register_output(mi_output_fun* out, void* arg) mi_attr_no
 typedef void (mi_cdecl mi_error_fun)(int err, void* arg);
 mi_decl_export void mi_register_error(mi_error_fun* fun, void* arg);
 
+typedef void (mi_cdecl mi_watermark_fun)(size_t level, size_t usage, size_t limit, void* arg);
+mi_decl_export bool mi_register_watermark(size_t level, mi_watermark_fun* fun, void* arg) mi_attr_noexcept;
+
+// Coarse allocator events from the slow paths; `p` and `size` give the memory range of the event
+typedef enum mi_event_e {
+  mi_event_segment_alloc,       // a segment is allocated
+  mi_event_segment_free,        // a segment is freed
+  mi_event_segment_abandon,     // a segment is abandoned by its thread (when the thread terminates)
+  mi_event_segment_reclaim,     // an abandoned segment is reclaimed by another thread
+  mi_event_page_alloc,          // a page is allocated in a segment
+  mi_event_page_retire,         // a page is freed back to its segment
+  mi_event_huge_alloc,          // a huge block is allocated (in its own segment)
+  mi_event_huge_free,           // a huge block is freed
+  mi_event_os_commit,           // OS memory is committed
+  mi_event_os_decommit,         // OS memory is decommitted
+  mi_event_os_purge,            // OS memory is purged (decommitted or reset, see `mi_option_purge_decommits`)
+  _mi_event_last
+} mi_event_t;
+
+// Called on the thread that causes the event; events caused by the allocations of the callback itself are not reported.
+// Registration is thread safe: an event calls either the old or the new callback, each with its own argument.
+typedef void (mi_cdecl mi_event_fun)(mi_event_t event, void* p, size_t size, void* arg);
+mi_decl_export void mi_register_event(mi_event_fun* fun, void* arg) mi_attr_noexcept;
+
 mi_decl_export void mi_collect(bool force)    mi_attr_noexcept;
 mi_decl_export int  mi_version(void)          mi_attr_noexcept;
 mi_decl_export void mi_stats_reset(void)      mi_attr_noexcept;
@@ -167,6 +191,152 @@ mi_decl_export void mi_process_info(size_t* elapsed_msecs, size_t* user_msecs, s
                                     size_t* current_rss, size_t* peak_rss,
                                     size_t* current_commit, size_t* peak_commit, size_t* page_faults) mi_attr_noexcept;
 
+// Statistics snapshot of all threads; get one with `mi_stats_get(&snapshot, sizeof(snapshot))`.
+// Fields are only ever added at the end so a program built against an older header keeps working.
+#define MI_STATS_SNAPSHOT_VERSION  (3)
+#define MI_STATS_SNAPSHOT_BINS     (74)      // number of size classes (bins) of normal objects
+#define MI_STATS_LATENCY_BUCKETS   (32)      // number of log2 buckets of a latency histogram
+#define MI_STATS_LATENCY_KINDS     (16)      // room for latency histograms in the snapshot (at least `_mi_latency_last`)
+
+// Slow paths and OS calls with a latency histogram (see `mi_option_latency_stats`)
+typedef enum mi_latency_kind_e {
+  mi_latency_malloc_generic,      // `_mi_malloc_generic`: the allocation slow path
+  mi_latency_segment_alloc,       // reclaim an abandoned segment or allocate a fresh one
+  mi_latency_os_commit,           // commit OS memory (`_mi_os_commit`)
+  mi_latency_arena_purge,         // purge a range of an arena
+  mi_latency_abandoned_reclaim,   // reclaim all abandoned segments (`_mi_abandoned_reclaim_all`)
+  mi_latency_prim_alloc,          // `_mi_prim_alloc` (e.g. `mmap`)
+  mi_latency_prim_commit,         // `_mi_prim_commit`
+  mi_latency_prim_decommit,       // `_mi_prim_decommit`
+  mi_latency_prim_reset,          // `_mi_prim_reset`
+  mi_latency_prim_purge_batch,    // `_mi_prim_purge_batch` (e.g. `process_madvise`)
+  _mi_latency_last
+} mi_latency_kind_t;
+
+typedef struct mi_stat_count_snapshot_s {
+  int64_t allocated;
+  int64_t freed;
+  int64_t peak;
+  int64_t current;
+} mi_stat_count_snapshot_t;
+
+typedef struct mi_stat_counter_snapshot_s {
+  int64_t total;
+  int64_t count;
+} mi_stat_counter_snapshot_t;
+
+// Bucket `i > 0` counts the calls that took at least 2^(i-1) and less than 2^i timestamp counter ticks
+// (the last bucket counts all longer calls); `total` is the sum of the ticks.
+typedef struct mi_stat_latency_snapshot_s {
+  int64_t count;
+  int64_t total;
+  int64_t buckets[MI_STATS_LATENCY_BUCKETS];
+} mi_stat_latency_snapshot_t;
+
+typedef struct mi_stats_snapshot_s {
+  size_t version;                       // MI_STATS_SNAPSHOT_VERSION of the library
+  size_t size;                          // bytes filled in by the library
+  mi_stat_count_snapshot_t segments;
+  mi_stat_count_snapshot_t pages;
+  mi_stat_count_snapshot_t reserved;
+  mi_stat_count_snapshot_t committed;
+  mi_stat_count_snapshot_t reset;
+  mi_stat_count_snapshot_t purged;
+  mi_stat_count_snapshot_t page_committed;
+  mi_stat_count_snapshot_t segments_abandoned;
+  mi_stat_count_snapshot_t pages_abandoned;
+  mi_stat_count_snapshot_t threads;
+  mi_stat_count_snapshot_t normal;
+  mi_stat_count_snapshot_t huge;
+  mi_stat_count_snapshot_t large;
+  mi_stat_count_snapshot_t malloc;
+  mi_stat_count_snapshot_t segments_cache;
+  mi_stat_counter_snapshot_t pages_extended;
+  mi_stat_counter_snapshot_t mmap_calls;
+  mi_stat_counter_snapshot_t commit_calls;
+  mi_stat_counter_snapshot_t reset_calls;
+  mi_stat_counter_snapshot_t purge_calls;
+  mi_stat_counter_snapshot_t page_no_retire;
+  mi_stat_counter_snapshot_t searches;
+  mi_stat_counter_snapshot_t normal_count;
+  mi_stat_counter_snapshot_t huge_count;
+  mi_stat_counter_snapshot_t large_count;
+  mi_stat_counter_snapshot_t pages_remote;
+  mi_stat_counter_snapshot_t numa_migrations;
+  mi_stat_count_snapshot_t normal_bins[MI_STATS_SNAPSHOT_BINS];  // only maintained in builds with detailed statistics (MI_STAT>1)
+  mi_stat_latency_snapshot_t latency[MI_STATS_LATENCY_KINDS];    // since version 2; indexed by `mi_latency_kind_t` and only maintained with `mi_option_latency_stats`
+  mi_stat_counter_snapshot_t free_mt;                            // since version 3; cross-thread frees (only maintained in builds with statistics)
+  mi_stat_counter_snapshot_t free_mt_retries;                    // failed CAS operations of cross-thread frees
+  mi_stat_counter_snapshot_t free_delayed;                       // cross-thread frees to the `thread_delayed_free` list of a heap
+} mi_stats_snapshot_t;
+
+mi_decl_export bool mi_stats_get(mi_stats_snapshot_t* stats, size_t size) mi_attr_noexcept;
+mi_decl_export void mi_stats_print_json(mi_output_fun* out, void* arg) mi_attr_noexcept;
+
+// Write the live allocations sampled by the heap profiler (see `mi_option_profile_interval`) to the file descriptor `fd`
+// in the (text) heap profile format of pprof. Returns 0 on success or an error code.
+mi_decl_export int  mi_heap_profile_dump(int fd) mi_attr_noexcept;
+
+// Fragmentation of the segments and pages owned by the calling thread (and of the per-CPU heaps).
+// The visitor is called once for each segment with `page == NULL`, and then for each page in use in that segment;
+// return `false` to stop. The visitor should not allocate. Blocks freed by other threads that are not yet
+// collected still count as `used`.
+typedef struct mi_frag_segment_s {
+  const void* segment;            // start of the segment
+  size_t size;                    // size of the segment in bytes
+  size_t slice_size;              // size of a slice in bytes
+  size_t slices;                  // total number of slices
+  size_t used_slices;             // slices used by pages (including the segment info)
+  size_t free_slices;             // slices in free spans
+  size_t free_spans;              // number of free spans
+  size_t largest_free_span;       // slices in the largest free span
+  size_t committed;               // committed bytes
+  size_t pages;                   // pages in use
+} mi_frag_segment_t;
+
+typedef struct mi_frag_page_s {
+  const void* start;              // start of the page area
+  size_t size;                    // size of the page area in bytes
+  size_t block_size;              // size of the blocks (including padding)
+  size_t used;                    // blocks in use
+  size_t capacity;                // blocks that are initialized
+  size_t reserved;                // blocks that fit in the page
+} mi_frag_page_t;
+
+typedef bool (mi_cdecl mi_frag_visit_fun)(const mi_frag_segment_t* segment, const mi_frag_page_t* page, void* arg);
+mi_decl_export bool mi_frag_visit(mi_frag_visit_fun* visitor, void* arg) mi_attr_noexcept;
+
+// Summary of `mi_frag_visit` per size class. A page is sparse if less than a quarter of its blocks are in use;
+// `sparse_free` counts the free bytes trapped in sparse pages.
+typedef struct mi_frag_bin_s {
+  size_t block_size;
+  size_t pages;
+  size_t used;                    // blocks in use
+  size_t capacity;
+  size_t reserved;
+  size_t sparse_pages;
+  size_t sparse_free;
+} mi_frag_bin_t;
+
+typedef struct mi_frag_report_s {
+  size_t segments;
+  size_t slices;
+  size_t used_slices;
+  size_t free_slices;
+  size_t free_spans;
+  size_t largest_free_spans;      // sum over the segments of their largest free span
+  size_t committed;
+  size_t pages;
+  size_t page_reserved;           // bytes of the blocks that fit in the pages
+  size_t page_used;               // bytes of the blocks in use
+  size_t sparse_pages;
+  size_t sparse_free;
+  mi_frag_bin_t bins[MI_STATS_SNAPSHOT_BINS];
+} mi_frag_report_t;
+
+mi_decl_export void mi_frag_get(mi_frag_report_t* report) mi_attr_noexcept;
+mi_decl_export void mi_frag_print_json(mi_output_fun* out, void* arg) mi_attr_noexcept;
+
 // -------------------------------------------------------------------------------------
 // Aligned allocation
 // Note that `alignment` always follows `size` for consistency with unaligned
@@ -268,6 +438,26 @@ typedef bool (mi_cdecl mi_block_visit_fun)(const mi_heap_t* heap, const mi_heap_
 
 mi_decl_export bool mi_heap_visit_blocks(const mi_heap_t* heap, bool visit_all_blocks, mi_block_visit_fun* visitor, void* arg);
 
+// The live blocks of a heap that were allocated at the same site (see `mi_option_alloc_tags`).
+// The site is either a user tag (set with `mi_set_alloc_tag`), or the innermost return addresses of the allocation.
+// Blocks allocated while not tagging have an `id` of 0 (and there is a site with an `id` of `MI_ALLOC_SITE_OTHER` for the
+// blocks of any sites beyond the first few thousand).
+#define MI_ALLOC_SITE_OTHER  (0x7FFFFFFFU)
+
+typedef struct mi_alloc_site_s {
+  uint32_t     id;            // site id
+  uint32_t     tag;           // user tag (or 0)
+  size_t       frame_count;   // number of return addresses in `frames`
+  void* const* frames;        // return addresses (innermost first)
+  size_t       count;         // number of live blocks
+  size_t       size;          // total size in bytes of the live blocks
+} mi_alloc_site_t;
+
+typedef bool (mi_cdecl mi_alloc_site_fun)(const mi_heap_t* heap, const mi_alloc_site_t* site, void* arg);
+
+mi_decl_export bool     mi_heap_dump_live(mi_heap_t* heap, mi_alloc_site_fun* visitor, void* arg) mi_attr_noexcept;
+mi_decl_export uint32_t mi_set_alloc_tag(uint32_t tag) mi_attr_noexcept;  // set the (31-bit) tag of the following allocations in this thread (0 to use the return addresses); returns the previous tag
+
 // Experimental
 mi_decl_nodiscard mi_decl_export bool mi_is_in_heap_region(const void* p) mi_attr_noexcept;
 mi_decl_nodiscard mi_decl_export bool mi_is_redirected(void) mi_attr_noexcept;
@@ -287,11 +477,39 @@ mi_decl_export int   mi_reserve_huge_os_pages_at_ex(size_t pages, int numa_node,
 mi_decl_export int   mi_reserve_os_memory_ex(size_t size, bool commit, bool allow_large, bool exclusive, mi_arena_id_t* arena_id) mi_attr_noexcept;
 mi_decl_export bool  mi_manage_os_memory_ex(void* start, size_t size, bool is_committed, bool is_large, bool is_zero, int numa_node, bool exclusive, mi_arena_id_t* arena_id) mi_attr_noexcept;
 
+// Experimental: arena usage information (in arena blocks)
+typedef struct mi_arena_info_s {
+  void*  start;             // start of the arena memory
+  size_t block_size;        // size in bytes of one arena block
+  size_t block_count;       // total number of blocks
+  size_t blocks_inuse;      // blocks that are allocated
+  size_t blocks_committed;  // blocks that are committed
+  size_t blocks_dirty;      // blocks that were used at some point (and are potentially non-zero)
+  size_t blocks_purge;      // blocks scheduled to be purged
+  int    numa_node;         // associated NUMA node (or -1)
+  bool   is_exclusive;      // only used by heaps in this arena
+  bool   is_large;          // consists of large or huge OS pages
+} mi_arena_info_t;
+
+typedef bool (mi_cdecl mi_arena_visit_fun)(mi_arena_id_t arena_id, const mi_arena_info_t* info, void* arg);
+
+mi_decl_export bool  mi_arena_info(mi_arena_id_t arena_id, mi_arena_info_t* info) mi_attr_noexcept;
+mi_decl_export bool  mi_arenas_visit(mi_arena_visit_fun* visitor, void* arg) mi_attr_noexcept;
+
 #if MI_MALLOC_VERSION >= 182
 // Create a heap that only allocates in the specified arena
 mi_decl_nodiscard mi_decl_export mi_heap_t* mi_heap_new_in_arena(mi_arena_id_t arena_id);
 #endif
 
+// Experimental: heaps confined to an exclusive arena of at most 4GiB so pointers can be stored as 32-bit offsets from the base
+mi_decl_nodiscard mi_decl_export mi_heap_t* mi_heap_new_caged(size_t size);
+mi_decl_export void* mi_heap_cage_base(const mi_heap_t* heap, size_t* size) mi_attr_noexcept;
+
+// Experimental: copy-on-write snapshots of heaps in a shared (exclusive) arena
+mi_decl_export int   mi_reserve_os_memory_shared_ex(size_t size, mi_arena_id_t* arena_id) mi_attr_noexcept;
+mi_decl_nodiscard mi_decl_export const void* mi_heap_snapshot(mi_heap_t* heap, size_t* size) mi_attr_noexcept;
+mi_decl_export void  mi_heap_snapshot_free(const void* snapshot, size_t size) mi_attr_noexcept;
+
 // deprecated
 mi_decl_export int  mi_reserve_huge_os_pages(size_t pages, double max_secs, size_t* pages_reserved) mi_attr_noexcept;
 
@@ -348,6 +566,14 @@ typedef enum mi_option_e {
   mi_option_arena_reserve,            // initial memory size in KiB for arena reservation (1GiB on 64-bit)
   mi_option_arena_purge_mult,         
   mi_option_purge_extend_delay,
+  mi_option_os_reserve,               // reserve N KiB of virtual address space up front and allocate OS memory from it first (0 = disabled)
+  mi_option_percpu_heaps,             // allocate from per-CPU heaps instead of per-thread heaps (for processes with many more threads than cores)
+  mi_option_pressure_monitor,         // monitor the OS for memory pressure and purge more eagerly while under pressure
+  mi_option_memory_limit,             // hard limit in KiB on the memory usage of the process (0 = none); the soft limit is 90% of it
+  mi_option_memory_limit_cgroup,      // use the cgroup v2 `memory.high` and `memory.max` as the soft and hard memory limits (if `mi_option_memory_limit` is 0)
+  mi_option_profile_interval,         // sample an allocation on average every N KiB allocated by a thread for the heap profiler (0 = disabled)
+  mi_option_latency_stats,            // keep latency histograms of the allocator slow paths and OS calls (see `mi_stats_get`)
+  mi_option_alloc_tags,               // tag each allocation with its site (see `mi_heap_dump_live`); 2 = also print the live blocks by site in `mi_heap_destroy`
   _mi_option_last,
   // legacy option names
   mi_option_large_os_pages = mi_option_allow_large_os_pages,
@@ -0,0 +1,52 @@
+/* ----------------------------------------------------------------------------
+Copyright (c) 2018-2023, Microsoft Research, Daan Leijen
+This is free software; you can redistribute it and/or modify it under the
+terms of the MIT license. A copy of the license can be found in the file
+"LICENSE" at the root of this distribution.
+-----------------------------------------------------------------------------*/
+#pragma once
+#ifndef MIMALLOC_ALLOC_TRACE_H
+#define MIMALLOC_ALLOC_TRACE_H
+
+#include <stdint.h>
+
+/* ------------------------------------------------------------------------------------------------------
+The binary format of allocation traces as written by the `mimalloc-trace` preload library (`src/alloc-trace.c`)
+and read by `mimalloc-replay` (`bench/replay.c`).
+
+A trace starts with a `mi_trace_header_t` followed by fixed size records in native byte order. The records of
+each thread are in program order, but the records of different threads are interleaved in chunks (as the
+per-thread buffers are flushed). Objects are identified by a 64-bit id that is never reused:
+`(thread << MI_TRACE_ID_THREAD_SHIFT) | seq`, where `thread` is the index of the allocating thread and
+`seq` counts the allocations of that thread starting at 1 (so 0 is never a valid id).
+-------------------------------------------------------------------------------------------------------*/
+
+#define MI_TRACE_MAGIC              "mi-trace"
+#define MI_TRACE_VERSION            (1)
+#define MI_TRACE_ID_THREAD_SHIFT    (40)
+
+typedef enum mi_trace_op_e {
+  MI_TRACE_MALLOC  = 1,   // `id` of `size` bytes
+  MI_TRACE_CALLOC  = 2,   // `id` of `size` zero initialized bytes
+  MI_TRACE_ALIGNED = 3,   // `id` of `size` bytes aligned at `1 << align_shift`
+  MI_TRACE_REALLOC = 4,   // `old_id` (or 0) is reallocated as `id` of `size` bytes
+  MI_TRACE_FREE    = 5    // `id` is freed
+} mi_trace_op_t;
+
+typedef struct mi_trace_header_s {
+  char     magic[8];      // MI_TRACE_MAGIC (without the terminating zero)
+  uint32_t version;       // MI_TRACE_VERSION
+  uint32_t record_size;   // sizeof(mi_trace_record_t)
+} mi_trace_header_t;
+
+typedef struct mi_trace_record_s {
+  uint64_t id;            // the allocated (or freed) object
+  uint64_t old_id;        // for `MI_TRACE_REALLOC`: the original object (or 0)
+  uint64_t size;          // requested size in bytes
+  uint32_t thread;        // index of the thread that made the call
+  uint8_t  op;            // mi_trace_op_t
+  uint8_t  align_shift;   // for `MI_TRACE_ALIGNED`: log2 of the alignment
+  uint16_t reserved;
+} mi_trace_record_t;
+
+#endif
@@ -16,6 +16,7 @@ terms of the MIT license. A copy of the license can be found in the file
 
 #include "mimalloc/types.h"
 #include "mimalloc/track.h"
+#include "mimalloc/probe.h"
 
 #if (MI_DEBUG>0)
 #define mi_trace_message(...)  _mi_trace_message(__VA_ARGS__)
@@ -65,6 +66,15 @@ void       _mi_trace_message(const char* fmt, ...);
 void       _mi_options_init(void);
 void       _mi_error_message(int err, const char* fmt, ...);
 
+#if defined(__ANDROID__)
+// on Android the options are compile-time constants from the generated `mimalloc-android-options.h`
+#include "mimalloc-android-options.h"
+#define mi_option_get(option)                mi_android_option_get(option)
+#define mi_option_get_clamp(option,min,max)  mi_android_option_get_clamp(option,min,max)
+#define mi_option_get_size(option)           mi_android_option_get_size(option)
+#define mi_option_is_enabled(option)         mi_android_option_is_enabled(option)
+#endif
+
 // random.c
 void       _mi_random_init(mi_random_ctx_t* ctx);
 void       _mi_random_init_weak(mi_random_ctx_t* ctx);
@@ -85,6 +95,13 @@ mi_threadid_t _mi_thread_id(void) mi_attr_noexcept;
 mi_heap_t*    _mi_heap_main_get(void);     // statically allocated main backing heap
 void       _mi_thread_done(mi_heap_t* heap);
 void       _mi_thread_data_collect(void);
+mi_heap_t* _mi_heap_cpu_acquire(void);     // lock the heap of the current processor (or NULL if out of memory)
+mi_heap_t* _mi_heap_cpu_try_acquire(mi_threadid_t owner_id, bool wait);  // lock the per-CPU heap owning a segment (to free into it)
+void       _mi_heap_cpu_release(mi_heap_t* heap);
+bool       _mi_heap_cpu_is_held(const mi_heap_t* heap);
+void       _mi_heap_cpu_collect(bool force);
+void       _mi_heap_cpu_stats_merge(void);
+void       _mi_heap_cpu_visit(void (*visit)(mi_heap_t* heap, void* arg), void* arg);
 
 // os.c
 void       _mi_os_init(void);                                            // called from process init
@@ -105,6 +122,9 @@ bool       _mi_os_protect(void* addr, size_t size);
 bool       _mi_os_unprotect(void* addr, size_t size);
 bool       _mi_os_purge(void* p, size_t size, mi_stats_t* stats);
 bool       _mi_os_purge_ex(void* p, size_t size, bool allow_reset, mi_stats_t* stats);
+void       _mi_os_purge_batch_init(mi_purge_batch_t* batch);
+bool       _mi_os_purge_batch_add(mi_purge_batch_t* batch, void* p, size_t size, bool allow_reset, mi_stats_t* stats);
+bool       _mi_os_purge_batch_flush(mi_purge_batch_t* batch, mi_stats_t* stats);
 
 void*      _mi_os_alloc_aligned(size_t size, size_t alignment, bool commit, bool allow_large, mi_memid_t* memid, mi_stats_t* stats);
 void*      _mi_os_alloc_aligned_at_offset(size_t size, size_t alignment, size_t align_offset, bool commit, bool allow_large, mi_memid_t* memid, mi_stats_t* tld_stats);
@@ -113,7 +133,19 @@ void*      _mi_os_get_aligned_hint(size_t try_alignment, size_t size);
 bool       _mi_os_use_large_page(size_t size, size_t alignment);
 size_t     _mi_os_large_page_size(void);
 
-void*      _mi_os_alloc_huge_os_pages(size_t pages, int numa_node, mi_msecs_t max_secs, size_t* pages_reserved, size_t* psize, mi_memid_t* memid);
+void*      _mi_os_alloc_huge_os_pages(size_t pages, int numa_node, mi_msecs_t max_secs, bool prefault, size_t* pages_reserved, size_t* psize, mi_memid_t* memid);
+
+void       _mi_os_reserve_init(void);
+bool       _mi_os_reserve_contains(const void* p);
+bool       _mi_os_reserve_is_complete(void);
+void       _mi_os_reserve_note_outside(void);
+
+void       _mi_os_pressure_monitor_init(void);
+void       _mi_os_limit_init(void);
+bool       _mi_os_under_pressure(void);
+size_t     _mi_os_pressure_epoch(void);
+long       _mi_os_purge_delay(void);
+bool       _mi_os_purge_decommits(void);
 
 // arena.c
 mi_arena_id_t _mi_arena_id_none(void);
@@ -121,9 +153,14 @@ void       _mi_arena_free(void* p, size_t size, size_t still_committed_size, mi_
 void*      _mi_arena_alloc(size_t size, bool commit, bool allow_large, mi_arena_id_t req_arena_id, mi_memid_t* memid, mi_os_tld_t* tld);
 void*      _mi_arena_alloc_aligned(size_t size, size_t alignment, size_t align_offset, bool commit, bool allow_large, mi_arena_id_t req_arena_id, mi_memid_t* memid, mi_os_tld_t* tld);
 bool       _mi_arena_memid_is_suitable(mi_memid_t memid, mi_arena_id_t request_arena_id);
+int        _mi_arena_memid_numa_node(mi_memid_t memid);
 bool       _mi_arena_contains(const void* p);
 void       _mi_arena_collect(bool force_purge, mi_stats_t* stats);
 void       _mi_arena_unsafe_destroy_all(mi_stats_t* stats);
+bool       _mi_arena_reserve_cage(size_t size, mi_arena_id_t* arena_id);
+int        _mi_arena_reserve_huge_os_pages_interleave(size_t pages, size_t numa_nodes, size_t timeout_msecs, bool parallel);
+const void* _mi_arena_snapshot(mi_arena_id_t arena_id, size_t* size);
+void       _mi_arena_snapshot_free(const void* snapshot, size_t size);
 
 // "segment-map.c"
 void       _mi_segment_map_allocated_at(const mi_segment_t* segment);
@@ -177,11 +214,24 @@ bool       _mi_heap_memid_is_suitable(mi_heap_t* heap, mi_memid_t memid);
 void       _mi_heap_unsafe_destroy_all(void);
 
 // "stats.c"
+void       _mi_stats_init(void);                 // register the fork handlers
 void       _mi_stats_done(mi_stats_t* stats);
+void       _mi_stats_register(mi_tld_t* tld);    // track the statistics of a live thread (or per-CPU heap)
+void       _mi_stats_unregister(mi_tld_t* tld);  // merge them and stop tracking
+void       _mi_stats_aggregate(mi_stats_t* stats);  // sum the statistics of the main and all live threads
+void       _mi_stat_latency(mi_latency_kind_t kind, uint64_t ticks);  // add to the latency histogram of the current thread
+bool       _mi_stat_latency_format(const mi_stat_latency_t* stat, mi_latency_kind_t kind, char* buf, size_t len);
 mi_msecs_t  _mi_clock_now(void);
 mi_msecs_t  _mi_clock_end(mi_msecs_t start);
 mi_msecs_t  _mi_clock_start(void);
 
+// "profile.c"
+void       _mi_heap_profile_sample(mi_heap_t* heap, mi_page_t* page, mi_block_t* block, size_t size);  // called when the `profile_countdown` of a heap expires (on each allocation while tagging)
+void       _mi_heap_profile_free(const mi_block_t* block);                 // called when freeing a block in a page that `has_sampled`
+void       _mi_heap_profile_free_page(const mi_segment_t* segment, mi_page_t* page);  // called when destroying a page that `has_sampled`
+void       _mi_page_tags_free(mi_page_t* page);                            // called when freeing a page with allocation site `tags`
+void       _mi_heap_tags_print_live(mi_heap_t* heap);
+
 // "alloc.c"
 void*       _mi_page_malloc(mi_heap_t* heap, mi_page_t* page, size_t size, bool zero) mi_attr_noexcept;  // called from `_mi_malloc_generic`
 void*       _mi_heap_malloc_zero(mi_heap_t* heap, size_t size, bool zero) mi_attr_noexcept;
@@ -191,8 +241,12 @@ mi_block_t* _mi_page_ptr_unalign(const mi_segment_t* segment, const mi_page_t* p
 bool        _mi_free_delayed_block(mi_block_t* block);
 void        _mi_free_generic(const mi_segment_t* segment, mi_page_t* page, bool is_local, void* p) mi_attr_noexcept;  // for runtime integration
 void        _mi_padding_shrink(const mi_page_t* page, const mi_block_t* block, const size_t min_size);
+#if MI_TRACE_ALLOCS
+void        _mi_trace_thread_done(void);   // flush the allocation trace buffer of this thread
+void        _mi_trace_done(void);          // flush all allocation trace buffers at process exit
+#endif
 
-// option.c, c primitives
+// libc.c
 char        _mi_toupper(char c);
 int         _mi_strnicmp(const char* s, const char* t, size_t n);
 void        _mi_strlcpy(char* dest, const char* src, size_t dest_size);
@@ -221,6 +275,13 @@ bool        _mi_page_is_valid(mi_page_t* page);
 #define mi_likely(x)       (x)
 #endif
 
+// Allocator events (see `mi_register_event`): a single branch if no callback is registered
+extern _Atomic(mi_event_fun*) _mi_event_fun;
+void _mi_event_emit(mi_event_t event, void* p, size_t size);
+
+#define mi_event(event,p,size) \
+  do { if mi_unlikely(mi_atomic_load_ptr_relaxed(mi_event_fun, &_mi_event_fun) != NULL) { _mi_event_emit(event, (void*)(p), size); } } while(0)
+
 #ifndef __has_builtin
 #define __has_builtin(x)  0
 #endif
@@ -581,6 +642,14 @@ static inline void mi_page_set_has_aligned(mi_page_t* page, bool has_aligned) {
   page->flags.x.has_aligned = has_aligned;
 }
 
+static inline bool mi_page_has_sampled(const mi_page_t* page) {
+  return page->flags.x.has_sampled;
+}
+
+static inline void mi_page_set_has_sampled(mi_page_t* page, bool has_sampled) {
+  page->flags.x.has_sampled = has_sampled;
+}
+
 
 /* -------------------------------------------------------------------
 Encoding/Decoding the free list next pointers
@@ -906,6 +975,57 @@ static inline size_t mi_bsr(uintptr_t x) {
   return (x==0 ? MI_INTPTR_BITS : MI_INTPTR_BITS - 1 - mi_clz(x));
 }
 
+// Return the number of bits set in `x`
+static inline size_t mi_popcount(uintptr_t x) {
+#if defined(__GNUC__)
+  #if (INTPTR_MAX == LONG_MAX)
+  return (size_t)__builtin_popcountl(x);
+  #else
+  return (size_t)__builtin_popcountll(x);
+  #endif
+#else
+  size_t count = 0;
+  for (; x != 0; x &= (x - 1)) { count++; }
+  return count;
+#endif
+}
+
+
+// ---------------------------------------------------------------------------------
+// Latency histograms (see `mi_option_latency_stats`). A slow path is timed with
+// the timestamp counter as:
+//
+//   const mi_ticks_t start = mi_latency_start();
+//   ...
+//   mi_latency_end(mi_latency_xxx, start);
+//
+// which only costs reading the (cached) option when the histograms are disabled.
+// ---------------------------------------------------------------------------------
+
+typedef uint64_t mi_ticks_t;
+
+static inline mi_ticks_t _mi_ticks(void) {
+#if defined(_MSC_VER) && !defined(__clang__) && (defined(_M_IX86) || defined(_M_X64))
+  return (mi_ticks_t)__rdtsc();
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+  return (mi_ticks_t)__builtin_ia32_rdtsc();
+#elif (defined(__GNUC__) || defined(__clang__)) && defined(__aarch64__)
+  uint64_t ticks;
+  __asm__ volatile("mrs %0, cntvct_el0" : "=r"(ticks));
+  return ticks;
+#else
+  return (mi_ticks_t)_mi_clock_now();  // milli-seconds
+#endif
+}
+
+static inline mi_ticks_t mi_latency_start(void) {
+  return (mi_option_is_enabled(mi_option_latency_stats) ? _mi_ticks() : 0);
+}
+
+static inline void mi_latency_end(mi_latency_kind_t kind, mi_ticks_t start) {
+  if mi_unlikely(start != 0) { _mi_stat_latency(kind, _mi_ticks() - start); }
+}
+
 
 // ---------------------------------------------------------------------------------
 // Provide our own `_mi_memcpy` for potential performance optimizations.
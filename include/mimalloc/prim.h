@@ -45,6 +45,11 @@ int _mi_prim_free(void* addr, size_t size );
 //      try_alignment >= _mi_os_page_size() and a power of 2
 int _mi_prim_alloc(size_t size, size_t try_alignment, bool commit, bool allow_large, bool* is_large, bool* is_zero, void** addr);
 
+// Reserve a (large) range of virtual address space without committing or accounting any memory for it
+// (e.g. `MAP_NORESERVE` on Linux). The range is later committed piecewise using `_mi_prim_commit`.
+// Returns ENOSYS if virtual reservation is not supported.
+int _mi_prim_reserve(size_t size, void** addr);
+
 // Commit memory. Returns error code or 0 on success.
 // For example, on Linux this would make the memory PROT_READ|PROT_WRITE.
 // `is_zero` is set to true if the memory was zero initialized (e.g. on Windows)
@@ -60,6 +65,11 @@ int _mi_prim_decommit(void* addr, size_t size, bool* needs_recommit);
 // Returns error code or 0 on success.
 int _mi_prim_reset(void* addr, size_t size);
 
+// Decommit (or reset if `decommit` is false) `count` ranges at once using a single system call.
+// Returns ENOSYS if this is not supported in which case the ranges are purged one by one.
+// pre: needs_recommit != NULL, all ranges are page aligned
+int _mi_prim_purge_batch(const mi_os_range_t* ranges, size_t count, bool decommit, bool* needs_recommit);
+
 // Protect memory. Returns error code or 0 on success.
 int _mi_prim_protect(void* addr, size_t size, bool protect);
 
@@ -69,12 +79,51 @@ int _mi_prim_protect(void* addr, size_t size, bool protect);
 //      numa_node is either negative (don't care), or a numa node number.
 int _mi_prim_alloc_huge_os_pages(void* hint_addr, size_t size, int numa_node, bool* is_zero, void** addr);
 
+// Map a fresh (zero initialized) anonymous shared memory file of `size` bytes over the reserved range
+// at `addr` so the memory can later be mapped a second time. The file descriptor is returned in `fd`.
+// Returns ENOSYS if shared memory files are not supported.
+int _mi_prim_alloc_shared(void* addr, size_t size, int* fd);
+
+// Map the shared memory file `fd` read-only at a new address `snapshot`, and remap the range at `addr`
+// copy-on-write so further writes to it no longer reach the file (and the snapshot stays frozen).
+int _mi_prim_snapshot_shared(int fd, void* addr, size_t size, void** snapshot);
+
+// Close a shared memory file and remap `addr` (of `size` bytes) as private inaccessible
+// memory again, so the range can be reused for regular allocations (e.g. in the up-front reservation).
+int _mi_prim_free_shared(int fd, void* addr, size_t size);
+
 // Return the current NUMA node
 size_t _mi_prim_numa_node(void);
 
 // Return the number of logical NUMA nodes
 size_t _mi_prim_numa_node_count(void);
 
+// Return the processor the current thread runs on. Returns `false` if this
+// cannot be determined cheaply (i.e. without a system call).
+bool _mi_prim_cpu_id(size_t* cpu);
+
+// Call `fun(arg,node)` for each `node` in `[0,node_count)` on its own helper thread that is bound to the 
+// processors of that NUMA node (if possible), and wait until all helper threads have terminated.
+// If a helper thread cannot be created, `fun` is called for that node on the current thread instead.
+// The `fun` must not allocate from a mimalloc heap.
+typedef void (mi_prim_numa_fun_t)(void* arg, size_t node);
+void _mi_prim_numa_run_parallel(size_t node_count, mi_prim_numa_fun_t* fun, void* arg);
+
+// Start monitoring the OS for memory pressure on a helper thread. It calls `fun(arg,true)`
+// when memory pressure is detected (possibly repeatedly while the pressure lasts), and
+// `fun(arg,false)` once the pressure is gone. Returns 0 on success. The `fun` must not
+// allocate from a mimalloc heap.
+typedef void (mi_prim_pressure_fun_t)(void* arg, bool under_pressure);
+int _mi_prim_pressure_monitor_start(mi_prim_pressure_fun_t* fun, void* arg);
+
+// Detect the memory limits of the process (like the cgroup v2 `memory.high` and `memory.max`).
+// A limit is 0 if there is none. Returns `false` if no limits were found.
+bool _mi_prim_memory_limits(size_t* soft_limit, size_t* hard_limit);
+
+// Return the current memory usage: the usage of the cgroup if `cgroup` is set (and limits were found),
+// and otherwise the resident set size of the process (or the commit charge on Windows).
+bool _mi_prim_memory_usage(bool cgroup, size_t* usage);
+
 // Clock ticks
 mi_msecs_t _mi_prim_clock_now(void);
 
@@ -96,6 +145,31 @@ void _mi_prim_process_info(mi_process_info_t* pinfo);
 // msg != NULL && _mi_strlen(msg) > 0
 void _mi_prim_out_stderr( const char* msg );
 
+// Capture the return addresses of the current call stack into `frames` (skipping the `skip` innermost frames).
+// Returns the number of captured frames (0 if stack unwinding is not supported). Must not allocate.
+size_t _mi_prim_backtrace(void** frames, size_t max_frames, size_t skip);
+
+// Write `size` bytes of `buf` to the file descriptor `fd`. Returns 0 on success or an error code.
+int _mi_prim_write(int fd, const void* buf, size_t size);
+
+// Create (or truncate) the file at `fpath` for writing (used for allocation traces).
+// Returns a file descriptor for `_mi_prim_write`, or -1 on error.
+int _mi_prim_file_create(const char* fpath);
+
+// Close a file descriptor returned by `_mi_prim_file_create`.
+void _mi_prim_file_close(int fd);
+
+// Return the id of the current process.
+size_t _mi_prim_getpid(void);
+
+// Register functions that are called before and after a `fork` (in the parent and the child).
+// Returns `false` if this is not supported (or fails).
+bool _mi_prim_atfork(void (*prepare)(void), void (*parent)(void), void (*child)(void));
+
+// Write the memory mappings of the process (in the format of `/proc/self/maps`) to `fd`
+// (used to symbolize heap profiles). Returns ENOSYS if this is not supported.
+int _mi_prim_write_mappings(int fd);
+
 // Get an environment variable. (only for options)
 // name != NULL, result != NULL, result_size >= 64
 bool _mi_prim_getenv(const char* name, char* result, size_t result_size);
@@ -0,0 +1,42 @@
+/* ----------------------------------------------------------------------------
+Copyright (c) 2018-2023, Microsoft Research, Daan Leijen
+This is free software; you can redistribute it and/or modify it under the
+terms of the MIT license. A copy of the license can be found in the file
+"LICENSE" at the root of this distribution.
+-----------------------------------------------------------------------------*/
+#pragma once
+#ifndef MIMALLOC_PROBE_H
+#define MIMALLOC_PROBE_H
+
+/* ------------------------------------------------------------------------------------------------------
+Static tracepoints (USDT) on the allocator slow paths for tools like `bpftrace` and `perf`.
+They are compiled in with `MI_USDT=1` (the `MI_USDT` CMake option) and are a single `nop`
+when not traced. All probes are in the `mimalloc` provider:
+
+  segment_alloc(segment, size)        segment_free(segment, size)
+  segment_abandon(segment, used)      segment_reclaim(segment, heap)
+  page_alloc(heap, page, block_size)  page_retire(heap, page, block_size)   page_free(heap, page, block_size)
+  huge_alloc(heap, page, size)
+  arena_alloc(p, size, arena_id)      arena_purge(p, size)
+  os_commit(p, size)                  os_decommit(p, size)                os_reset(p, size)
+  thread_init(heap)                   thread_done(heap)
+
+For example: `bpftrace -e 'usdt:./libmimalloc.so:mimalloc:os_commit { @[ustack] = sum(arg1); }'`
+-------------------------------------------------------------------------------------------------------*/
+
+#if MI_USDT
+#include <sys/sdt.h>
+
+#define mi_probe1(name,a1)          DTRACE_PROBE1(mimalloc, name, a1)
+#define mi_probe2(name,a1,a2)       DTRACE_PROBE2(mimalloc, name, a1, a2)
+#define mi_probe3(name,a1,a2,a3)    DTRACE_PROBE3(mimalloc, name, a1, a2, a3)
+
+#else
+
+#define mi_probe1(name,a1)
+#define mi_probe2(name,a1,a2)
+#define mi_probe3(name,a1,a2,a3)
+
+#endif
+
+#endif
@@ -216,6 +216,9 @@ typedef uintptr_t  mi_encoded_t;
 // thread id's
 typedef size_t     mi_threadid_t;
 
+// per-CPU heaps own their segments through an id with the lowest bit set (thread id's are aligned addresses)
+#define MI_CPU_HEAP_OWNER_BIT  ((mi_threadid_t)1)
+
 // free lists contain blocks
 typedef struct mi_block_s {
   mi_encoded_t next;
@@ -231,23 +234,25 @@ typedef enum mi_delayed_e {
 } mi_delayed_t;
 
 
-// The `in_full` and `has_aligned` page flags are put in a union to efficiently
-// test if both are false (`full_aligned == 0`) in the `mi_free` routine.
+// The `in_full`, `has_aligned`, and `has_sampled` page flags are put in a union to efficiently
+// test if all are false (`full_aligned == 0`) in the `mi_free` routine.
 #if !MI_TSAN
 typedef union mi_page_flags_s {
   uint8_t full_aligned;
   struct {
     uint8_t in_full : 1;
     uint8_t has_aligned : 1;
+    uint8_t has_sampled : 1;  // contains blocks sampled by the heap profiler (see `profile.c`)
   } x;
 } mi_page_flags_t;
 #else
 // under thread sanitizer, use a byte for each flag to suppress warning, issue #130
 typedef union mi_page_flags_s {
-  uint16_t full_aligned;
+  uint32_t full_aligned;
   struct {
     uint8_t in_full;
     uint8_t has_aligned;
+    uint8_t has_sampled;
   } x;
 } mi_page_flags_t;
 #endif
@@ -316,11 +321,9 @@ typedef struct mi_page_s {
 
   struct mi_page_s*     next;              // next page owned by this thread with the same `block_size`
   struct mi_page_s*     prev;              // previous page owned by this thread with the same `block_size`
+  struct mi_page_tags_s* tags;             // allocation site of each block (if allocations are tagged, see `profile.c`)
 
-  // 64-bit 9 words, 32-bit 12 words, (+2 for secure)
-  #if MI_INTPTR_SIZE==8
-  uintptr_t padding[1];
-  #endif
+  // 64-bit 10 words, 32-bit 13 words, (+2 for secure)
 } mi_page_t;
 
 
@@ -379,11 +382,12 @@ typedef enum mi_memkind_e {
   MI_MEM_OS,        // allocated from the OS
   MI_MEM_OS_HUGE,   // allocated as huge os pages
   MI_MEM_OS_REMAP,  // allocated in a remapable area (i.e. using `mremap`)
+  MI_MEM_OS_RESERVED, // allocated from the up-front reserved virtual address range (see `mi_option_os_reserve`)
   MI_MEM_ARENA      // allocated from an arena (the usual case)
 } mi_memkind_t;
 
 static inline bool mi_memkind_is_os(mi_memkind_t memkind) {
-  return (memkind >= MI_MEM_OS && memkind <= MI_MEM_OS_REMAP);
+  return (memkind >= MI_MEM_OS && memkind <= MI_MEM_OS_RESERVED);
 }
 
 typedef struct mi_memid_os_info {
@@ -418,6 +422,8 @@ typedef struct mi_segment_s {
   bool              allow_decommit;
   bool              allow_purge;
   size_t            segment_size;
+  int               numa_node;          // numa node of the memory (or of the allocating thread if unknown)
+  size_t            numa_epoch;         // numa epoch of the owning thread when allocated or reclaimed (see `mi_os_tld_t`)
 
   // segment fields
   mi_msecs_t        purge_expire;
@@ -499,6 +505,7 @@ typedef struct mi_padding_s {
 // A heap owns a set of pages.
 struct mi_heap_s {
   mi_tld_t*             tld;
+  ptrdiff_t             profile_countdown;                   // bytes to allocate until the next sample of the heap profiler (see `profile.c`)
   mi_page_t*            pages_free_direct[MI_PAGES_DIRECT];  // optimize: array where every entry points a page with possibly free blocks in the corresponding queue for that size.
   mi_page_queue_t       pages[MI_BIN_FULL + 1];              // queue of pages for each size class (or "bin")
   _Atomic(mi_block_t*)  thread_delayed_free;
@@ -512,6 +519,9 @@ struct mi_heap_s {
   size_t                page_retired_max;                    // largest retired index into the `pages` array.
   mi_heap_t*            next;                                // list of heaps per thread
   bool                  no_reclaim;                          // `true` if this heap should not reclaim abandoned pages
+  bool                  cpu_heaps;                           // `true` if allocation is redirected to the per-CPU heaps (see `mi_option_percpu_heaps`)
+  bool                  tag_allocs;                          // `true` if each allocation is tagged with its site (see `mi_option_alloc_tags`)
+  ptrdiff_t             sample_countdown;                    // bytes to allocate until the next sample while tagging (as `profile_countdown` is then kept at zero)
 };
 
 
@@ -574,6 +584,12 @@ typedef struct mi_stat_counter_s {
   int64_t count;
 } mi_stat_counter_t;
 
+typedef struct mi_stat_latency_s {
+  int64_t count;
+  int64_t total;    // in timestamp counter ticks
+  int64_t buckets[MI_STATS_LATENCY_BUCKETS];
+} mi_stat_latency_t;
+
 typedef struct mi_stats_s {
   mi_stat_count_t segments;
   mi_stat_count_t pages;
@@ -600,6 +616,12 @@ typedef struct mi_stats_s {
   mi_stat_counter_t normal_count;
   mi_stat_counter_t huge_count;
   mi_stat_counter_t large_count;
+  mi_stat_counter_t pages_remote;     // pages allocated in a segment on another numa node than the thread
+  mi_stat_counter_t numa_migrations;  // threads seen on a different numa node than before
+  mi_stat_counter_t free_mt;          // frees from a thread that does not own the page (`_mi_free_block_mt`)
+  mi_stat_counter_t free_mt_retries;  // failed CAS operations of those frees (contention)
+  mi_stat_counter_t free_delayed;     // of those, the frees that went to the heap `thread_delayed_free` list
+  mi_stat_latency_t latency[_mi_latency_last];
 #if MI_STAT>1
   mi_stat_count_t normal_bins[MI_BIN_HUGE+1];
 #endif
@@ -638,10 +660,27 @@ typedef struct mi_span_queue_s {
 
 #define MI_SEGMENT_BIN_MAX (35)     // 35 == mi_segment_bin(MI_SLICES_PER_SEGMENT)
 
+// A batch of address ranges that are purged together with as few system calls as possible.
+// Adjacent ranges are merged. Owners of the memory must flush the batch before the memory can be reused.
+#define MI_PURGE_BATCH_MAX  (32)
+
+typedef struct mi_os_range_s {
+  void*         start;
+  size_t        size;
+} mi_os_range_t;
+
+typedef struct mi_purge_batch_s {
+  bool          decommit;     // decommit the ranges (or reset if false)
+  size_t        count;        // number of ranges in use
+  mi_os_range_t ranges[MI_PURGE_BATCH_MAX];
+} mi_purge_batch_t;
+
 // OS thread local data
 typedef struct mi_os_tld_s {
   size_t                region_idx;   // start point for next allocation
   mi_stats_t*           stats;        // points to tld stats
+  int                   numa_node;    // last seen numa node of the thread (-1 if not yet known)
+  size_t                numa_epoch;   // incremented each time the thread is seen on a different numa node
 } mi_os_tld_t;
 
 
@@ -654,16 +693,20 @@ typedef struct mi_segments_tld_s {
   size_t              peak_size;    // peak size of all segments
   mi_stats_t*         stats;        // points to tld stats
   mi_os_tld_t*        os;           // points to os stats
+  mi_threadid_t       owner_id;     // owner of new and reclaimed segments (0 for the current thread, or the id of a per-CPU heap)
 } mi_segments_tld_t;
 
 // Thread local data
 struct mi_tld_s {
   unsigned long long  heartbeat;     // monotonic heartbeat count
   bool                recurse;       // true if deferred was called; used to prevent infinite recursion.
+  size_t              pressure_epoch; // last memory pressure event seen by this thread (see `_mi_os_pressure_epoch`)
   mi_heap_t*          heap_backing;  // backing heap of this thread (cannot be deleted)
   mi_heap_t*          heaps;         // list of heaps in this thread (so we can abandon all when the thread terminates)
   mi_segments_tld_t   segments;      // segment tld
   mi_os_tld_t         os;            // os tld
+  mi_tld_t*           stats_next;    // list of the statistics of all live threads (see `stats.c`)
+  mi_tld_t*           stats_prev;
   mi_stats_t          stats;         // statistics
 };
 
@@ -15,9 +15,25 @@ terms of the MIT license. A copy of the license can be found in the file
 // Aligned Allocation
 // ------------------------------------------------------
 
+static void* mi_heap_malloc_zero_aligned_at(mi_heap_t* const heap, const size_t size, const size_t alignment, const size_t offset, const bool zero) mi_attr_noexcept;
+
+// Allocate from the per-CPU heap instead of the thread heap (see `mi_option_percpu_heaps`)
+// (we hold it for the whole allocation as aligning updates the page flags)
+static mi_decl_noinline void* mi_heap_malloc_zero_aligned_at_cpu(const size_t size, const size_t alignment, const size_t offset, const bool zero) mi_attr_noexcept {
+  mi_heap_t* const heap = _mi_heap_cpu_acquire();
+  if (heap == NULL) return NULL;
+  void* const p = mi_heap_malloc_zero_aligned_at(heap, size, alignment, offset, zero);
+  _mi_heap_cpu_release(heap);
+  return p;
+}
+
 // Fallback primitive aligned allocation -- split out for better codegen
 static mi_decl_noinline void* mi_heap_malloc_zero_aligned_at_fallback(mi_heap_t* const heap, const size_t size, const size_t alignment, const size_t offset, const bool zero) mi_attr_noexcept
 {
+  // a backing heap that redirects to the per-CPU heaps has no pages, so its fast path always ends up here
+  if mi_unlikely((mi_heap_is_initialized(heap) ? heap : mi_heap_get_default())->cpu_heaps) {
+    return mi_heap_malloc_zero_aligned_at_cpu(size, alignment, offset, zero);
+  }
   mi_assert_internal(size <= PTRDIFF_MAX);
   mi_assert_internal(alignment != 0 && _mi_is_power_of_two(alignment));
 
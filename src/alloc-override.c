@@ -29,6 +29,30 @@ typedef struct mi_nothrow_s { int _tag; } mi_nothrow_t;
 // Override system malloc
 // ------------------------------------------------------
 
+#if MI_TRACE_ALLOCS
+  // in the `mimalloc-trace` library all entry points record the calls in a trace (see `alloc-trace.c`)
+  #define mi_malloc                   mi_traced_malloc
+  #define mi_calloc                   mi_traced_calloc
+  #define mi_realloc                  mi_traced_realloc
+  #define mi_reallocf                 mi_traced_reallocf
+  #define mi_reallocarray             mi_traced_reallocarray
+  #define mi_reallocarr               mi_traced_reallocarr
+  #define mi_free                     mi_traced_free
+  #define mi_cfree                    mi_traced_cfree
+  #define mi_free_size                mi_traced_free_size
+  #define mi_free_aligned             mi_traced_free_aligned
+  #define mi_free_size_aligned        mi_traced_free_size_aligned
+  #define mi_new                      mi_traced_new
+  #define mi_new_nothrow              mi_traced_new_nothrow
+  #define mi_new_aligned              mi_traced_new_aligned
+  #define mi_new_aligned_nothrow      mi_traced_new_aligned_nothrow
+  #define mi_aligned_alloc            mi_traced_aligned_alloc
+  #define mi_memalign                 mi_traced_memalign
+  #define mi_posix_memalign           mi_traced_posix_memalign
+  #define mi_valloc                   mi_traced_valloc
+  #define mi_pvalloc                  mi_traced_pvalloc
+#endif
+
 #if (defined(__GNUC__) || defined(__clang__)) && !defined(__APPLE__) && !MI_TRACK_ENABLED
   // gcc, clang: use aliasing to alias the exported function to one of our `mi_` functions
   #if (defined(__GNUC__) && __GNUC__ >= 9)
@@ -294,4 +318,27 @@ void* _aligned_malloc(size_t alignment, size_t size)    { return mi_aligned_allo
 #pragma GCC visibility pop
 #endif
 
+#if MI_TRACE_ALLOCS
+  #undef mi_malloc
+  #undef mi_calloc
+  #undef mi_realloc
+  #undef mi_reallocf
+  #undef mi_reallocarray
+  #undef mi_reallocarr
+  #undef mi_free
+  #undef mi_cfree
+  #undef mi_free_size
+  #undef mi_free_aligned
+  #undef mi_free_size_aligned
+  #undef mi_new
+  #undef mi_new_nothrow
+  #undef mi_new_aligned
+  #undef mi_new_aligned_nothrow
+  #undef mi_aligned_alloc
+  #undef mi_memalign
+  #undef mi_posix_memalign
+  #undef mi_valloc
+  #undef mi_pvalloc
+#endif
+
 #endif // MI_MALLOC_OVERRIDE && !_WIN32
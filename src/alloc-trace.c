@@ -0,0 +1,521 @@
+/* ----------------------------------------------------------------------------
+Copyright (c) 2018-2023, Microsoft Research, Daan Leijen
+This is free software; you can redistribute it and/or modify it under the
+terms of the MIT license. A copy of the license can be found in the file
+"LICENSE" at the root of this distribution.
+-----------------------------------------------------------------------------*/
+
+#if !defined(MI_IN_ALLOC_C)
+#error "this file should be included from 'alloc.c' (so aliases can work)"
+#endif
+
+#if MI_TRACE_ALLOCS
+
+#include "mimalloc/alloc-trace.h"
+
+/* -----------------------------------------------------------
+  Allocation trace recorder
+
+  This is only compiled into the `mimalloc-trace` preload library where
+  the overridden entry points (in `alloc-override.c`) call the `mi_traced_`
+  functions below instead of the plain `mi_` ones. So only the standard
+  entry points (`malloc`, `free`, `new`, etc.) are recorded; a program that
+  calls the `mi_` functions directly (like `test-stress`) is not traced.
+  Each call is appended as a `mi_trace_record_t` to a buffer of the calling
+  thread that is written to the trace file when it is full and when the
+  thread terminates.
+
+  Each process writes its own trace file: `MIMALLOC_TRACE_FILE` (or
+  `mimalloc.%p.trace`) where `%p` is replaced by the process id (which is
+  appended if the name has no `%p`). So child processes and wrappers (like
+  `timeout`) do not overwrite the trace of their parent. A forked child
+  starts a fresh trace in its own file.
+
+  Objects are recorded by id instead of address: the id of each live block
+  is kept in a hash map from addresses to ids that is split in stripes
+  with their own spin lock and is allocated from the OS (so the recorder
+  does not change the heap layout of the traced program).
+----------------------------------------------------------- */
+
+#define MI_TRACE_STRIPES_SHIFT  (8)
+#define MI_TRACE_STRIPES        (1UL << MI_TRACE_STRIPES_SHIFT)
+#define MI_TRACE_STRIPE_MIN     (1024)     // initial entries in a stripe
+#define MI_TRACE_BUFFER_SIZE    (8192)     // records per thread buffer
+
+static void mi_trace_lock(_Atomic(uintptr_t)* lock) {
+  uintptr_t expected = 0;
+  while (!mi_atomic_cas_weak_acq_rel(lock, &expected, (uintptr_t)1)) {
+    expected = 0;
+    mi_atomic_yield();
+  }
+}
+
+static void mi_trace_unlock(_Atomic(uintptr_t)* lock) {
+  mi_atomic_store_release(lock, (uintptr_t)0);
+}
+
+
+// ------------------------------------------------------
+// Map from addresses to object ids
+// ------------------------------------------------------
+
+typedef struct mi_trace_entry_s {
+  const void* p;          // NULL if the entry is free
+  uint64_t    id;
+} mi_trace_entry_t;
+
+typedef struct mi_trace_stripe_s {
+  _Atomic(uintptr_t) lock;
+  size_t             count;
+  size_t             capacity;  // a power of 2
+  size_t             shift;     // MI_INTPTR_BITS - log2(capacity)
+  mi_trace_entry_t*  entries;
+  mi_memid_t         memid;
+} mi_trace_stripe_t;
+
+static mi_trace_stripe_t mi_trace_stripes[MI_TRACE_STRIPES];
+
+static uintptr_t mi_trace_hash(const void* p) {
+  return ((uintptr_t)p >> 3) * (uintptr_t)0x9E3779B97F4A7C15ULL;  // fibonacci hashing
+}
+
+// the top bits of the hash select the stripe, and the following bits the entry
+static mi_trace_stripe_t* mi_trace_stripe_of(uintptr_t h) {
+  return &mi_trace_stripes[h >> (MI_INTPTR_BITS - MI_TRACE_STRIPES_SHIFT)];
+}
+
+static size_t mi_trace_home(const mi_trace_stripe_t* stripe, uintptr_t h) {
+  return (size_t)((h << MI_TRACE_STRIPES_SHIFT) >> stripe->shift);
+}
+
+static void mi_trace_stripe_put(mi_trace_stripe_t* stripe, const void* p, uint64_t id) {
+  size_t i = mi_trace_home(stripe, mi_trace_hash(p));
+  while (stripe->entries[i].p != NULL) {
+    i = (i + 1) & (stripe->capacity - 1);
+  }
+  stripe->entries[i].p = p;
+  stripe->entries[i].id = id;
+  stripe->count++;
+}
+
+// grow the stripe to twice its capacity (called with the lock held)
+static bool mi_trace_stripe_grow(mi_trace_stripe_t* stripe) {
+  const size_t capacity = (stripe->capacity == 0 ? MI_TRACE_STRIPE_MIN : 2*stripe->capacity);
+  mi_memid_t memid;
+  mi_trace_entry_t* entries = (mi_trace_entry_t*)_mi_os_alloc(capacity * sizeof(mi_trace_entry_t), &memid, &_mi_stats_main);  // zero initialized
+  if (entries == NULL) return false;
+  mi_trace_stripe_t old = *stripe;
+  stripe->count = 0;
+  stripe->capacity = capacity;
+  stripe->shift = MI_INTPTR_BITS - mi_bsr(capacity);
+  stripe->entries = entries;
+  stripe->memid = memid;
+  for (size_t i = 0; i < old.capacity; i++) {
+    if (old.entries[i].p != NULL) { mi_trace_stripe_put(stripe, old.entries[i].p, old.entries[i].id); }
+  }
+  if (old.entries != NULL) {
+    _mi_os_free(old.entries, old.capacity * sizeof(mi_trace_entry_t), old.memid, &_mi_stats_main);
+  }
+  return true;
+}
+
+static void mi_trace_map_insert(const void* p, uint64_t id) {
+  mi_trace_stripe_t* stripe = mi_trace_stripe_of(mi_trace_hash(p));
+  mi_trace_lock(&stripe->lock);
+  if (4*(stripe->count + 1) <= 3*stripe->capacity || mi_trace_stripe_grow(stripe)) {
+    mi_trace_stripe_put(stripe, p, id);
+  }
+  mi_trace_unlock(&stripe->lock);
+}
+
+// Remove `p` and return its id (or 0 if it is not known)
+static uint64_t mi_trace_map_remove(const void* p) {
+  const uintptr_t h = mi_trace_hash(p);
+  mi_trace_stripe_t* stripe = mi_trace_stripe_of(h);
+  uint64_t id = 0;
+  mi_trace_lock(&stripe->lock);
+  if (stripe->capacity > 0) {
+    const size_t mask = stripe->capacity - 1;
+    size_t i = mi_trace_home(stripe, h);
+    while (stripe->entries[i].p != NULL && stripe->entries[i].p != p) {
+      i = (i + 1) & mask;
+    }
+    if (stripe->entries[i].p == p) {
+      id = stripe->entries[i].id;
+      // shift back later entries of the same probe run into the hole at `i`
+      size_t j = i;
+      while (true) {
+        j = (j + 1) & mask;
+        const mi_trace_entry_t* e = &stripe->entries[j];
+        if (e->p == NULL) break;
+        const size_t home = mi_trace_home(stripe, mi_trace_hash(e->p));
+        const bool in_range = (i <= j ? (i < home && home <= j) : (i < home || home <= j));
+        if (!in_range) {
+          stripe->entries[i] = *e;
+          i = j;
+        }
+      }
+      stripe->entries[i].p = NULL;
+      stripe->count--;
+    }
+  }
+  mi_trace_unlock(&stripe->lock);
+  return id;
+}
+
+
+// ------------------------------------------------------
+// Trace file
+// ------------------------------------------------------
+
+static _Atomic(uintptr_t) mi_trace_file_lock;   // = 0
+static int mi_trace_fd = -1;                     // -2 if the file could not be created
+
+// Append the decimal `n` to `buf` (of which `len` is in use); returns the new length
+static size_t mi_trace_name_append_num(char* buf, size_t len, size_t size, size_t n) {
+  char digits[24];
+  size_t count = 0;
+  do {
+    digits[count++] = (char)('0' + (n % 10));
+    n /= 10;
+  } while (n != 0);
+  while (count > 0 && len + 1 < size) { buf[len++] = digits[--count]; }
+  buf[len] = 0;
+  return len;
+}
+
+// The name of the trace file of this process (with `%p` replaced by the process id)
+static void mi_trace_file_name(char* fname, size_t size) {
+  char pattern[256];
+  if (!_mi_prim_getenv("MIMALLOC_TRACE_FILE", pattern, sizeof(pattern)) || pattern[0] == 0) {
+    _mi_strlcpy(pattern, "mimalloc.%p.trace", sizeof(pattern));
+  }
+  const size_t pid = _mi_prim_getpid();
+  bool has_pid = false;
+  size_t len = 0;
+  fname[0] = 0;
+  for (const char* s = pattern; *s != 0 && len + 1 < size; s++) {
+    if (s[0] == '%' && s[1] == 'p') {
+      len = mi_trace_name_append_num(fname, len, size, pid);
+      has_pid = true;
+      s++;
+    }
+    else {
+      fname[len++] = *s;
+      fname[len] = 0;
+    }
+  }
+  if (!has_pid && len + 1 < size) {
+    fname[len++] = '.';
+    mi_trace_name_append_num(fname, len, size, pid);
+  }
+}
+
+// Write to the trace file (called with the file lock held)
+static void mi_trace_file_write(const void* buf, size_t size) {
+  if (mi_trace_fd == -1) {
+    char fname[256];
+    mi_trace_file_name(fname, sizeof(fname));
+    mi_trace_fd = _mi_prim_file_create(fname);
+    if (mi_trace_fd < 0) {
+      _mi_warning_message("unable to create the allocation trace file \"%s\"\n", fname);
+      mi_trace_fd = -2;
+    }
+    else {
+      mi_trace_header_t header;
+      _mi_memzero(&header, sizeof(header));
+      _mi_memcpy(header.magic, MI_TRACE_MAGIC, sizeof(header.magic));
+      header.version = MI_TRACE_VERSION;
+      header.record_size = (uint32_t)sizeof(mi_trace_record_t);
+      _mi_prim_write(mi_trace_fd, &header, sizeof(header));
+    }
+  }
+  if (mi_trace_fd >= 0) {
+    _mi_prim_write(mi_trace_fd, buf, size);
+  }
+}
+
+
+// ------------------------------------------------------
+// Thread buffers
+// ------------------------------------------------------
+
+typedef struct mi_trace_buffer_s {
+  struct mi_trace_buffer_s* next;     // in the list of all buffers
+  _Atomic(uintptr_t)  in_use;
+  uint32_t            thread;         // index of the owning thread
+  uint64_t            seq;            // allocations of the owning thread
+  size_t              count;
+  mi_memid_t          memid;
+  mi_trace_record_t   records[MI_TRACE_BUFFER_SIZE];
+} mi_trace_buffer_t;
+
+static _Atomic(mi_trace_buffer_t*) mi_trace_buffers;      // all buffers (never freed)
+static _Atomic(uintptr_t)          mi_trace_thread_count;
+static mi_decl_thread mi_trace_buffer_t* mi_trace_buffer; // buffer of this thread
+
+static void mi_trace_buffer_flush(mi_trace_buffer_t* buf) {
+  if (buf->count == 0) return;
+  mi_trace_lock(&mi_trace_file_lock);
+  mi_trace_file_write(buf->records, buf->count * sizeof(mi_trace_record_t));
+  mi_trace_unlock(&mi_trace_file_lock);
+  buf->count = 0;
+}
+
+// ------------------------------------------------------
+// Fork: the child starts a fresh trace in its own file
+// ------------------------------------------------------
+
+static _Atomic(uintptr_t) mi_trace_atfork_registered;  // = 0
+
+// hold all locks during the fork so the child gets the trace state in a consistent state
+static void mi_trace_fork_prepare(void) {
+  mi_trace_lock(&mi_trace_file_lock);
+  for (size_t i = 0; i < MI_TRACE_STRIPES; i++) { mi_trace_lock(&mi_trace_stripes[i].lock); }
+}
+
+static void mi_trace_fork_parent(void) {
+  for (size_t i = 0; i < MI_TRACE_STRIPES; i++) { mi_trace_unlock(&mi_trace_stripes[i].lock); }
+  mi_trace_unlock(&mi_trace_file_lock);
+}
+
+// In the child, drop the records and object ids of the parent and reopen the trace file
+// (only the forking thread runs in the child)
+static void mi_trace_fork_child(void) {
+  for (size_t i = 0; i < MI_TRACE_STRIPES; i++) {
+    mi_trace_stripe_t* stripe = &mi_trace_stripes[i];
+    if (stripe->entries != NULL) { _mi_memzero(stripe->entries, stripe->capacity * sizeof(mi_trace_entry_t)); }
+    stripe->count = 0;
+  }
+  for (mi_trace_buffer_t* buf = mi_atomic_load_ptr_acquire(mi_trace_buffer_t, &mi_trace_buffers); buf != NULL; buf = buf->next) {
+    buf->count = 0;
+    mi_atomic_store_release(&buf->in_use, (uintptr_t)(buf == mi_trace_buffer ? 1 : 0));
+  }
+  if (mi_trace_fd >= 0) { _mi_prim_file_close(mi_trace_fd); }
+  mi_trace_fd = -1;
+  mi_trace_fork_parent();
+}
+
+// Get a buffer for this thread: reuse one of a terminated thread or allocate a fresh one
+static mi_decl_noinline mi_trace_buffer_t* mi_trace_buffer_claim(void) {
+  mi_trace_buffer_t* buf;
+  for (buf = mi_atomic_load_ptr_acquire(mi_trace_buffer_t, &mi_trace_buffers); buf != NULL; buf = buf->next) {
+    uintptr_t expected = 0;
+    if (mi_atomic_load_relaxed(&buf->in_use) == 0 && mi_atomic_cas_strong_acq_rel(&buf->in_use, &expected, (uintptr_t)1)) break;
+  }
+  if (buf == NULL) {
+    mi_memid_t memid;
+    buf = (mi_trace_buffer_t*)_mi_os_alloc(sizeof(mi_trace_buffer_t), &memid, &_mi_stats_main);  // zero initialized
+    if (buf == NULL) return NULL;
+    buf->memid = memid;
+    mi_atomic_store_release(&buf->in_use, (uintptr_t)1);
+    mi_trace_buffer_t* head = mi_atomic_load_ptr_relaxed(mi_trace_buffer_t, &mi_trace_buffers);
+    do {
+      buf->next = head;
+    } while (!mi_atomic_cas_ptr_weak_release(mi_trace_buffer_t, &mi_trace_buffers, &head, buf));
+  }
+  buf->thread = (uint32_t)mi_atomic_increment_relaxed(&mi_trace_thread_count);
+  buf->seq = 0;
+  buf->count = 0;
+  mi_trace_buffer = buf;
+  // register the fork handlers on first use (after setting the buffer as this may allocate)
+  uintptr_t expected = 0;
+  if (mi_atomic_load_relaxed(&mi_trace_atfork_registered) == 0 &&
+      mi_atomic_cas_strong_acq_rel(&mi_trace_atfork_registered, &expected, (uintptr_t)1)) {
+    _mi_prim_atfork(&mi_trace_fork_prepare, &mi_trace_fork_parent, &mi_trace_fork_child);
+  }
+  return buf;
+}
+
+static void mi_trace_append(mi_trace_buffer_t* buf, mi_trace_op_t op, uint64_t id, uint64_t old_id, size_t size, size_t alignment) {
+  mi_trace_record_t* rec = &buf->records[buf->count++];
+  rec->id = id;
+  rec->old_id = old_id;
+  rec->size = size;
+  rec->thread = buf->thread;
+  rec->op = (uint8_t)op;
+  rec->align_shift = (uint8_t)(alignment <= 1 ? 0 : mi_bsr(alignment));
+  rec->reserved = 0;
+  if (buf->count >= MI_TRACE_BUFFER_SIZE) { mi_trace_buffer_flush(buf); }
+}
+
+// Record an allocation of `p` (with `old_id` if it was reallocated)
+static void mi_trace_alloc(void* p, mi_trace_op_t op, size_t size, size_t alignment, uint64_t old_id) {
+  if (p == NULL) return;
+  mi_trace_buffer_t* buf = mi_trace_buffer;
+  if mi_unlikely(buf == NULL) {
+    buf = mi_trace_buffer_claim();
+    if (buf == NULL) return;
+  }
+  const uint64_t id = ((uint64_t)buf->thread << MI_TRACE_ID_THREAD_SHIFT) | (++buf->seq);
+  mi_trace_map_insert(p, id);
+  mi_trace_append(buf, op, id, old_id, size, alignment);
+}
+
+// Record a free of the object with `id`
+static void mi_trace_free(uint64_t id) {
+  if (id == 0) return;   // not allocated while tracing
+  mi_trace_buffer_t* buf = mi_trace_buffer;
+  if mi_unlikely(buf == NULL) {
+    buf = mi_trace_buffer_claim();
+    if (buf == NULL) return;
+  }
+  mi_trace_append(buf, MI_TRACE_FREE, id, 0, 0, 0);
+}
+
+static uint64_t mi_trace_remove(void* p) {
+  return (p == NULL ? 0 : mi_trace_map_remove(p));
+}
+
+void _mi_trace_thread_done(void) {
+  mi_trace_buffer_t* buf = mi_trace_buffer;
+  if (buf == NULL) return;
+  mi_trace_buffer_flush(buf);
+  mi_trace_buffer = NULL;
+  mi_atomic_store_release(&buf->in_use, (uintptr_t)0);
+}
+
+// Flush the buffer of the exiting thread at process exit. The buffers of other threads
+// are still in use by those threads (which can run concurrently) and are skipped, so the
+// records of threads that are still running at exit may be lost (terminated threads
+// already flushed theirs in `_mi_trace_thread_done`).
+void _mi_trace_done(void) {
+  _mi_trace_thread_done();
+}
+
+
+// ------------------------------------------------------
+// Traced entry points
+// ------------------------------------------------------
+
+void* mi_traced_malloc(size_t size) mi_attr_noexcept {
+  void* p = mi_malloc(size);
+  mi_trace_alloc(p, MI_TRACE_MALLOC, size, 0, 0);
+  return p;
+}
+
+void* mi_traced_calloc(size_t count, size_t size) mi_attr_noexcept {
+  void* p = mi_calloc(count, size);
+  mi_trace_alloc(p, MI_TRACE_CALLOC, count*size, 0, 0);
+  return p;
+}
+
+void* mi_traced_realloc(void* p, size_t newsize) mi_attr_noexcept {
+  const uint64_t old_id = mi_trace_remove(p);
+  void* q = mi_realloc(p, newsize);
+  if (q == NULL) {
+    if (old_id != 0) { mi_trace_map_insert(p, old_id); }  // `p` is still valid
+    return NULL;
+  }
+  mi_trace_alloc(q, MI_TRACE_REALLOC, newsize, 0, old_id);
+  return q;
+}
+
+void* mi_traced_reallocf(void* p, size_t newsize) mi_attr_noexcept {
+  const uint64_t old_id = mi_trace_remove(p);
+  void* q = mi_reallocf(p, newsize);
+  if (q == NULL) {
+    mi_trace_free(old_id);   // `p` was freed
+    return NULL;
+  }
+  mi_trace_alloc(q, MI_TRACE_REALLOC, newsize, 0, old_id);
+  return q;
+}
+
+void* mi_traced_reallocarray(void* p, size_t count, size_t size) mi_attr_noexcept {
+  size_t total;
+  if (mi_count_size_overflow(count, size, &total)) { errno = EOVERFLOW; return NULL; }
+  return mi_traced_realloc(p, total);
+}
+
+int mi_traced_reallocarr(void* p, size_t count, size_t size) mi_attr_noexcept {
+  mi_assert(p != NULL);
+  if (p == NULL) { errno = EINVAL; return EINVAL; }
+  void** op = (void**)p;
+  void* newp = mi_traced_reallocarray(*op, count, size);
+  if mi_unlikely(newp == NULL) { return errno; }
+  *op = newp;
+  return 0;
+}
+
+void mi_traced_free(void* p) mi_attr_noexcept {
+  mi_trace_free(mi_trace_remove(p));
+  mi_free(p);
+}
+
+void mi_traced_cfree(void* p) mi_attr_noexcept {
+  if (mi_is_in_heap_region(p)) {
+    mi_traced_free(p);
+  }
+}
+
+void mi_traced_free_size(void* p, size_t size) mi_attr_noexcept {
+  mi_trace_free(mi_trace_remove(p));
+  mi_free_size(p, size);
+}
+
+void mi_traced_free_aligned(void* p, size_t alignment) mi_attr_noexcept {
+  mi_trace_free(mi_trace_remove(p));
+  mi_free_aligned(p, alignment);
+}
+
+void mi_traced_free_size_aligned(void* p, size_t size, size_t alignment) mi_attr_noexcept {
+  mi_trace_free(mi_trace_remove(p));
+  mi_free_size_aligned(p, size, alignment);
+}
+
+void* mi_traced_new(size_t size) {
+  void* p = mi_new(size);
+  mi_trace_alloc(p, MI_TRACE_MALLOC, size, 0, 0);
+  return p;
+}
+
+void* mi_traced_new_nothrow(size_t size) mi_attr_noexcept {
+  void* p = mi_new_nothrow(size);
+  mi_trace_alloc(p, MI_TRACE_MALLOC, size, 0, 0);
+  return p;
+}
+
+void* mi_traced_new_aligned(size_t size, size_t alignment) {
+  void* p = mi_new_aligned(size, alignment);
+  mi_trace_alloc(p, MI_TRACE_ALIGNED, size, alignment, 0);
+  return p;
+}
+
+void* mi_traced_new_aligned_nothrow(size_t size, size_t alignment) mi_attr_noexcept {
+  void* p = mi_new_aligned_nothrow(size, alignment);
+  mi_trace_alloc(p, MI_TRACE_ALIGNED, size, alignment, 0);
+  return p;
+}
+
+void* mi_traced_aligned_alloc(size_t alignment, size_t size) mi_attr_noexcept {
+  void* p = mi_aligned_alloc(alignment, size);
+  mi_trace_alloc(p, MI_TRACE_ALIGNED, size, alignment, 0);
+  return p;
+}
+
+void* mi_traced_memalign(size_t alignment, size_t size) mi_attr_noexcept {
+  void* p = mi_memalign(alignment, size);
+  mi_trace_alloc(p, MI_TRACE_ALIGNED, size, alignment, 0);
+  return p;
+}
+
+int mi_traced_posix_memalign(void** p, size_t alignment, size_t size) mi_attr_noexcept {
+  const int err = mi_posix_memalign(p, alignment, size);
+  if (err == 0) { mi_trace_alloc(*p, MI_TRACE_ALIGNED, size, alignment, 0); }
+  return err;
+}
+
+void* mi_traced_valloc(size_t size) mi_attr_noexcept {
+  void* p = mi_valloc(size);
+  mi_trace_alloc(p, MI_TRACE_ALIGNED, size, _mi_os_page_size(), 0);
+  return p;
+}
+
+void* mi_traced_pvalloc(size_t size) mi_attr_noexcept {
+  void* p = mi_pvalloc(size);
+  mi_trace_alloc(p, MI_TRACE_ALIGNED, _mi_align_up(size, _mi_os_page_size()), _mi_os_page_size(), 0);
+  return p;
+}
+
+#endif // MI_TRACE_ALLOCS
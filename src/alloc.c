@@ -17,6 +17,7 @@ terms of the MIT license. A copy of the license can be found in the file
 #include <stdlib.h>      // malloc, abort
 
 #define MI_IN_ALLOC_C
+#include "alloc-trace.c"
 #include "alloc-override.c"
 #undef MI_IN_ALLOC_C
 
@@ -99,6 +100,10 @@ extern inline void* _mi_page_malloc(mi_heap_t* heap, mi_page_t* page, size_t siz
   #endif
 #endif
 
+  // sample for the heap profiler once enough bytes were allocated (see `profile.c`)
+  if mi_unlikely((heap->profile_countdown -= (ptrdiff_t)size) < 0) {
+    _mi_heap_profile_sample(heap, page, block, size);
+  }
   return block;
 }
 
@@ -106,7 +111,7 @@ static inline mi_decl_restrict void* mi_heap_malloc_small_zero(mi_heap_t* heap,
   mi_assert(heap != NULL);
   #if MI_DEBUG
   const uintptr_t tid = _mi_thread_id();
-  mi_assert(heap->thread_id == 0 || heap->thread_id == tid); // heaps are thread local
+  mi_assert(heap->thread_id == 0 || heap->thread_id == tid || _mi_heap_cpu_is_held(heap)); // heaps are thread local
   #endif
   mi_assert(size <= MI_SMALL_SIZE_MAX);
   #if (MI_PADDING)
@@ -146,7 +151,7 @@ extern inline void* _mi_heap_malloc_zero_ex(mi_heap_t* heap, size_t size, bool z
   }
   else {
     mi_assert(heap!=NULL);
-    mi_assert(heap->thread_id == 0 || heap->thread_id == _mi_thread_id());   // heaps are thread local
+    mi_assert(heap->thread_id == 0 || heap->thread_id == _mi_thread_id() || _mi_heap_cpu_is_held(heap));   // heaps are thread local
     void* const p = _mi_malloc_generic(heap, size + MI_PADDING_SIZE, zero, huge_alignment);  // note: size can overflow but it is detected in malloc_generic
     mi_track_malloc(p,size,zero);
     #if MI_STAT>1
@@ -429,6 +434,8 @@ static mi_decl_noinline void _mi_free_block_mt(mi_page_t* page, mi_block_t* bloc
   #endif
 
   // Try to put the block on either the page-local thread free list, or the heap delayed free list.
+  // (the statistics count the failed CAS operations as a measure of contention)
+  mi_stat_counter_increase(_mi_stats_main.free_mt, 1);
   mi_thread_free_t tfreex;
   bool use_delayed;
   mi_thread_free_t tfree = mi_atomic_load_relaxed(&page->xthread_free);
@@ -443,9 +450,10 @@ static mi_decl_noinline void _mi_free_block_mt(mi_page_t* page, mi_block_t* bloc
       mi_block_set_next(page, block, mi_tf_block(tfree));
       tfreex = mi_tf_set_block(tfree,block);
     }
-  } while (!mi_atomic_cas_weak_release(&page->xthread_free, &tfree, tfreex));
+  } while (!mi_atomic_cas_weak_release(&page->xthread_free, &tfree, tfreex) && (mi_stat_counter_increase(_mi_stats_main.free_mt_retries, 1), true));
 
   if mi_unlikely(use_delayed) {
+    mi_stat_counter_increase(_mi_stats_main.free_delayed, 1);
     // racy read on `heap`, but ok because MI_DELAYED_FREEING is set (see `mi_heap_delete` and `mi_heap_collect_abandon`)
     mi_heap_t* const heap = (mi_heap_t*)(mi_atomic_load_acquire(&page->xheap)); //mi_page_heap(page);
     mi_assert_internal(heap != NULL);
@@ -454,7 +462,7 @@ static mi_decl_noinline void _mi_free_block_mt(mi_page_t* page, mi_block_t* bloc
       mi_block_t* dfree = mi_atomic_load_ptr_relaxed(mi_block_t, &heap->thread_delayed_free);
       do {
         mi_block_set_nextx(heap,block,dfree, heap->keys);
-      } while (!mi_atomic_cas_ptr_weak_release(mi_block_t,&heap->thread_delayed_free, &dfree, block));
+      } while (!mi_atomic_cas_ptr_weak_release(mi_block_t,&heap->thread_delayed_free, &dfree, block) && (mi_stat_counter_increase(_mi_stats_main.free_mt_retries, 1), true));
     }
 
     // and reset the MI_DELAYED_FREEING flag
@@ -463,10 +471,12 @@ static mi_decl_noinline void _mi_free_block_mt(mi_page_t* page, mi_block_t* bloc
       tfreex = tfree;
       mi_assert_internal(mi_tf_delayed(tfree) == MI_DELAYED_FREEING);
       tfreex = mi_tf_set_delayed(tfree,MI_NO_DELAYED_FREE);
-    } while (!mi_atomic_cas_weak_release(&page->xthread_free, &tfree, tfreex));
+    } while (!mi_atomic_cas_weak_release(&page->xthread_free, &tfree, tfreex) && (mi_stat_counter_increase(_mi_stats_main.free_mt_retries, 1), true));
   }
 }
 
+static mi_decl_noinline bool mi_free_block_cpu(mi_page_t* page, mi_block_t* block);
+
 // regular free
 static inline void _mi_free_block(mi_page_t* page, bool local, mi_block_t* block)
 {
@@ -492,10 +502,25 @@ static inline void _mi_free_block(mi_page_t* page, bool local, mi_block_t* block
     }
   }
   else {
+    if mi_unlikely((mi_atomic_load_relaxed(&_mi_page_segment(page)->thread_id) & MI_CPU_HEAP_OWNER_BIT) != 0 && mi_free_block_cpu(page, block)) return;
     _mi_free_block_mt(page,block);
   }
 }
 
+// Free into a page of a per-CPU heap (see `mi_option_percpu_heaps`): if we can take the heap lock
+// we free as the owner. For large and huge blocks we wait for the lock so the memory is released
+// right away, instead of at the next allocation from that heap.
+static mi_decl_noinline bool mi_free_block_cpu(mi_page_t* page, mi_block_t* block) {
+  mi_segment_t* const segment = _mi_page_segment(page);
+  const mi_threadid_t owner_id = mi_atomic_load_relaxed(&segment->thread_id);
+  mi_heap_t* const heap = _mi_heap_cpu_try_acquire(owner_id, mi_page_block_size(page) > MI_MEDIUM_OBJ_SIZE_MAX);
+  if (heap == NULL) return false;
+  const bool owned = (mi_atomic_load_relaxed(&segment->thread_id) == owner_id);  // still owned by that heap?
+  if (owned) { _mi_free_block(page, true, block); }
+  _mi_heap_cpu_release(heap);
+  return owned;
+}
+
 
 // Adjust a block that was allocated aligned, to the actual start of the block in the page.
 mi_block_t* _mi_page_ptr_unalign(const mi_segment_t* segment, const mi_page_t* page, const void* p) {
@@ -510,6 +535,7 @@ void mi_decl_noinline _mi_free_generic(const mi_segment_t* segment, mi_page_t* p
   mi_block_t* const block = (mi_page_has_aligned(page) ? _mi_page_ptr_unalign(segment, page, p) : (mi_block_t*)p);
   mi_stat_free(page, block);    // stat_free may access the padding
   mi_track_free_size(block, mi_page_usable_size_of(page,block));
+  if mi_unlikely(mi_page_has_sampled(page)) { _mi_heap_profile_free(block); }
   _mi_free_block(page, is_local, block);
 }
 
@@ -598,8 +624,8 @@ bool _mi_free_delayed_block(mi_block_t* block) {
   // get segment and page
   const mi_segment_t* const segment = _mi_ptr_segment(block);
   mi_assert_internal(_mi_ptr_cookie(segment) == segment->cookie);
-  mi_assert_internal(_mi_thread_id() == segment->thread_id);
   mi_page_t* const page = _mi_segment_page_of(segment, block);
+  mi_assert_internal(_mi_thread_id() == segment->thread_id || _mi_heap_cpu_is_held(mi_page_heap(page)));
 
   // Clear the no-delayed flag so delayed freeing is used again for this page.
   // This must be done before collecting the free lists on this page -- otherwise
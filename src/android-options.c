@@ -19,57 +19,36 @@
 #include "mimalloc/atomic.h"
 
 #if defined(__ANDROID__)
-mi_decl_nodiscard inline long mi_option_get(mi_option_t option)
+// The option values come from the generated `mimalloc-android-options.h` (see `android-options.h.in`).
+// Inside mimalloc the option functions are macros for its constant accessors (see `internal.h`)
+// so the exported functions below are only used by applications.
+mi_decl_nodiscard long (mi_option_get)(mi_option_t option)
 {
-  switch (option) {
-  case mi_option_reserve_huge_os_pages_at:
-  return -1;
-  case mi_option_eager_commit_delay:
-  return 1;
-  case mi_option_purge_extend_delay:
-  return 1;
-  case mi_option_arena_purge_mult:
-  return 10;
-  case mi_option_purge_delay:
-  return 10;
-  case mi_option_arena_eager_commit:
-  return 2;
-  default:
-  return 0;
-  }
+  return mi_android_option_get(option);
 }
 
-mi_decl_nodiscard inline long mi_option_get_clamp(mi_option_t option, long min, long max)
+mi_decl_nodiscard long (mi_option_get_clamp)(mi_option_t option, long min, long max)
 {
-  (void)max;
-  (void)option;
-  return min;
+  return mi_android_option_get_clamp(option, min, max);
 }
 
-mi_decl_nodiscard size_t mi_option_get_size(mi_option_t option) {
-  switch (option) {
-    case mi_option_arena_reserve:
-#if (MI_INTPTR_SIZE>4)
-    return 1024L * 1024L * MI_KiB;
-#else
-    return  128L * 1024L * MI_KiB;
-#endif
-    default:
-    return 0;
-  }
+mi_decl_nodiscard size_t (mi_option_get_size)(mi_option_t option)
+{
+  return mi_android_option_get_size(option);
 }
 
-mi_decl_nodiscard inline bool mi_option_is_enabled(mi_option_t option)
+mi_decl_nodiscard bool (mi_option_is_enabled)(mi_option_t option)
 {
-  switch (option) {
-  case mi_option_eager_commit:
-  case mi_option_purge_decommits:
-  return true;
-  default:
-  return false;
-  }
+  return mi_android_option_is_enabled(option);
 }
 
+// The options cannot be changed at runtime: setting them has no effect.
+void mi_option_set(mi_option_t option, long value) {}
+void mi_option_set_default(mi_option_t option, long value) {}
+void mi_option_set_enabled(mi_option_t option, bool enable) {}
+void mi_option_set_enabled_default(mi_option_t option, bool enable) {}
+void mi_option_enable(mi_option_t option) {}
+
 inline void mi_option_disable(mi_option_t option) {}
 inline void _mi_options_init(void) {}
 inline void _mi_warning_message(const char* fmt, ... ) {}
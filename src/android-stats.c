@@ -17,10 +17,66 @@
 #include "mimalloc.h"
 #include "mimalloc/internal.h"
 #include "mimalloc/atomic.h"
+#include "mimalloc/prim.h"
 
-inline void _mi_stat_decrease(mi_stat_count_t* stat, size_t amount) {};
-inline void _mi_stat_increase(mi_stat_count_t* stat, size_t amount) {};
-inline void mi_stats_reset(void) mi_attr_noexcept {};
-inline void _mi_stats_done(mi_stats_t* stats) {};
-inline void _mi_stat_counter_increase(mi_stat_counter_t* stat, size_t amount) {};
-inline void mi_stats_print(void* out) mi_attr_noexcept {};
+#include <stdio.h>  // snprintf
+
+#if defined(__ANDROID__)
+// Android is built without `MI_STAT` and only keeps the statistics that are updated outside
+// the allocation fast path (see `stats.c`): reserved and committed OS memory, segments, pages,
+// threads, and the mmap and purge calls. Threads update their own statistics without atomics
+// and these are summed with those of all live threads when printing.
+// The regular output functions are disabled on Android so we print directly.
+
+static void mi_android_stats_out(mi_output_fun* out, void* arg, const char* msg) {
+  if (out == NULL || (void*)out == (void*)stdout || (void*)out == (void*)stderr) {
+    _mi_prim_out_stderr(msg);
+  }
+  else {
+    out(msg, arg);
+  }
+}
+
+static void mi_android_stat_print(const mi_stat_count_t* stat, const char* msg, const char* unit, mi_output_fun* out, void* arg) {
+  char buf[128];
+  snprintf(buf, sizeof(buf), "%10s: %14lld%s peak, %14lld%s current\n", msg, (long long)stat->peak, unit, (long long)stat->current, unit);
+  mi_android_stats_out(out, arg, buf);
+}
+
+static void mi_android_stat_counter_print(const mi_stat_counter_t* stat, const char* msg, mi_output_fun* out, void* arg) {
+  char buf[128];
+  snprintf(buf, sizeof(buf), "%10s: %14lld\n", msg, (long long)stat->total);
+  mi_android_stats_out(out, arg, buf);
+}
+
+static void mi_android_stats_print(const mi_stats_t* stats, mi_output_fun* out, void* arg) {
+  mi_android_stat_print(&stats->reserved, "reserved", " B", out, arg);
+  mi_android_stat_print(&stats->committed, "committed", " B", out, arg);
+  mi_android_stat_print(&stats->segments, "segments", "  ", out, arg);
+  mi_android_stat_print(&stats->pages, "pages", "  ", out, arg);
+  mi_android_stat_print(&stats->threads, "threads", "  ", out, arg);
+  mi_android_stat_counter_print(&stats->mmap_calls, "mmaps", out, arg);
+  mi_android_stat_counter_print(&stats->purge_calls, "purges", out, arg);
+  for (size_t i = 0; i < _mi_latency_last; i++) {
+    char buf[128];
+    if (_mi_stat_latency_format(&stats->latency[i], (mi_latency_kind_t)i, buf, sizeof(buf))) {
+      mi_android_stats_out(out, arg, buf);
+    }
+  }
+}
+
+void mi_stats_print_out(mi_output_fun* out, void* arg) mi_attr_noexcept {
+  mi_stats_t stats;
+  _mi_stats_aggregate(&stats);
+  mi_android_stats_print(&stats, out, arg);
+}
+
+void mi_stats_print(void* out) mi_attr_noexcept {
+  // for compatibility there is an `out` parameter (which can be `stdout` or `stderr`)
+  mi_stats_print_out((mi_output_fun*)out, NULL);
+}
+
+void mi_thread_stats_print_out(mi_output_fun* out, void* arg) mi_attr_noexcept {
+  mi_android_stats_print(&mi_heap_get_default()->tld->stats, out, arg);
+}
+#endif /* __ANDROID__ */
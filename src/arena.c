@@ -21,6 +21,7 @@ The arena allocation needs to be thread safe and we use an atomic bitmap to allo
 #include "mimalloc.h"
 #include "mimalloc/internal.h"
 #include "mimalloc/atomic.h"
+#include "mimalloc/prim.h"   // _mi_prim_alloc_shared, _mi_prim_numa_run_parallel
 
 #include <string.h>  // memset
 #include <errno.h>   // ENOMEM
@@ -37,6 +38,11 @@ typedef uintptr_t mi_block_info_t;
 #define MI_ARENA_BLOCK_SIZE   (MI_SEGMENT_SIZE)        // 64MiB  (must be at least MI_SEGMENT_ALIGN)
 #define MI_ARENA_MIN_OBJ_SIZE (MI_ARENA_BLOCK_SIZE/2)  // 32MiB
 #define MI_MAX_ARENAS         (112)                    // not more than 126 (since we use 7 bits in the memid and an arena index + 1)
+#if (MI_INTPTR_SIZE >= 8)
+#define MI_ARENA_CAGE_MAX     (4*MI_GiB)               // maximal size of a cage (addressable with 32-bit offsets)
+#else
+#define MI_ARENA_CAGE_MAX     (1*MI_GiB)
+#endif
 
 // A memory arena descriptor
 typedef struct mi_arena_s {
@@ -50,6 +56,8 @@ typedef struct mi_arena_s {
   int      numa_node;                     // associated NUMA node
   bool     exclusive;                     // only allow allocations if specifically for this arena  
   bool     is_large;                      // memory area consists of large- or huge OS pages (always committed)
+  int      shared_fd;                     // shared memory file backing the area (or -1) so it can be snapshotted
+  bool     is_snapshotted;                // the area was remapped copy-on-write after a snapshot
   _Atomic(size_t) search_idx;             // optimization to start the search for free blocks
   _Atomic(mi_msecs_t) purge_expire;       // expiration time when blocks should be decommitted from `blocks_decommit`.  
   mi_bitmap_field_t* blocks_dirty;        // are the blocks potentially non-zero?
@@ -229,6 +237,7 @@ static mi_decl_noinline void* mi_arena_try_alloc_at(mi_arena_t* arena, size_t ar
   void* p = mi_arena_block_start(arena, bitmap_index);
   *memid = mi_memid_create_arena(arena->id, arena->exclusive, bitmap_index);
   memid->is_pinned = arena->memid.is_pinned;
+  mi_probe3(arena_alloc, p, mi_arena_block_size(needed_bcount), arena->id);
 
   // none of the claimed blocks should be scheduled for a decommit
   if (arena->blocks_purge != NULL) {
@@ -254,6 +263,8 @@ static mi_decl_noinline void* mi_arena_try_alloc_at(mi_arena_t* arena, size_t ar
     if (any_uncommitted) {
       bool commit_zero = false;
       if (!_mi_os_commit(p, mi_arena_block_size(needed_bcount), &commit_zero, tld->stats)) {
+        // (e.g. at the memory limit): conservatively mark the range as uncommitted again
+        _mi_bitmap_unclaim_across(arena->blocks_committed, arena->field_count, needed_bcount, bitmap_index);
         memid->initially_committed = false;
       }
       else {
@@ -420,6 +431,16 @@ void* mi_arena_area(mi_arena_id_t arena_id, size_t* size) {
   return arena->start;
 }
 
+// The numa node of arena memory, or -1 if unknown (or not bound to a particular node)
+int _mi_arena_memid_numa_node(mi_memid_t memid) {
+  if (memid.memkind != MI_MEM_ARENA) return -1;
+  size_t arena_index = mi_arena_id_index(memid.mem.arena.id);
+  if (arena_index >= MI_MAX_ARENAS) return -1;
+  mi_arena_t* arena = mi_atomic_load_ptr_acquire(mi_arena_t, &mi_arenas[arena_index]);
+  if (arena == NULL) return -1;
+  return arena->numa_node;
+}
+
 
 /* -----------------------------------------------------------
   Arena purge
@@ -427,7 +448,7 @@ void* mi_arena_area(mi_arena_id_t arena_id, size_t* size) {
 
 static long mi_arena_purge_delay(void) {
   // <0 = no purging allowed, 0=immediate purging, >0=milli-second delay
-  return (mi_option_get(mi_option_purge_delay) * mi_option_get(mi_option_arena_purge_mult));
+  return (_mi_os_purge_delay() * mi_option_get(mi_option_arena_purge_mult));
 }
 
 // reset or decommit in an arena and update the committed/decommit bitmaps
@@ -436,8 +457,10 @@ static void mi_arena_purge(mi_arena_t* arena, size_t bitmap_idx, size_t blocks,
   mi_assert_internal(arena->blocks_committed != NULL);
   mi_assert_internal(arena->blocks_purge != NULL);
   mi_assert_internal(!arena->memid.is_pinned);
+  const mi_ticks_t start = mi_latency_start();
   const size_t size = mi_arena_block_size(blocks);
   void* const p = mi_arena_block_start(arena, bitmap_idx); 
+  mi_probe2(arena_purge, p, size);
   bool needs_recommit;
   if (_mi_bitmap_is_claimed_across(arena->blocks_committed, arena->field_count, blocks, bitmap_idx)) {
     // all blocks are committed, we can purge freely
@@ -447,10 +470,13 @@ static void mi_arena_purge(mi_arena_t* arena, size_t bitmap_idx, size_t blocks,
     // some blocks are not committed -- this can happen when a partially committed block is freed 
     // in `_mi_arena_free` and it is conservatively marked as uncommitted but still scheduled for a purge
     // we need to ensure we do not try to reset (as that may be invalid for uncommitted memory), 
-    // and also undo the decommit stats (as it was already adjusted)
-    mi_assert_internal(mi_option_is_enabled(mi_option_purge_decommits));
-    needs_recommit = _mi_os_purge_ex(p, size, false /* allow reset? */, stats);
-    _mi_stat_increase(&stats->committed, size);
+    // and also undo the decommit stats (as it was already adjusted) if we actually decommit
+    mi_purge_batch_t batch;
+    _mi_os_purge_batch_init(&batch);
+    _mi_os_purge_batch_add(&batch, p, size, false /* allow reset? */, stats);
+    mi_assert_internal(batch.decommit || batch.count == 0);  // without decommit the range is left as is
+    needs_recommit = _mi_os_purge_batch_flush(&batch, stats);
+    if (batch.decommit) { _mi_stat_increase(&stats->committed, size); }
   }
   
   // clear the purged blocks
@@ -459,6 +485,7 @@ static void mi_arena_purge(mi_arena_t* arena, size_t bitmap_idx, size_t blocks,
   if (needs_recommit) {
     _mi_bitmap_unclaim_across(arena->blocks_committed, arena->field_count, blocks, bitmap_idx);
   }
+  mi_latency_end(mi_latency_arena_purge, start);
 }
 
 // Schedule a purge. This is usually delayed to avoid repeated decommit/commit calls.
@@ -485,10 +512,79 @@ static void mi_arena_schedule_purge(mi_arena_t* arena, size_t bitmap_idx, size_t
   }
 }
 
+// Purges during an arena sweep are collected in a batch to use fewer system calls.
+// We keep the claimed `in_use` bits until the batch is flushed so no one can reuse the memory in between.
+typedef struct mi_arena_purge_claim_s {
+  mi_arena_t*       arena;
+  mi_bitmap_index_t bitmap_idx;   // start of the claimed `in_use` bits
+  size_t            bitlen;
+  size_t            purge;        // the purge bits of the field when claimed
+} mi_arena_purge_claim_t;
+
+typedef struct mi_arena_purge_batch_s {
+  mi_purge_batch_t       os;
+  size_t                 count;
+  mi_arena_purge_claim_t claims[MI_PURGE_BATCH_MAX];
+} mi_arena_purge_batch_t;
+
+// the mask of `purge` bits in the range of a claim
+static size_t mi_arena_purge_claim_mask(const mi_arena_purge_claim_t* claim) {
+  const size_t bitidx = mi_bitmap_index_bit_in_field(claim->bitmap_idx);
+  const size_t mask = (claim->bitlen >= MI_BITMAP_FIELD_BITS ? MI_BITMAP_FIELD_FULL : (((size_t)1 << claim->bitlen) - 1) << bitidx);
+  return (claim->purge & mask);
+}
+
+// purge all batched ranges, update the purge and committed bitmaps, and release the claimed `in_use` bits
+static void mi_arena_purge_batch_flush(mi_arena_purge_batch_t* batch, mi_stats_t* stats) {
+  if (batch->count == 0 && batch->os.count == 0) return;
+  const mi_ticks_t start = mi_latency_start();
+  const bool needs_recommit = _mi_os_purge_batch_flush(&batch->os, stats);
+  for (size_t i = 0; i < batch->count; i++) {
+    const mi_arena_purge_claim_t* claim = &batch->claims[i];
+    mi_arena_t* const arena = claim->arena;
+    const size_t field_idx = mi_bitmap_index_field(claim->bitmap_idx);
+    const size_t purged = mi_arena_purge_claim_mask(claim);
+    // clear the purged blocks and update the committed bitmap
+    mi_atomic_and_acq_rel(&arena->blocks_purge[field_idx], ~purged);
+    if (needs_recommit) {
+      mi_atomic_and_acq_rel(&arena->blocks_committed[field_idx], ~purged);
+    }
+    // release the claimed `in_use` bits again
+    _mi_bitmap_unclaim(arena->blocks_inuse, arena->field_count, claim->bitlen, claim->bitmap_idx);
+  }
+  batch->count = 0;
+  mi_latency_end(mi_latency_arena_purge, start);
+}
+
+// add a range of blocks to the purge batch
+static void mi_arena_purge_add(mi_arena_t* arena, size_t bitmap_idx, size_t blocks, mi_arena_purge_batch_t* batch, mi_stats_t* stats) {
+  mi_assert_internal(arena->blocks_committed != NULL);
+  mi_assert_internal(!arena->memid.is_pinned);
+  const size_t size = mi_arena_block_size(blocks);
+  void* const p = mi_arena_block_start(arena, bitmap_idx); 
+  mi_probe2(arena_purge, p, size);
+  bool added;
+  if (_mi_bitmap_is_claimed_across(arena->blocks_committed, arena->field_count, blocks, bitmap_idx)) {
+    // all blocks are committed, we can purge freely
+    added = _mi_os_purge_batch_add(&batch->os, p, size, true /* allow reset? */, stats);
+  }
+  else {
+    // some blocks are not committed (see `mi_arena_purge`) 
+    #if (MI_DEBUG>1)
+    const size_t count = batch->os.count;
+    #endif
+    added = _mi_os_purge_batch_add(&batch->os, p, size, false /* allow reset? */, stats);
+    mi_assert_internal(batch->os.decommit || batch->os.count == count);  // without decommit the range is left as is
+    if (batch->os.decommit) { _mi_stat_increase(&stats->committed, size); }
+  }
+  MI_UNUSED(added);
+  mi_assert_internal(added);
+}
+
 // purge a range of blocks
 // return true if the full range was purged.
 // assumes we own the area (i.e. blocks_in_use is claimed by us)
-static bool mi_arena_purge_range(mi_arena_t* arena, size_t idx, size_t startidx, size_t bitlen, size_t purge, mi_stats_t* stats) {
+static bool mi_arena_purge_range(mi_arena_t* arena, size_t idx, size_t startidx, size_t bitlen, size_t purge, mi_arena_purge_batch_t* batch, mi_stats_t* stats) {
   const size_t endidx = startidx + bitlen;
   size_t bitidx = startidx;
   bool all_purged = false;
@@ -501,7 +597,7 @@ static bool mi_arena_purge_range(mi_arena_t* arena, size_t idx, size_t startidx,
     if (count > 0) {
       // found range to be purged
       const mi_bitmap_index_t range_idx = mi_bitmap_index_create(idx, bitidx);
-      mi_arena_purge(arena, range_idx, count, stats);
+      mi_arena_purge_add(arena, range_idx, count, batch, stats);
       if (count == bitlen) {
         all_purged = true;
       }
@@ -512,7 +608,7 @@ static bool mi_arena_purge_range(mi_arena_t* arena, size_t idx, size_t startidx,
 }
 
 // returns true if anything was purged
-static bool mi_arena_try_purge(mi_arena_t* arena, mi_msecs_t now, bool force, mi_stats_t* stats) 
+static bool mi_arena_try_purge(mi_arena_t* arena, mi_msecs_t now, bool force, mi_arena_purge_batch_t* batch, mi_stats_t* stats) 
 {
   if (arena->memid.is_pinned || arena->blocks_purge == NULL) return false;
   mi_msecs_t expire = mi_atomic_loadi64_relaxed(&arena->purge_expire);
@@ -547,12 +643,18 @@ static bool mi_arena_try_purge(mi_arena_t* arena, mi_msecs_t now, bool force, mi
         if (bitlen > 0) {
           // read purge again now that we have the in_use bits
           purge = mi_atomic_load_acquire(&arena->blocks_purge[i]);
-          if (!mi_arena_purge_range(arena, i, bitidx, bitlen, purge, stats)) {
+          mi_arena_purge_claim_t claim = { arena, bitmap_index, bitlen, purge };
+          // make room in the batch for all ranges in this claim (a claim is only released on a flush)
+          const size_t claimed = mi_arena_purge_claim_mask(&claim);
+          const size_t ranges  = mi_popcount(claimed & ~(claimed << 1));
+          if (batch->count >= MI_PURGE_BATCH_MAX || batch->os.count + ranges > MI_PURGE_BATCH_MAX) {
+            mi_arena_purge_batch_flush(batch, stats);
+          }
+          if (!mi_arena_purge_range(arena, i, bitidx, bitlen, purge, batch, stats)) {
             full_purge = false;
           }
           any_purged = true;
-          // release the claimed `in_use` bits again
-          _mi_bitmap_unclaim(arena->blocks_inuse, arena->field_count, bitlen, bitmap_index);
+          batch->claims[batch->count++] = claim;
         }
         bitidx += (bitlen+1);  // +1 to skip the zero (or end)
       } // while bitidx
@@ -579,15 +681,19 @@ static void mi_arenas_try_purge( bool force, bool visit_all, mi_stats_t* stats )
   {
     mi_msecs_t now = _mi_clock_now();
     size_t max_purge_count = (visit_all ? max_arena : 1);
+    mi_arena_purge_batch_t batch;
+    _mi_os_purge_batch_init(&batch.os);
+    batch.count = 0;
     for (size_t i = 0; i < max_arena; i++) {
       mi_arena_t* arena = mi_atomic_load_ptr_acquire(mi_arena_t, &mi_arenas[i]);
       if (arena != NULL) {
-        if (mi_arena_try_purge(arena, now, force, stats)) {
+        if (mi_arena_try_purge(arena, now, force, &batch, stats)) {
           if (max_purge_count <= 1) break;
           max_purge_count--;
         }
       }
     }
+    mi_arena_purge_batch_flush(&batch, stats);
   }  
 }
 
@@ -686,6 +792,7 @@ static void mi_arenas_unsafe_destroy(void) {
     if (arena != NULL) {
       if (arena->start != NULL && mi_memkind_is_os(arena->memid.memkind)) {      
         mi_atomic_store_ptr_release(mi_arena_t, &mi_arenas[i], NULL);
+        if (arena->shared_fd >= 0) { _mi_prim_free_shared(arena->shared_fd, arena->start, mi_arena_size(arena)); }
         _mi_os_free(arena->start, mi_arena_size(arena), arena->memid, &_mi_stats_main); 
       }
       else {
@@ -714,6 +821,7 @@ void _mi_arena_unsafe_destroy_all(mi_stats_t* stats) {
 
 // Is a pointer inside any of our arenas?
 bool _mi_arena_contains(const void* p) {
+  if (_mi_os_reserve_is_complete() && !_mi_os_reserve_contains(p)) return false;
   const size_t max_arena = mi_atomic_load_relaxed(&mi_arena_count);
   for (size_t i = 0; i < max_arena; i++) {
     mi_arena_t* arena = mi_atomic_load_ptr_acquire(mi_arena_t, &mi_arenas[i]);
@@ -754,6 +862,9 @@ static bool mi_manage_os_memory_ex2(void* start, size_t size, bool is_large, int
   if (is_large) {
     mi_assert_internal(memid.initially_committed && memid.is_pinned);
   }
+  if (memid.memkind == MI_MEM_EXTERNAL) {
+    _mi_os_reserve_note_outside();  // user provided memory is not in the up-front reservation
+  }
 
   const size_t bcount = size / MI_ARENA_BLOCK_SIZE;
   const size_t fields = _mi_divide_up(bcount, MI_BITMAP_FIELD_BITS);
@@ -775,6 +886,7 @@ static bool mi_manage_os_memory_ex2(void* start, size_t size, bool is_large, int
   arena->start = (uint8_t*)start;
   arena->numa_node    = numa_node; // TODO: or get the current numa node if -1? (now it allows anyone to allocate on -1)
   arena->is_large     = is_large;
+  arena->shared_fd    = -1;
   arena->purge_expire = 0;
   arena->search_idx   = 0;
   arena->blocks_dirty = &arena->blocks_inuse[fields]; // just after inuse bitmap
@@ -822,6 +934,60 @@ int mi_reserve_os_memory_ex(size_t size, bool commit, bool allow_large, bool exc
   return 0;
 }
 
+// Reserve an exclusive "cage" arena of at most `MI_ARENA_CAGE_MAX` aligned to its size rounded up to a power of two.
+// Every block in the cage is addressable by a 32-bit offset from its start, and since heaps in an exclusive arena
+// never fall back to the OS (see `_mi_arena_alloc_aligned`) all their allocations stay inside.
+bool _mi_arena_reserve_cage(size_t size, mi_arena_id_t* arena_id) {
+  if (arena_id != NULL) *arena_id = _mi_arena_id_none();
+  if (size == 0) size = MI_ARENA_CAGE_MAX;
+  if (size > MI_ARENA_CAGE_MAX) { errno = EINVAL; return false; }
+  size = _mi_align_up(size, MI_ARENA_BLOCK_SIZE);
+  size_t alignment = MI_SEGMENT_ALIGN;
+  while (alignment < size) { alignment *= 2; }
+  mi_memid_t memid;
+  void* start = _mi_os_alloc_aligned(size, alignment, false /* commit */, false /* allow large */, &memid, &_mi_stats_main);
+  if (start == NULL) { errno = ENOMEM; return false; }
+  if (!mi_manage_os_memory_ex2(start, size, false, -1 /* numa node */, true /* exclusive */, memid, arena_id)) {
+    _mi_os_free_ex(start, size, false, memid, &_mi_stats_main);
+    errno = ENOMEM;
+    return false;
+  }
+  _mi_verbose_message("reserved %zu KiB memory cage at %p\n", _mi_divide_up(size, 1024), start);
+  return true;
+}
+
+// Reserve an exclusive arena backed by a shared memory file so its heaps can be snapshotted.
+// The memory is always committed and never purged (as `madvise` does not release shared file memory).
+int mi_reserve_os_memory_shared_ex(size_t size, mi_arena_id_t* arena_id) mi_attr_noexcept {
+  if (arena_id != NULL) *arena_id = _mi_arena_id_none();
+  size = _mi_align_up(size, MI_ARENA_BLOCK_SIZE); // at least one block
+  mi_memid_t memid;
+  void* start = _mi_os_alloc_aligned(size, MI_SEGMENT_ALIGN, false /* commit */, false /* allow large */, &memid, &_mi_stats_main);
+  if (start == NULL) return ENOMEM;
+  int fd = -1;
+  int err = _mi_prim_alloc_shared(start, size, &fd);
+  if (err != 0) {
+    _mi_os_free_ex(start, size, false, memid, &_mi_stats_main);
+    _mi_verbose_message("unable to map shared memory for an arena (error: %d (0x%x), size: %zu KiB)\n", err, err, _mi_divide_up(size, 1024));
+    return err;
+  }
+  _mi_stat_increase(&_mi_stats_main.committed, size);
+  memid.initially_committed = true;
+  memid.initially_zero = true;
+  memid.is_pinned = true;
+  mi_arena_id_t id;
+  if (!mi_manage_os_memory_ex2(start, size, false, -1 /* numa node */, true /* exclusive */, memid, &id)) {
+    _mi_prim_free_shared(fd, start, size);
+    _mi_os_free_ex(start, size, true, memid, &_mi_stats_main);
+    return ENOMEM;
+  }
+  mi_arena_t* arena = mi_atomic_load_ptr_acquire(mi_arena_t, &mi_arenas[mi_arena_id_index(id)]);
+  arena->shared_fd = fd;
+  if (arena_id != NULL) *arena_id = id;
+  _mi_verbose_message("reserved %zu KiB shared memory\n", _mi_divide_up(size, 1024));
+  return 0;
+}
+
 
 // Manage a range of regular OS memory
 bool mi_manage_os_memory(void* start, size_t size, bool is_committed, bool is_large, bool is_zero, int numa_node) mi_attr_noexcept {
@@ -834,6 +1000,110 @@ int mi_reserve_os_memory(size_t size, bool commit, bool allow_large) mi_attr_noe
 }
 
 
+/* -----------------------------------------------------------
+  Snapshots of shared arenas.
+  The arena is mapped a second time read-only from its shared memory
+  file, and the original range is remapped copy-on-write so the file
+  (and thus the snapshot) stays frozen. The snapshot is not an arena:
+  it is never registered in `mi_arenas` or the segment map and
+  cannot be allocated from or freed into.
+----------------------------------------------------------- */
+
+const void* _mi_arena_snapshot(mi_arena_id_t arena_id, size_t* size) {
+  if (size != NULL) *size = 0;
+  size_t arena_index = mi_arena_id_index(arena_id);
+  if (arena_index >= MI_MAX_ARENAS) { errno = EINVAL; return NULL; }
+  mi_arena_t* arena = mi_atomic_load_ptr_acquire(mi_arena_t, &mi_arenas[arena_index]);
+  if (arena == NULL || arena->shared_fd < 0) { errno = EINVAL; return NULL; }
+  if (arena->is_snapshotted) {
+    // the owner writes to private pages now; a next generation would require a copy
+    errno = EBUSY;
+    return NULL;
+  }
+  const size_t asize = mi_arena_size(arena);
+  void* p = NULL;
+  int err = _mi_prim_snapshot_shared(arena->shared_fd, arena->start, asize, &p);
+  if (err != 0) {
+    _mi_warning_message("unable to snapshot arena %d (error: %d (0x%x))\n", arena_id, err, err);
+    errno = err;
+    return NULL;
+  }
+  arena->is_snapshotted = true;
+  if (size != NULL) *size = asize;
+  return p;
+}
+
+void _mi_arena_snapshot_free(const void* snapshot, size_t size) {
+  if (snapshot == NULL || size == 0) return;
+  int err = _mi_prim_free((void*)snapshot, size);
+  if (err != 0) {
+    _mi_warning_message("unable to free a snapshot (error: %d (0x%x), size: 0x%zx bytes, address: %p)\n", err, err, size, snapshot);
+  }
+}
+
+
+/* -----------------------------------------------------------
+  Arena information
+  Reads the bitmaps without locking so the counts are only
+  an approximation if there are concurrent allocations.
+----------------------------------------------------------- */
+
+// count the set bits for the `block_count` blocks of the arena; the trailing bits of the last field are
+// ignored as they are claimed in the in-use bitmap, and also set in the committed bitmap of committed arenas.
+static size_t mi_arena_bitmap_count(const mi_bitmap_field_t* fields, size_t field_count, size_t block_count) {
+  if (fields == NULL) return 0;
+  size_t count = 0;
+  for (size_t i = 0; i < field_count; i++) {
+    size_t field = mi_atomic_load_relaxed(&((mi_bitmap_field_t*)fields)[i]);
+    const size_t bits = block_count - (i * MI_BITMAP_FIELD_BITS);
+    if (bits < MI_BITMAP_FIELD_BITS) { field &= (((size_t)1 << bits) - 1); }
+    count += mi_popcount(field);
+  }
+  return count;
+}
+
+static void mi_arena_get_info(mi_arena_t* arena, mi_arena_info_t* info) {
+  const size_t fields = arena->field_count;
+  const size_t bcount = arena->block_count;
+  info->start = arena->start;
+  info->block_size = MI_ARENA_BLOCK_SIZE;
+  info->block_count = bcount;
+  info->blocks_inuse = mi_arena_bitmap_count(arena->blocks_inuse, fields, bcount);
+  info->blocks_dirty = (!arena->memid.initially_zero ? bcount  // dirty blocks are only tracked for zero initialized memory
+                         : mi_arena_bitmap_count(arena->blocks_dirty, fields, bcount));
+  info->blocks_committed = (arena->blocks_committed == NULL ? bcount  // always committed
+                             : mi_arena_bitmap_count(arena->blocks_committed, fields, bcount));
+  info->blocks_purge = mi_arena_bitmap_count(arena->blocks_purge, fields, bcount);
+  info->numa_node = arena->numa_node;
+  info->is_exclusive = arena->exclusive;
+  info->is_large = arena->is_large;
+}
+
+bool mi_arena_info(mi_arena_id_t arena_id, mi_arena_info_t* info) mi_attr_noexcept {
+  if (info == NULL) return false;
+  const size_t arena_index = mi_arena_id_index(arena_id);
+  if (arena_index >= mi_atomic_load_relaxed(&mi_arena_count)) return false;
+  mi_arena_t* arena = mi_atomic_load_ptr_acquire(mi_arena_t, &mi_arenas[arena_index]);
+  if (arena == NULL) return false;
+  mi_arena_get_info(arena, info);
+  return true;
+}
+
+// Visit all arenas; returns `false` if the visitor returned `false` to stop
+bool mi_arenas_visit(mi_arena_visit_fun* visitor, void* arg) mi_attr_noexcept {
+  if (visitor == NULL) return false;
+  const size_t max_arena = mi_atomic_load_relaxed(&mi_arena_count);
+  for (size_t i = 0; i < max_arena; i++) {
+    mi_arena_t* arena = mi_atomic_load_ptr_acquire(mi_arena_t, &mi_arenas[i]);
+    if (arena == NULL) continue;
+    mi_arena_info_t info;
+    mi_arena_get_info(arena, &info);
+    if (!visitor(arena->id, &info, arg)) return false;
+  }
+  return true;
+}
+
+
 /* -----------------------------------------------------------
   Debugging
 ----------------------------------------------------------- */
@@ -871,34 +1141,69 @@ void mi_debug_show_arenas(void) mi_attr_noexcept {
   Reserve a huge page arena.
 ----------------------------------------------------------- */
 // reserve at a specific numa node
-int mi_reserve_huge_os_pages_at_ex(size_t pages, int numa_node, size_t timeout_msecs, bool exclusive, mi_arena_id_t* arena_id) mi_attr_noexcept {
-  if (arena_id != NULL) *arena_id = -1;
-  if (pages==0) return 0;
-  if (numa_node < -1) numa_node = -1;
-  if (numa_node >= 0) numa_node = numa_node % _mi_os_numa_node_count();
-  size_t hsize = 0;
-  size_t pages_reserved = 0;
-  mi_memid_t memid;
-  void* p = _mi_os_alloc_huge_os_pages(pages, numa_node, timeout_msecs, &pages_reserved, &hsize, &memid);
-  if (p==NULL || pages_reserved==0) {
-    _mi_warning_message("failed to reserve %zu GiB huge pages\n", pages);
+// A reservation of huge OS pages on a numa node
+typedef struct mi_huge_reserve_s {
+  size_t      pages;            // requested pages
+  int         numa_node;
+  size_t      timeout_msecs;
+  void*       start;            // result
+  size_t      size;
+  size_t      pages_reserved;
+  mi_msecs_t  elapsed;
+  mi_memid_t  memid;
+} mi_huge_reserve_t;
+
+static void mi_huge_reserve_alloc(mi_huge_reserve_t* r, bool prefault) {
+  mi_msecs_t start_t = _mi_clock_start();
+  r->start = _mi_os_alloc_huge_os_pages(r->pages, r->numa_node, r->timeout_msecs, prefault, &r->pages_reserved, &r->size, &r->memid);
+  r->elapsed = _mi_clock_end(start_t);
+}
+
+static int mi_huge_reserve_register(mi_huge_reserve_t* r, bool exclusive, mi_arena_id_t* arena_id) {
+  if (r->start==NULL || r->pages_reserved==0) {
+    _mi_warning_message("failed to reserve %zu GiB huge pages\n", r->pages);
     return ENOMEM;
   }
-  _mi_verbose_message("numa node %i: reserved %zu GiB huge pages (of the %zu GiB requested)\n", numa_node, pages_reserved, pages);
+  _mi_verbose_message("numa node %i: reserved %zu GiB huge pages (of the %zu GiB requested) in %ld ms\n", r->numa_node, r->pages_reserved, r->pages, (long)r->elapsed);
 
-  if (!mi_manage_os_memory_ex2(p, hsize, true, numa_node, exclusive, memid, arena_id)) {
-    _mi_os_free(p, hsize, memid, &_mi_stats_main);
+  if (!mi_manage_os_memory_ex2(r->start, r->size, true, r->numa_node, exclusive, r->memid, arena_id)) {
+    _mi_os_free(r->start, r->size, r->memid, &_mi_stats_main);
     return ENOMEM;
   }
   return 0;
 }
 
+int mi_reserve_huge_os_pages_at_ex(size_t pages, int numa_node, size_t timeout_msecs, bool exclusive, mi_arena_id_t* arena_id) mi_attr_noexcept {
+  if (arena_id != NULL) *arena_id = -1;
+  if (pages==0) return 0;
+  if (numa_node < -1) numa_node = -1;
+  if (numa_node >= 0) numa_node = numa_node % _mi_os_numa_node_count();
+  mi_huge_reserve_t r;
+  _mi_memzero_var(r);
+  r.pages = pages;
+  r.numa_node = numa_node;
+  r.timeout_msecs = timeout_msecs;
+  mi_huge_reserve_alloc(&r, false);
+  return mi_huge_reserve_register(&r, exclusive, arena_id);
+}
+
 int mi_reserve_huge_os_pages_at(size_t pages, int numa_node, size_t timeout_msecs) mi_attr_noexcept {
   return mi_reserve_huge_os_pages_at_ex(pages, numa_node, timeout_msecs, false, NULL);
 }
 
-// reserve huge pages evenly among the given number of numa nodes (or use the available ones as detected)
-int mi_reserve_huge_os_pages_interleave(size_t pages, size_t numa_nodes, size_t timeout_msecs) mi_attr_noexcept {
+#define MI_HUGE_RESERVE_NUMA_MAX  (64)  // reserve in parallel for at most this many numa nodes
+
+// called on a helper thread bound to the numa node
+static void mi_huge_reserve_on_node(void* arg, size_t node) {
+  mi_huge_reserve_t* r = &((mi_huge_reserve_t*)arg)[node];
+  if (r->pages > 0) {
+    mi_huge_reserve_alloc(r, true /* prefault */);
+  }
+}
+
+// reserve huge pages evenly among the given number of numa nodes (or use the available ones as detected);
+// if `parallel` is set, the nodes are reserved concurrently on helper threads
+int _mi_arena_reserve_huge_os_pages_interleave(size_t pages, size_t numa_nodes, size_t timeout_msecs, bool parallel) {
   if (pages == 0) return 0;
 
   // pages per numa node
@@ -906,9 +1211,30 @@ int mi_reserve_huge_os_pages_interleave(size_t pages, size_t numa_nodes, size_t
   if (numa_count <= 0) numa_count = 1;
   const size_t pages_per = pages / numa_count;
   const size_t pages_mod = pages % numa_count;
-  const size_t timeout_per = (timeout_msecs==0 ? 0 : (timeout_msecs / numa_count) + 50);
+
+  if (parallel && numa_count > 1 && numa_count <= MI_HUGE_RESERVE_NUMA_MAX) {
+    // reserve (and prefault) on all numa nodes in parallel using a helper thread per node;
+    // each node gets the full timeout as they run concurrently
+    mi_huge_reserve_t reserves[MI_HUGE_RESERVE_NUMA_MAX];
+    _mi_memzero(reserves, sizeof(reserves));
+    for (size_t numa_node = 0; numa_node < numa_count; numa_node++) {
+      reserves[numa_node].pages = pages_per + (numa_node < pages_mod ? 1 : 0);  // can be 0
+      reserves[numa_node].numa_node = (int)numa_node;
+      reserves[numa_node].timeout_msecs = timeout_msecs;
+    }
+    _mi_prim_numa_run_parallel(numa_count, &mi_huge_reserve_on_node, reserves);
+    // all helper threads are done; register the reserved pages as arenas
+    int err = 0;
+    for (size_t numa_node = 0; numa_node < numa_count; numa_node++) {
+      if (reserves[numa_node].pages == 0) continue;
+      int node_err = mi_huge_reserve_register(&reserves[numa_node], false, NULL);
+      if (err == 0) { err = node_err; }
+    }
+    return err;
+  }
 
   // reserve evenly among numa nodes
+  const size_t timeout_per = (timeout_msecs==0 ? 0 : (timeout_msecs / numa_count) + 50);
   for (size_t numa_node = 0; numa_node < numa_count && pages > 0; numa_node++) {
     size_t node_pages = pages_per;  // can be 0
     if (numa_node < pages_mod) node_pages++;
@@ -925,6 +1251,10 @@ int mi_reserve_huge_os_pages_interleave(size_t pages, size_t numa_nodes, size_t
   return 0;
 }
 
+int mi_reserve_huge_os_pages_interleave(size_t pages, size_t numa_nodes, size_t timeout_msecs) mi_attr_noexcept {
+  return _mi_arena_reserve_huge_os_pages_interleave(pages, numa_nodes, timeout_msecs, true /* parallel */);
+}
+
 int mi_reserve_huge_os_pages(size_t pages, double max_secs, size_t* pages_reserved) mi_attr_noexcept {
   MI_UNUSED(max_secs);
   _mi_warning_message("mi_reserve_huge_os_pages is deprecated: use mi_reserve_huge_os_pages_interleave/at instead\n");
@@ -176,6 +176,7 @@ void _mi_heap_collect_abandon(mi_heap_t* heap) {
 
 void mi_heap_collect(mi_heap_t* heap, bool force) mi_attr_noexcept {
   mi_heap_collect_ex(heap, (force ? MI_FORCE : MI_NORMAL));
+  if (heap != NULL && heap->cpu_heaps) { _mi_heap_cpu_collect(force); }
 }
 
 void mi_collect(bool force) mi_attr_noexcept {
@@ -229,6 +230,21 @@ mi_decl_nodiscard mi_heap_t* mi_heap_new(void) {
   return mi_heap_new_in_arena(_mi_arena_id_none());
 }
 
+// Create a heap in a fresh exclusive arena of at most 4GiB (or 4GiB if `size` is 0).
+// All its allocations (including huge ones) are inside the arena, see `mi_heap_cage_base`.
+mi_decl_nodiscard mi_heap_t* mi_heap_new_caged(size_t size) {
+  mi_arena_id_t arena_id;
+  if (!_mi_arena_reserve_cage(size, &arena_id)) return NULL;
+  return mi_heap_new_in_arena(arena_id);
+}
+
+// Return the start of the arena of a heap; any block `p` of the heap satisfies `0 <= p - base < size`.
+void* mi_heap_cage_base(const mi_heap_t* heap, size_t* size) mi_attr_noexcept {
+  if (size != NULL) *size = 0;
+  if (heap==NULL || heap->arena_id == _mi_arena_id_none()) return NULL;
+  return mi_arena_area(heap->arena_id, size);
+}
+
 bool _mi_heap_memid_is_suitable(mi_heap_t* heap, mi_memid_t memid) {
   return _mi_arena_memid_is_suitable(memid, heap->arena_id);
 }
@@ -315,6 +331,11 @@ static bool _mi_heap_page_destroy(mi_heap_t* heap, mi_page_queue_t* pq, mi_page_
   mi_heap_stat_decrease(heap, malloc, bsize * inuse);  // todo: off for aligned blocks...
 #endif
 
+  // forget any blocks sampled by the heap profiler
+  if mi_unlikely(mi_page_has_sampled(page)) {
+    _mi_heap_profile_free_page(_mi_page_segment(page), page);
+  }
+
   /// pretend it is all free now
   mi_assert_internal(mi_page_thread_free(page) == NULL);
   page->used = 0;
@@ -352,6 +373,8 @@ void mi_heap_destroy(mi_heap_t* heap) {
     mi_heap_delete(heap);
   }
   else {
+    // report the live blocks by allocation site
+    if mi_unlikely(heap->tag_allocs && mi_option_get(mi_option_alloc_tags) > 1) { _mi_heap_tags_print_live(heap); }
     // track all blocks as freed
     #if MI_TRACK_HEAP_DESTROY
     mi_heap_visit_blocks(heap, true, mi_heap_track_block_free, NULL);
@@ -436,6 +459,26 @@ void mi_heap_delete(mi_heap_t* heap)
   mi_heap_free(heap);
 }
 
+/* -----------------------------------------------------------
+  Snapshots
+----------------------------------------------------------- */
+
+// Return a read-only, frozen image of the (shared) arena of the heap, or NULL on error.
+// A block `p` of the heap is found at `snapshot + (p - mi_arena_area(heap arena))`.
+// The heap keeps working as before but its later writes are no longer visible in the snapshot.
+// The heap (and any other heap in the arena) must not be used concurrently during this call.
+const void* mi_heap_snapshot(mi_heap_t* heap, size_t* size) mi_attr_noexcept {
+  if (size != NULL) *size = 0;
+  if (heap==NULL || !mi_heap_is_initialized(heap)) return NULL;
+  if (heap->arena_id == _mi_arena_id_none()) return NULL;   // only heaps in a shared arena
+  return _mi_arena_snapshot(heap->arena_id, size);
+}
+
+void mi_heap_snapshot_free(const void* snapshot, size_t size) mi_attr_noexcept {
+  _mi_arena_snapshot_free(snapshot, size);
+}
+
+
 mi_heap_t* mi_heap_set_default(mi_heap_t* heap) {
   mi_assert(heap != NULL);
   mi_assert(mi_heap_is_initialized(heap));
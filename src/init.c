@@ -29,10 +29,8 @@ const mi_page_t _mi_page_empty = {
   #endif
   MI_ATOMIC_VAR_INIT(0), // xthread_free
   MI_ATOMIC_VAR_INIT(0), // xheap
-  NULL, NULL
-  #if MI_INTPTR_SIZE==8
-  , { 0 }  // padding
-  #endif
+  NULL, NULL,
+  NULL     // tags
 };
 
 #define MI_PAGE_EMPTY() ((mi_page_t*)&_mi_page_empty)
@@ -84,7 +82,9 @@ const mi_page_t _mi_page_empty = {
   MI_STAT_COUNT_NULL(), MI_STAT_COUNT_NULL(), \
   MI_STAT_COUNT_NULL(), \
   { 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 }, \
-  { 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 } \
+  { 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 }, \
+  { 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 }, \
+  { { 0, 0, { 0 } } } \
   MI_STAT_COUNT_END_NULL()
 
 
@@ -110,6 +110,7 @@ const mi_page_t _mi_page_empty = {
 
 mi_decl_cache_align const mi_heap_t _mi_heap_empty = {
   NULL,
+  0,                // profile countdown
   MI_SMALL_PAGES_EMPTY,
   MI_PAGE_QUEUES_EMPTY,
   MI_ATOMIC_VAR_INIT(NULL),
@@ -121,7 +122,10 @@ mi_decl_cache_align const mi_heap_t _mi_heap_empty = {
   0,                // page count
   MI_BIN_FULL, 0,   // page retired min/max
   NULL,             // next
-  false
+  false,
+  false,            // cpu heaps
+  false,            // tag allocations
+  0                 // sample countdown
 };
 
 #define tld_empty_stats  ((mi_stats_t*)((uint8_t*)&tld_empty + offsetof(mi_tld_t,stats)))
@@ -130,9 +134,11 @@ mi_decl_cache_align const mi_heap_t _mi_heap_empty = {
 mi_decl_cache_align static const mi_tld_t tld_empty = {
   0,
   false,
+  0,
   NULL, NULL,
-  { MI_SEGMENT_SPAN_QUEUES_EMPTY, 0, 0, 0, 0, tld_empty_stats, tld_empty_os }, // segments
-  { 0, tld_empty_stats }, // os
+  { MI_SEGMENT_SPAN_QUEUES_EMPTY, 0, 0, 0, 0, tld_empty_stats, tld_empty_os, 0 }, // segments
+  { 0, tld_empty_stats, -1, 0 }, // os
+  NULL, NULL,             // stats list
   { MI_STATS_NULL }       // stats
 };
 
@@ -146,15 +152,17 @@ mi_decl_thread mi_heap_t* _mi_heap_default = (mi_heap_t*)&_mi_heap_empty;
 extern mi_heap_t _mi_heap_main;
 
 static mi_tld_t tld_main = {
-  0, false,
+  0, false, 0,
   &_mi_heap_main, & _mi_heap_main,
-  { MI_SEGMENT_SPAN_QUEUES_EMPTY, 0, 0, 0, 0, &tld_main.stats, &tld_main.os }, // segments
-  { 0, &tld_main.stats },  // os
+  { MI_SEGMENT_SPAN_QUEUES_EMPTY, 0, 0, 0, 0, &tld_main.stats, &tld_main.os, 0 }, // segments
+  { 0, &tld_main.stats, -1, 0 },  // os
+  NULL, NULL,             // stats list
   { MI_STATS_NULL }       // stats
 };
 
 mi_heap_t _mi_heap_main = {
   &tld_main,
+  0,                // profile countdown
   MI_SMALL_PAGES_EMPTY,
   MI_PAGE_QUEUES_EMPTY,
   MI_ATOMIC_VAR_INIT(NULL),
@@ -166,7 +174,10 @@ mi_heap_t _mi_heap_main = {
   0,                // page count
   MI_BIN_FULL, 0,   // page retired min/max
   NULL,             // next heap
-  false             // can reclaim
+  false,            // can reclaim
+  false,            // cpu heaps
+  false,            // tag allocations
+  0                 // sample countdown
 };
 
 bool _mi_process_is_initialized = false;  // set to `true` in `mi_process_init`.
@@ -186,6 +197,7 @@ static void mi_heap_main_init(void) {
     _mi_heap_main.cookie  = _mi_heap_random_next(&_mi_heap_main);
     _mi_heap_main.keys[0] = _mi_heap_random_next(&_mi_heap_main);
     _mi_heap_main.keys[1] = _mi_heap_random_next(&_mi_heap_main);
+    _mi_stats_register(&tld_main);
   }
 }
 
@@ -282,6 +294,211 @@ void _mi_thread_data_collect(void) {
   }
 }
 
+
+/* -----------------------------------------------------------
+  Per-CPU heaps
+
+  With `mi_option_percpu_heaps` enabled, the thread backing heaps
+  redirect their allocations to a heap per processor instead. This
+  keeps the footprint proportional to the number of processors
+  instead of the number of threads. Each per-CPU heap is protected
+  by a lock that is almost never contended: it is taken by the
+  thread that currently runs on that processor (as read cheaply from
+  the rseq area). If it is taken anyway (because the owner was
+  preempted or migrated), we try the heaps of the other processors.
+
+  The per-CPU heaps (and their segments) are owned by a unique id
+  that is not a thread id (it has `MI_CPU_HEAP_OWNER_BIT` set). A
+  free into them takes the heap lock and frees the block as the
+  owner; only if the lock is busy the block is pushed on the
+  thread-free list (`xthread_free`) to be collected by whichever
+  thread allocates next from that heap. For large and huge blocks
+  we wait for the lock instead so their memory is released right away.
+----------------------------------------------------------- */
+
+#define MI_CPU_HEAPS_MAX  (256)   // processors beyond this share heaps
+
+typedef struct mi_cpu_heap_s {
+  mi_heap_t          heap;        // must come first (see `mi_cpu_heap_of`)
+  mi_tld_t           tld;
+  _Atomic(uintptr_t) lock;
+  mi_memid_t         memid;
+} mi_cpu_heap_t;
+
+static _Atomic(mi_cpu_heap_t*) mi_cpu_heaps[MI_CPU_HEAPS_MAX];
+
+// the per-CPU heap currently held by this thread (to allow re-entrant allocation, e.g. from a deferred free callback)
+static mi_decl_thread mi_heap_t* mi_cpu_heap_held;
+static mi_decl_thread size_t     mi_cpu_heap_held_count;
+
+static inline mi_cpu_heap_t* mi_cpu_heap_of(mi_heap_t* heap) {
+  return (mi_cpu_heap_t*)heap;
+}
+
+static bool mi_cpu_heaps_enabled(void) {
+  if (!mi_option_is_enabled(mi_option_percpu_heaps)) return false;
+  size_t cpu;
+  return _mi_prim_cpu_id(&cpu);
+}
+
+static mi_cpu_heap_t* mi_cpu_heap_create(size_t idx) {
+  mi_memid_t memid;
+  mi_cpu_heap_t* ch = (mi_cpu_heap_t*)_mi_os_alloc(sizeof(mi_cpu_heap_t), &memid, &_mi_stats_main);
+  if (ch == NULL) {
+    _mi_error_message(ENOMEM, "unable to allocate per-CPU heap metadata (%zu bytes)\n", sizeof(mi_cpu_heap_t));
+    return NULL;
+  }
+  mi_tld_t*  tld  = &ch->tld;
+  mi_heap_t* heap = &ch->heap;
+  _mi_memcpy_aligned(tld, &tld_empty, sizeof(*tld));
+  _mi_memcpy_aligned(heap, &_mi_heap_empty, sizeof(*heap));
+  ch->memid = memid;
+  mi_atomic_store_relaxed(&ch->lock, (uintptr_t)0);
+  heap->thread_id = (mi_threadid_t)ch | MI_CPU_HEAP_OWNER_BIT;  // unique and never equal to a thread id
+  _mi_random_init(&heap->random);
+  heap->cookie  = _mi_heap_random_next(heap) | 1;
+  heap->keys[0] = _mi_heap_random_next(heap);
+  heap->keys[1] = _mi_heap_random_next(heap);
+  heap->tld = tld;
+  tld->heap_backing = heap;
+  tld->heaps = heap;
+  tld->segments.stats = &tld->stats;
+  tld->segments.os = &tld->os;
+  tld->segments.owner_id = heap->thread_id;
+  tld->os.stats = &tld->stats;
+  // publish (or use the one another thread created concurrently)
+  mi_cpu_heap_t* expected = NULL;
+  if (!mi_atomic_cas_ptr_strong_release(mi_cpu_heap_t, &mi_cpu_heaps[idx], &expected, ch)) {
+    _mi_os_free(ch, sizeof(mi_cpu_heap_t), memid, &_mi_stats_main);
+    ch = mi_atomic_load_ptr_acquire(mi_cpu_heap_t, &mi_cpu_heaps[idx]);
+  }
+  else {
+    _mi_stats_register(tld);
+  }
+  return ch;
+}
+
+static bool mi_cpu_heap_try_lock(mi_cpu_heap_t* ch) {
+  uintptr_t expected = 0;
+  return (mi_atomic_load_relaxed(&ch->lock) == 0 &&
+          mi_atomic_cas_strong_acq_rel(&ch->lock, &expected, (uintptr_t)1));
+}
+
+// Acquire the heap of the current processor (or of another one if it is busy).
+// Returns NULL if out of memory.
+mi_heap_t* _mi_heap_cpu_acquire(void) {
+  if mi_unlikely(mi_cpu_heap_held != NULL) {
+    // re-entrant allocation while holding a per-CPU heap
+    mi_cpu_heap_held_count++;
+    return mi_cpu_heap_held;
+  }
+  size_t cpu;
+  _mi_prim_cpu_id(&cpu);
+  const size_t idx = cpu % MI_CPU_HEAPS_MAX;
+  mi_cpu_heap_t* ch = mi_atomic_load_ptr_acquire(mi_cpu_heap_t, &mi_cpu_heaps[idx]);
+  if mi_unlikely(ch == NULL) {
+    ch = mi_cpu_heap_create(idx);
+    if (ch == NULL) return NULL;
+  }
+  while (!mi_cpu_heap_try_lock(ch)) {
+    // busy: try the heaps of the other processors, and create an extra heap if all existing ones are busy
+    // (as otherwise we may spin for a full time slice when the owner was preempted while holding the lock)
+    for (size_t i = 1; i < MI_CPU_HEAPS_MAX; i++) {
+      const size_t oidx = (idx + i) % MI_CPU_HEAPS_MAX;
+      mi_cpu_heap_t* other = mi_atomic_load_ptr_acquire(mi_cpu_heap_t, &mi_cpu_heaps[oidx]);
+      if (other == NULL) {
+        // only create if no existing heap is free
+        bool any_free = false;
+        for (size_t j = i + 1; j < MI_CPU_HEAPS_MAX && !any_free; j++) {
+          mi_cpu_heap_t* h = mi_atomic_load_ptr_relaxed(mi_cpu_heap_t, &mi_cpu_heaps[(idx + j) % MI_CPU_HEAPS_MAX]);
+          any_free = (h != NULL && mi_atomic_load_relaxed(&h->lock) == 0);
+        }
+        if (!any_free) { other = mi_cpu_heap_create(oidx); }
+      }
+      if (other != NULL && mi_cpu_heap_try_lock(other)) {
+        ch = other;
+        goto locked;
+      }
+    }
+    mi_atomic_yield();
+  }
+locked:
+  mi_cpu_heap_held = &ch->heap;
+  mi_cpu_heap_held_count = 1;
+  return &ch->heap;
+}
+
+// Acquire the per-CPU heap that owns the segments with id `owner_id` (to free into it as the owner).
+// Returns NULL if it is busy (and we should not `wait`), or if we hold another per-CPU heap already.
+mi_heap_t* _mi_heap_cpu_try_acquire(mi_threadid_t owner_id, bool wait) {
+  mi_assert_internal((owner_id & MI_CPU_HEAP_OWNER_BIT) != 0);
+  mi_cpu_heap_t* const ch = (mi_cpu_heap_t*)(owner_id & ~MI_CPU_HEAP_OWNER_BIT);
+  if mi_unlikely(mi_cpu_heap_held != NULL) {
+    if (mi_cpu_heap_held != &ch->heap) return NULL;  // never wait while holding a lock (as that may deadlock)
+    mi_cpu_heap_held_count++;
+    return mi_cpu_heap_held;
+  }
+  while (!mi_cpu_heap_try_lock(ch)) {
+    if (!wait) return NULL;
+    mi_atomic_yield();
+  }
+  mi_cpu_heap_held = &ch->heap;
+  mi_cpu_heap_held_count = 1;
+  return &ch->heap;
+}
+
+void _mi_heap_cpu_release(mi_heap_t* heap) {
+  mi_assert_internal(heap == mi_cpu_heap_held && mi_cpu_heap_held_count > 0);
+  if (--mi_cpu_heap_held_count > 0) return;
+  mi_cpu_heap_held = NULL;
+  mi_atomic_store_release(&mi_cpu_heap_of(heap)->lock, (uintptr_t)0);
+}
+
+// Is this a per-CPU heap held by the current thread? (used in assertions)
+bool _mi_heap_cpu_is_held(const mi_heap_t* heap) {
+  return (heap != NULL && heap == mi_cpu_heap_held);
+}
+
+// Visit each per-CPU heap while holding its lock
+static void mi_cpu_heaps_visit(void (*visit)(mi_heap_t* heap, void* arg), void* arg) {
+  if (mi_cpu_heap_held != NULL) return;  // avoid deadlock on re-entrance
+  for (size_t i = 0; i < MI_CPU_HEAPS_MAX; i++) {
+    mi_cpu_heap_t* ch = mi_atomic_load_ptr_acquire(mi_cpu_heap_t, &mi_cpu_heaps[i]);
+    if (ch == NULL) continue;
+    while (!mi_cpu_heap_try_lock(ch)) { mi_atomic_yield(); }
+    mi_cpu_heap_held = &ch->heap;
+    mi_cpu_heap_held_count = 1;
+    visit(&ch->heap, arg);
+    mi_cpu_heap_held = NULL;
+    mi_atomic_store_release(&ch->lock, (uintptr_t)0);
+  }
+}
+
+static void mi_cpu_heap_collect(mi_heap_t* heap, void* arg) {
+  mi_heap_collect(heap, *((bool*)arg));
+}
+
+// Collect all per-CPU heaps (called from `mi_heap_collect` on a thread heap that redirects to the per-CPU heaps)
+void _mi_heap_cpu_collect(bool force) {
+  mi_cpu_heaps_visit(&mi_cpu_heap_collect, &force);
+}
+
+static void mi_cpu_heap_stats_merge(mi_heap_t* heap, void* arg) {
+  MI_UNUSED(arg);
+  _mi_stats_done(&heap->tld->stats);
+}
+
+// Merge the statistics of all per-CPU heaps into the main statistics
+void _mi_heap_cpu_stats_merge(void) {
+  mi_cpu_heaps_visit(&mi_cpu_heap_stats_merge, NULL);
+}
+
+// Visit each per-CPU heap while holding its lock (used for the fragmentation report)
+void _mi_heap_cpu_visit(void (*visit)(mi_heap_t* heap, void* arg), void* arg) {
+  mi_cpu_heaps_visit(visit, arg);
+}
+
+
 // Initialize the thread local default heap, called from `mi_thread_init`
 static bool _mi_heap_init(void) {
   if (mi_heap_is_initialized(mi_prim_get_default_heap())) return true;
@@ -312,6 +529,8 @@ static bool _mi_heap_init(void) {
     tld->segments.stats = &tld->stats;
     tld->segments.os = &tld->os;
     tld->os.stats = &tld->stats;
+    _mi_stats_register(tld);
+    heap->cpu_heaps = mi_cpu_heaps_enabled();
     _mi_heap_set_default_direct(heap);
   }
   return false;
@@ -346,8 +565,13 @@ static bool _mi_heap_done(mi_heap_t* heap) {
     _mi_heap_collect_abandon(heap);
   }
 
-  // merge stats
-  _mi_stats_done(&heap->tld->stats);
+  // merge stats (and stop tracking the statistics of this thread if it is not the main thread)
+  if (heap != &_mi_heap_main) {
+    _mi_stats_unregister(heap->tld);
+  }
+  else {
+    _mi_stats_done(&heap->tld->stats);
+  }
 
   // free if not the main thread
   if (heap != &_mi_heap_main) {
@@ -419,6 +643,7 @@ void mi_thread_init(void) mi_attr_noexcept
 
   _mi_stat_increase(&_mi_stats_main.threads, 1);
   mi_atomic_increment_relaxed(&thread_count);
+  mi_probe1(thread_init, mi_prim_get_default_heap());
   //_mi_verbose_message("thread init: 0x%zx\n", _mi_thread_id());
 }
 
@@ -439,6 +664,8 @@ void _mi_thread_done(mi_heap_t* heap)
     return; 
   }
 
+  mi_probe1(thread_done, heap);
+
   // adjust stats
   mi_atomic_decrement_relaxed(&thread_count);
   _mi_stat_decrease(&_mi_stats_main.threads, 1);
@@ -446,6 +673,10 @@ void _mi_thread_done(mi_heap_t* heap)
   // check thread-id as on Windows shutdown with FLS the main (exit) thread may call this on thread-local heaps...
   if (heap->thread_id != _mi_thread_id()) return;
 
+  #if MI_TRACE_ALLOCS
+  _mi_trace_thread_done();
+  #endif
+
   // abandon the thread local heap
   if (_mi_heap_done(heap)) return;  // returns true if already ran
 }
@@ -575,6 +806,7 @@ void mi_process_init(void) mi_attr_noexcept {
 
   mi_detect_cpu_features();
   mi_heap_main_init();
+  _mi_heap_main.cpu_heaps = mi_cpu_heaps_enabled();
   #if MI_DEBUG
   _mi_verbose_message("debug level : %d\n", MI_DEBUG);
   #endif
@@ -583,7 +815,11 @@ void mi_process_init(void) mi_attr_noexcept {
   #if MI_TSAN
   _mi_verbose_message("thread santizer enabled\n");
   #endif
+  _mi_os_reserve_init();  // before any OS memory is allocated
+  _mi_os_limit_init();
   mi_thread_init();
+  _mi_stats_init();
+  _mi_os_pressure_monitor_init();
 
   #if defined(_WIN32)
   // On windows, when building as a static lib the FLS cleanup happens to early for the main thread.
@@ -601,7 +837,14 @@ void mi_process_init(void) mi_attr_noexcept {
     if (reserve_at != -1) {
       mi_reserve_huge_os_pages_at(pages, reserve_at, pages*500);
     } else {
-      mi_reserve_huge_os_pages_interleave(pages, 0, pages*500);
+      #if defined(MI_MALLOC_OVERRIDE)
+      // creating the helper threads would re-enter the allocator while it is being initialized
+      // (call `mi_reserve_huge_os_pages_interleave` after startup to reserve in parallel)
+      const bool parallel = false;
+      #else
+      const bool parallel = true;
+      #endif
+      _mi_arena_reserve_huge_os_pages_interleave(pages, 0, pages*500, parallel);
     }
   }
   if (mi_option_is_enabled(mi_option_reserve_os_memory)) {
@@ -621,6 +864,10 @@ static void mi_cdecl mi_process_done(void) {
   if (process_done) return;
   process_done = true;
 
+  #if MI_TRACE_ALLOCS
+  _mi_trace_done();
+  #endif
+
   // release any thread specific resources and ensure _mi_thread_done is called on all but the main thread
   _mi_prim_thread_done_auto_done();
   
@@ -90,6 +90,14 @@ static mi_option_desc_t options[_mi_option_last] =
   #endif
   { 10,  UNINIT, MI_OPTION(arena_purge_mult) },        // purge delay multiplier for arena's
   { 1,   UNINIT, MI_OPTION_LEGACY(purge_extend_delay, decommit_extend_delay) },
+  { 0,   UNINIT, MI_OPTION(os_reserve) },              // reserve N KiB of virtual address space at startup
+  { 0,   UNINIT, MI_OPTION(percpu_heaps) },            // use per-CPU heaps for the default heap
+  { 0,   UNINIT, MI_OPTION(pressure_monitor) },        // purge more eagerly under OS memory pressure
+  { 0,   UNINIT, MI_OPTION(memory_limit) },            // limit the memory usage to N KiB
+  { 0,   UNINIT, MI_OPTION(memory_limit_cgroup) },     // limit the memory usage to that of the cgroup
+  { 0,   UNINIT, MI_OPTION(profile_interval) },        // sample every N KiB allocated for the heap profiler
+  { 0,   UNINIT, MI_OPTION(latency_stats) },           // keep latency histograms of slow paths and OS calls
+  { 0,   UNINIT, MI_OPTION(alloc_tags) },              // tag allocations with their site (slow; for finding leaks)
 };
 
 static void mi_option_init(mi_option_desc_t* desc);
@@ -128,7 +136,7 @@ mi_decl_nodiscard long mi_option_get_clamp(mi_option_t option, long min, long ma
 }
 
 mi_decl_nodiscard size_t mi_option_get_size(mi_option_t option) {
-  mi_assert_internal(option == mi_option_reserve_os_memory || option == mi_option_arena_reserve);
+  mi_assert_internal(option == mi_option_reserve_os_memory || option == mi_option_arena_reserve || option == mi_option_os_reserve || option == mi_option_memory_limit || option == mi_option_profile_interval);
   long x = mi_option_get(option);
   return (x < 0 ? 0 : (size_t)x * MI_KiB);
 }
@@ -434,55 +442,6 @@ void _mi_error_message(int err, const char* fmt, ...) {
 // --------------------------------------------------------
 // Initialize options by checking the environment
 // --------------------------------------------------------
-char _mi_toupper(char c) {
-  if (c >= 'a' && c <= 'z') return (c - 'a' + 'A');
-                       else return c;
-}
-
-int _mi_strnicmp(const char* s, const char* t, size_t n) {
-  if (n == 0) return 0;
-  for (; *s != 0 && *t != 0 && n > 0; s++, t++, n--) {
-    if (_mi_toupper(*s) != _mi_toupper(*t)) break;
-  }
-  return (n == 0 ? 0 : *s - *t);
-}
-
-void _mi_strlcpy(char* dest, const char* src, size_t dest_size) {
-  if (dest==NULL || src==NULL || dest_size == 0) return;
-  // copy until end of src, or when dest is (almost) full
-  while (*src != 0 && dest_size > 1) {
-    *dest++ = *src++;
-    dest_size--;
-  }
-  // always zero terminate
-  *dest = 0;
-}
-
-void _mi_strlcat(char* dest, const char* src, size_t dest_size) {
-  if (dest==NULL || src==NULL || dest_size == 0) return;
-  // find end of string in the dest buffer
-  while (*dest != 0 && dest_size > 1) {
-    dest++;
-    dest_size--;
-  }
-  // and catenate
-  _mi_strlcpy(dest, src, dest_size);
-}
-
-size_t _mi_strlen(const char* s) {
-  if (s==NULL) return 0;
-  size_t len = 0;
-  while(s[len] != 0) { len++; }
-  return len;
-}
-
-size_t _mi_strnlen(const char* s, size_t max_len) {
-  if (s==NULL) return 0;
-  size_t len = 0;
-  while(s[len] != 0 && len < max_len) { len++; }
-  return len;
-}
-
 #ifdef MI_NO_GETENV
 static bool mi_getenv(const char* name, char* result, size_t result_size) {
   MI_UNUSED(name);
@@ -535,7 +494,7 @@ static void mi_option_init(mi_option_desc_t* desc) {
     else {
       char* end = buf;
       long value = strtol(buf, &end, 10);
-      if (desc->option == mi_option_reserve_os_memory || desc->option == mi_option_arena_reserve) {
+      if (desc->option == mi_option_reserve_os_memory || desc->option == mi_option_arena_reserve || desc->option == mi_option_memory_limit) {
         // this option is interpreted in KiB to prevent overflow of `long`
         if (*end == 'K') { end++; }
         else if (*end == 'M') { value *= MI_KiB; end++; }
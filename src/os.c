@@ -8,6 +8,7 @@ terms of the MIT license. A copy of the license can be found in the file
 #include "mimalloc/internal.h"
 #include "mimalloc/atomic.h"
 #include "mimalloc/prim.h"
+#include "bitmap.h"          // the chunks of the up-front reservation
 
 
 /* -----------------------------------------------------------
@@ -72,6 +73,8 @@ void _mi_os_init(void) {
 -------------------------------------------------------------- */
 bool _mi_os_decommit(void* addr, size_t size, mi_stats_t* stats);
 bool _mi_os_commit(void* addr, size_t size, bool* is_zero, mi_stats_t* tld_stats);
+static bool mi_os_limit_commit(size_t size);
+static void mi_os_limit_uncommit(size_t size);
 
 static void* mi_align_up_ptr(void* p, size_t alignment) {
   return (void*)_mi_align_up((uintptr_t)p, alignment);
@@ -133,6 +136,158 @@ void* _mi_os_get_aligned_hint(size_t try_alignment, size_t size) {
 #endif
 
 
+/* -----------------------------------------------------------
+  Up-front virtual address reservation.
+  If `mi_option_os_reserve` is set, a single contiguous range of
+  virtual address space is reserved at process start and OS memory
+  is allocated from it first. As long as all OS memory comes from
+  this range, checking if a pointer belongs to mimalloc is a single
+  range comparison. The range is divided in chunks that are claimed
+  in a bitmap (stored at the start of the range); freed memory is
+  decommitted and its chunks can be reused.
+-------------------------------------------------------------- */
+
+#define MI_OS_RESERVE_CHUNK   (MI_SEGMENT_SLICE_SIZE)   // 64KiB
+
+static uint8_t*        mi_os_reserve_start;   // = NULL
+static size_t          mi_os_reserve_size;    // = 0
+static mi_bitmap_t     mi_os_reserve_inuse;   // = NULL, a bit per chunk
+static size_t          mi_os_reserve_fields;  // = 0, fields in the bitmap
+static _Atomic(size_t) mi_os_reserve_used;    // = 0, highest offset ever allocated (memory above it is still zero)
+static _Atomic(size_t) mi_os_outside_count;   // = 0, number of live OS allocations (or managed areas) outside the reservation
+
+void _mi_os_reserve_init(void) {
+  if (mi_os_reserve_start != NULL) return;
+  const size_t size = _mi_align_up(mi_option_get_size(mi_option_os_reserve), MI_SEGMENT_ALIGN);
+  if (size == 0 || !mi_os_mem_config.has_virtual_reserve) return;
+  if (mi_atomic_load_relaxed(&mi_os_outside_count) > 0) {
+    _mi_verbose_message("OS memory was already allocated before the virtual address space was reserved\n");
+  }
+  void* p = NULL;
+  int err = _mi_prim_reserve(size + MI_SEGMENT_ALIGN, &p);  // over-reserve so we can align the start
+  if (err != 0 || p == NULL) {
+    _mi_warning_message("unable to reserve virtual address space (error: %d (0x%x), size: %zu KiB)\n", err, err, size / MI_KiB);
+    return;
+  }
+  uint8_t* const start = (uint8_t*)mi_align_up_ptr(p, MI_SEGMENT_ALIGN);
+  // the bitmap is at the start of the range and its chunks are claimed
+  const size_t chunks = size / MI_OS_RESERVE_CHUNK;
+  const size_t fields = _mi_divide_up(chunks, MI_BITMAP_FIELD_BITS);
+  const size_t bitmap_size = _mi_align_up(fields * sizeof(mi_bitmap_field_t), MI_OS_RESERVE_CHUNK);
+  if (!_mi_os_commit(start, bitmap_size, NULL, &_mi_stats_main)) {
+    _mi_warning_message("unable to commit the bitmap of the reserved virtual address space\n");
+    return;
+  }
+  mi_os_reserve_inuse  = (mi_bitmap_t)start;
+  mi_os_reserve_fields = fields;
+  _mi_bitmap_claim_across(mi_os_reserve_inuse, fields, bitmap_size / MI_OS_RESERVE_CHUNK, 0, NULL);
+  const size_t post = (fields * MI_BITMAP_FIELD_BITS) - chunks;
+  if (post > 0) {  // don't use the trailing bits of the last field
+    _mi_bitmap_claim(mi_os_reserve_inuse, fields, post, mi_bitmap_index_create(fields - 1, MI_BITMAP_FIELD_BITS - post), NULL);
+  }
+  mi_atomic_store_relaxed(&mi_os_reserve_used, bitmap_size);
+  mi_os_reserve_size  = size;
+  mi_os_reserve_start = start;
+  _mi_verbose_message("reserved %zu KiB of virtual address space at %p\n", size / MI_KiB, mi_os_reserve_start);
+}
+
+// Is `p` inside the up-front reservation?
+bool _mi_os_reserve_contains(const void* p) {
+  return ((const uint8_t*)p >= mi_os_reserve_start && (const uint8_t*)p < mi_os_reserve_start + mi_os_reserve_size);
+}
+
+// Does all OS memory come from the reservation? If so, any pointer outside it cannot be ours.
+bool _mi_os_reserve_is_complete(void) {
+  return (mi_os_reserve_start != NULL && mi_atomic_load_relaxed(&mi_os_outside_count) == 0);
+}
+
+// Called for memory that mimalloc manages but that was not allocated from the reservation (e.g. `mi_manage_os_memory`).
+void _mi_os_reserve_note_outside(void) {
+  mi_atomic_increment_relaxed(&mi_os_outside_count);
+}
+
+// Called when OS memory outside the reservation is freed again.
+static void mi_os_reserve_note_outside_free(void) {
+  mi_atomic_decrement_relaxed(&mi_os_outside_count);
+}
+
+static mi_bitmap_index_t mi_os_reserve_chunk_index(const void* p) {
+  return mi_bitmap_index_create_from_bit((size_t)((const uint8_t*)p - mi_os_reserve_start) / MI_OS_RESERVE_CHUNK);
+}
+
+static void mi_os_reserve_free(void* addr, size_t size, bool still_committed, mi_stats_t* stats) {
+  mi_assert_internal(_mi_os_reserve_contains(addr) && _mi_os_reserve_contains((uint8_t*)addr + size - 1));
+  mi_assert_internal(_mi_is_aligned(addr, MI_OS_RESERVE_CHUNK));
+  if (still_committed) { _mi_os_decommit(addr, size, stats); }
+  _mi_stat_decrease(&stats->reserved, size);
+  // and make the chunks available again
+  const bool all_claimed = _mi_bitmap_unclaim_across(mi_os_reserve_inuse, mi_os_reserve_fields, _mi_divide_up(size, MI_OS_RESERVE_CHUNK), mi_os_reserve_chunk_index(addr));
+  MI_UNUSED(all_claimed);
+  mi_assert_internal(all_claimed);
+}
+
+// Claim `count` chunks with the start aligned to `alignment`; returns NULL if there is no such range.
+// Claims are serialized so an aligned range can be checked and then claimed.
+static _Atomic(uintptr_t) mi_os_reserve_lock;   // = 0
+
+static uint8_t* mi_os_reserve_claim(size_t count, size_t alignment) {
+  const size_t chunks = mi_os_reserve_size / MI_OS_RESERVE_CHUNK;
+  if (count > chunks) return NULL;
+  uintptr_t expected = 0;
+  while (!mi_atomic_cas_weak_acq_rel(&mi_os_reserve_lock, &expected, (uintptr_t)1)) {
+    expected = 0;
+    mi_atomic_yield();
+  }
+  uint8_t* p = NULL;
+  mi_bitmap_index_t bitmap_idx;
+  if (alignment <= MI_OS_RESERVE_CHUNK) {
+    if (_mi_bitmap_try_find_from_claim_across(mi_os_reserve_inuse, mi_os_reserve_fields, 0, count, &bitmap_idx)) {
+      p = mi_os_reserve_start + mi_bitmap_index_bit(bitmap_idx) * MI_OS_RESERVE_CHUNK;
+    }
+  }
+  else {
+    // only try the aligned chunks
+    const size_t step = alignment / MI_OS_RESERVE_CHUNK;
+    size_t idx = (size_t)((uint8_t*)mi_align_up_ptr(mi_os_reserve_start, alignment) - mi_os_reserve_start) / MI_OS_RESERVE_CHUNK;
+    for (; idx + count <= chunks; idx += step) {
+      if (!_mi_bitmap_is_any_claimed_across(mi_os_reserve_inuse, mi_os_reserve_fields, count, idx)) {
+        _mi_bitmap_claim_across(mi_os_reserve_inuse, mi_os_reserve_fields, count, idx, NULL);
+        p = mi_os_reserve_start + idx * MI_OS_RESERVE_CHUNK;
+        break;
+      }
+    }
+  }
+  mi_atomic_store_release(&mi_os_reserve_lock, (uintptr_t)0);
+  return p;
+}
+
+static void* mi_os_reserve_alloc(size_t size, size_t alignment, bool commit, mi_memid_t* memid, mi_stats_t* stats) {
+  if (mi_os_reserve_start == NULL) return NULL;
+  if (alignment > MI_OS_RESERVE_CHUNK && (alignment % MI_OS_RESERVE_CHUNK) != 0) return NULL;
+  uint8_t* const p = mi_os_reserve_claim(_mi_divide_up(size, MI_OS_RESERVE_CHUNK), alignment);
+  if (p == NULL) return NULL;  // exhausted
+  const size_t start = (size_t)(p - mi_os_reserve_start);
+
+  // memory beyond the high water mark was never touched and is still zero
+  size_t used = mi_atomic_load_relaxed(&mi_os_reserve_used);
+  const bool is_zero = (start >= used);
+  while (used < start + size && !mi_atomic_cas_weak_acq_rel(&mi_os_reserve_used, &used, start + size)) { /* nothing */ };
+
+  _mi_stat_counter_increase(&stats->mmap_calls, 1);
+  _mi_stat_increase(&stats->reserved, size);
+  if (commit && !_mi_os_commit(p, size, NULL, stats)) {
+    mi_os_reserve_free(p, size, false, stats);
+    return NULL;
+  }
+  *memid = _mi_memid_create(MI_MEM_OS_RESERVED);
+  memid->initially_committed = commit;
+  memid->initially_zero = is_zero;
+  memid->mem.os.base = p;   // so an over-allocation (see `_mi_os_alloc_aligned_at_offset`) is freed from the start
+  memid->mem.os.alignment = alignment;
+  return p;
+}
+
+
 /* -----------------------------------------------------------
   Free memory
 -------------------------------------------------------------- */
@@ -168,9 +323,13 @@ void _mi_os_free_ex(void* addr, size_t size, bool still_committed, mi_memid_t me
       mi_assert(memid.is_pinned);
       mi_os_free_huge_os_pages(base, csize, tld_stats);
     }
+    else if (memid.memkind == MI_MEM_OS_RESERVED) {
+      mi_os_reserve_free(base, csize, still_committed, &_mi_stats_main);
+    }
     else {
       mi_os_prim_free(base, csize, still_committed, tld_stats);
     }
+    if (memid.memkind != MI_MEM_OS_RESERVED) { mi_os_reserve_note_outside_free(); }
   }
   else {
     // nothing to do 
@@ -197,12 +356,16 @@ static void* mi_os_prim_alloc(size_t size, size_t try_alignment, bool commit, bo
   if (try_alignment == 0) { try_alignment = 1; } // avoid 0 to ensure there will be no divide by zero when aligning
 
   *is_zero = false;
+  if (commit && !mi_os_limit_commit(size)) return NULL;  // stay within the memory limits (this may purge first)
   void* p = NULL; 
+  const mi_ticks_t start = mi_latency_start();
   int err = _mi_prim_alloc(size, try_alignment, commit, allow_large, is_large, is_zero, &p);
+  mi_latency_end(mi_latency_prim_alloc, start);
   if (err != 0) {
     _mi_warning_message("unable to allocate OS memory (error: %d (0x%x), size: 0x%zx bytes, align: 0x%zx, commit: %d, allow large: %d)\n", err, err, size, try_alignment, commit, allow_large);
   }
-  mi_stat_counter_increase(stats->mmap_calls, 1);
+  if (p == NULL && commit) { mi_os_limit_uncommit(size); }
+  _mi_stat_counter_increase(&stats->mmap_calls, 1);
   if (p != NULL) {
     _mi_stat_increase(&stats->reserved, size);
     if (commit) { 
@@ -295,10 +458,13 @@ void* _mi_os_alloc(size_t size, mi_memid_t* memid, mi_stats_t* tld_stats) {
   mi_stats_t* stats = &_mi_stats_main;
   if (size == 0) return NULL;
   size = _mi_os_good_alloc_size(size);
+  void* p = mi_os_reserve_alloc(size, 0, true, memid, stats);
+  if (p != NULL) return p;
   bool os_is_large = false;
   bool os_is_zero  = false;
-  void* p = mi_os_prim_alloc(size, 0, true, false, &os_is_large, &os_is_zero, stats);
+  p = mi_os_prim_alloc(size, 0, true, false, &os_is_large, &os_is_zero, stats);
   if (p != NULL) {
+    _mi_os_reserve_note_outside();  // before the memory can be observed
     *memid = _mi_memid_create_os(true, os_is_zero, os_is_large);
   }  
   return p;
@@ -312,12 +478,17 @@ void* _mi_os_alloc_aligned(size_t size, size_t alignment, bool commit, bool allo
   if (size == 0) return NULL;
   size = _mi_os_good_alloc_size(size);
   alignment = _mi_align_up(alignment, _mi_os_page_size());
-  
+
+  // large OS pages are not used from the reservation
+  void* p = mi_os_reserve_alloc(size, alignment, commit, memid, &_mi_stats_main);
+  if (p != NULL) return p;
+
   bool os_is_large = false;
   bool os_is_zero  = false;
   void* os_base = NULL;
-  void* p = mi_os_prim_alloc_aligned(size, alignment, commit, allow_large, &os_is_large, &os_is_zero, &os_base, &_mi_stats_main /*tld->stats*/ );
+  p = mi_os_prim_alloc_aligned(size, alignment, commit, allow_large, &os_is_large, &os_is_zero, &os_base, &_mi_stats_main /*tld->stats*/ );
   if (p != NULL) {
+    _mi_os_reserve_note_outside();  // before the memory can be observed
     *memid = _mi_memid_create_os(commit, os_is_zero, os_is_large);
     memid->mem.os.base = os_base;
     memid->mem.os.alignment = alignment;
@@ -388,23 +559,28 @@ static void* mi_os_page_align_area_conservative(void* addr, size_t size, size_t*
   return mi_os_page_align_areax(true, addr, size, newsize);
 }
 
-bool _mi_os_commit(void* addr, size_t size, bool* is_zero, mi_stats_t* tld_stats) {
+static bool mi_os_commit(void* addr, size_t size, bool* is_zero, mi_stats_t* tld_stats) {
   MI_UNUSED(tld_stats);
   mi_stats_t* stats = &_mi_stats_main;  
   if (is_zero != NULL) { *is_zero = false; }
-  _mi_stat_increase(&stats->committed, size);  // use size for precise commit vs. decommit
-  _mi_stat_counter_increase(&stats->commit_calls, 1);
 
   // page align range
   size_t csize;
   void* start = mi_os_page_align_areax(false /* conservative? */, addr, size, &csize);
+  if (csize > 0 && !mi_os_limit_commit(csize)) return false;  // stay within the memory limits (this may purge first)
+  _mi_stat_increase(&stats->committed, size);  // use size for precise commit vs. decommit
+  _mi_stat_counter_increase(&stats->commit_calls, 1);
   if (csize == 0) return true;
 
   // commit  
   bool os_is_zero = false;
+  const mi_ticks_t prim_start = mi_latency_start();
   int err = _mi_prim_commit(start, csize, &os_is_zero); 
+  mi_latency_end(mi_latency_prim_commit, prim_start);
   if (err != 0) {
     _mi_warning_message("cannot commit OS memory (error: %d (0x%x), address: %p, size: 0x%zx bytes)\n", err, err, start, csize);
+    _mi_stat_decrease(&stats->committed, size);
+    mi_os_limit_uncommit(csize);
     return false;
   }
   if (os_is_zero && is_zero != NULL) { 
@@ -419,10 +595,21 @@ bool _mi_os_commit(void* addr, size_t size, bool* is_zero, mi_stats_t* tld_stats
   return true;
 }
 
+bool _mi_os_commit(void* addr, size_t size, bool* is_zero, mi_stats_t* tld_stats) {
+  mi_probe2(os_commit, addr, size);
+  mi_event(mi_event_os_commit, addr, size);
+  const mi_ticks_t start = mi_latency_start();
+  const bool ok = mi_os_commit(addr, size, is_zero, tld_stats);
+  mi_latency_end(mi_latency_os_commit, start);
+  return ok;
+}
+
 static bool mi_os_decommit_ex(void* addr, size_t size, bool* needs_recommit, mi_stats_t* tld_stats) {
   MI_UNUSED(tld_stats);
   mi_stats_t* stats = &_mi_stats_main;
   mi_assert_internal(needs_recommit!=NULL);
+  mi_probe2(os_decommit, addr, size);
+  mi_event(mi_event_os_decommit, addr, size);
   _mi_stat_decrease(&stats->committed, size);
 
   // page align
@@ -432,7 +619,9 @@ static bool mi_os_decommit_ex(void* addr, size_t size, bool* needs_recommit, mi_
 
   // decommit
   *needs_recommit = true;
+  const mi_ticks_t prim_start = mi_latency_start();
   int err = _mi_prim_decommit(start,csize,needs_recommit);  
+  mi_latency_end(mi_latency_prim_decommit, prim_start);
   if (err != 0) {
     _mi_warning_message("cannot decommit OS memory (error: %d (0x%x), address: %p, size: 0x%zx bytes)\n", err, err, start, csize);
   }
@@ -455,6 +644,7 @@ bool _mi_os_reset(void* addr, size_t size, mi_stats_t* stats) {
   size_t csize;
   void* start = mi_os_page_align_area_conservative(addr, size, &csize);
   if (csize == 0) return true;  // || _mi_os_is_huge_reserved(addr)
+  mi_probe2(os_reset, start, csize);
   _mi_stat_increase(&stats->reset, csize);
   _mi_stat_counter_increase(&stats->reset_calls, 1);
 
@@ -462,7 +652,9 @@ bool _mi_os_reset(void* addr, size_t size, mi_stats_t* stats) {
   memset(start, 0, csize); // pretend it is eagerly reset
   #endif
 
+  const mi_ticks_t prim_start = mi_latency_start();
   int err = _mi_prim_reset(start, csize);
+  mi_latency_end(mi_latency_prim_reset, prim_start);
   if (err != 0) {
     _mi_warning_message("cannot reset OS memory (error: %d (0x%x), address: %p, size: 0x%zx bytes)\n", err, err, start, csize);
   }
@@ -475,22 +667,10 @@ bool _mi_os_reset(void* addr, size_t size, mi_stats_t* stats) {
 bool _mi_os_purge_ex(void* p, size_t size, bool allow_reset, mi_stats_t* stats)
 {
   if (mi_option_get(mi_option_purge_delay) < 0) return false;  // is purging allowed?
-  _mi_stat_counter_increase(&stats->purge_calls, 1);
-  _mi_stat_increase(&stats->purged, size);
-
-  if (mi_option_is_enabled(mi_option_purge_decommits) &&   // should decommit?
-      !_mi_preloading())                                   // don't decommit during preloading (unsafe)
-  {
-    bool needs_recommit = true;
-    mi_os_decommit_ex(p, size, &needs_recommit, stats);
-    return needs_recommit;   
-  }
-  else {
-    if (allow_reset) {  // this can sometimes be not allowed if the range is not fully committed
-      _mi_os_reset(p, size, stats);
-    }
-    return false;  // needs no recommit
-  }
+  mi_purge_batch_t batch;
+  _mi_os_purge_batch_init(&batch);
+  _mi_os_purge_batch_add(&batch, p, size, allow_reset, stats);
+  return _mi_os_purge_batch_flush(&batch, stats);
 }
 
 // either resets or decommits memory, returns true if the memory needs 
@@ -499,6 +679,113 @@ bool _mi_os_purge(void* p, size_t size, mi_stats_t * stats) {
   return _mi_os_purge_ex(p, size, true, stats);
 }
 
+
+/* -----------------------------------------------------------
+  Purge batches. Purges are collected and issued with as few
+  system calls as possible: adjacent ranges are merged and, where
+  supported, all ranges are purged with a single system call
+  (`process_madvise` on Linux). The `purge_calls` statistic counts
+  the actual calls while `purged` counts the bytes.
+----------------------------------------------------------- */
+
+void _mi_os_purge_batch_init(mi_purge_batch_t* batch) {
+  batch->count = 0;
+  batch->decommit = (mi_option_get(mi_option_purge_delay) >= 0 &&  // is purging allowed at all?
+                     _mi_os_purge_decommits() &&                  // should decommit (always under memory pressure)?
+                     !_mi_preloading());                          // don't decommit during preloading (unsafe)
+}
+
+// Add a range to be purged. Returns `false` if the batch is full (and the range was not added);
+// in that case the batch should be flushed first.
+bool _mi_os_purge_batch_add(mi_purge_batch_t* batch, void* p, size_t size, bool allow_reset, mi_stats_t* stats) {
+  if (mi_option_get(mi_option_purge_delay) < 0) return true;  // is purging allowed?
+  // reset can sometimes be not allowed if the range is not fully committed
+  if (batch->decommit || allow_reset) {
+    size_t csize;
+    uint8_t* start = (uint8_t*)mi_os_page_align_area_conservative(p, size, &csize);
+    if (csize > 0) {
+      mi_os_range_t* last = (batch->count > 0 ? &batch->ranges[batch->count-1] : NULL);
+      if (last != NULL && (uint8_t*)last->start + last->size == start) {
+        last->size += csize;   // extend the previous range
+      }
+      else if (last != NULL && start + csize == (uint8_t*)last->start) {
+        last->start = start;   // prepend to the previous range
+        last->size += csize;
+      }
+      else if (batch->count >= MI_PURGE_BATCH_MAX) {
+        return false;
+      }
+      else {
+        batch->ranges[batch->count].start = start;
+        batch->ranges[batch->count].size  = csize;
+        batch->count++;
+      }
+      if (!batch->decommit) { _mi_stat_increase(&stats->reset, csize); }
+    }
+    if (batch->decommit) { _mi_stat_decrease(&_mi_stats_main.committed, size); }
+  }
+  _mi_stat_increase(&stats->purged, size);
+  mi_event(mi_event_os_purge, p, size);
+  return true;
+}
+
+// Purge all ranges in the batch and empty it. Returns true if the memory 
+// needs to be recommitted if it is to be re-used later on.
+bool _mi_os_purge_batch_flush(mi_purge_batch_t* batch, mi_stats_t* stats) {
+  if (batch->count == 0) return batch->decommit;
+  #if MI_USDT
+  for (size_t i = 0; i < batch->count; i++) {
+    if (batch->decommit) { mi_probe2(os_decommit, batch->ranges[i].start, batch->ranges[i].size); }
+                    else { mi_probe2(os_reset, batch->ranges[i].start, batch->ranges[i].size); }
+  }
+  #endif
+  #if (MI_DEBUG>1) && !MI_SECURE && !MI_TRACK_ENABLED
+  if (!batch->decommit) {
+    for (size_t i = 0; i < batch->count; i++) {
+      memset(batch->ranges[i].start, 0, batch->ranges[i].size); // pretend it is eagerly reset
+    }
+  }
+  #endif
+  bool needs_recommit = batch->decommit;
+  const mi_ticks_t batch_start = mi_latency_start();
+  int err = _mi_prim_purge_batch(batch->ranges, batch->count, batch->decommit, &needs_recommit);
+  mi_latency_end(mi_latency_prim_purge_batch, batch_start);
+  if (err == 0) {
+    _mi_stat_counter_increase(&stats->purge_calls, 1);
+    if (!batch->decommit) { _mi_stat_counter_increase(&stats->reset_calls, 1); }
+  }
+  else {
+    // purge the (merged) ranges one by one
+    needs_recommit = false;
+    for (size_t i = 0; i < batch->count; i++) {
+      void* const  start = batch->ranges[i].start;
+      const size_t csize = batch->ranges[i].size;
+      if (batch->decommit) {
+        bool range_needs_recommit = true;
+        const mi_ticks_t prim_start = mi_latency_start();
+        err = _mi_prim_decommit(start, csize, &range_needs_recommit);
+        mi_latency_end(mi_latency_prim_decommit, prim_start);
+        if (range_needs_recommit) { needs_recommit = true; }
+        if (err != 0) {
+          _mi_warning_message("cannot decommit OS memory (error: %d (0x%x), address: %p, size: 0x%zx bytes)\n", err, err, start, csize);
+        }
+      }
+      else {
+        const mi_ticks_t prim_start = mi_latency_start();
+        err = _mi_prim_reset(start, csize);
+        mi_latency_end(mi_latency_prim_reset, prim_start);
+        _mi_stat_counter_increase(&stats->reset_calls, 1);
+        if (err != 0) {
+          _mi_warning_message("cannot reset OS memory (error: %d (0x%x), address: %p, size: 0x%zx bytes)\n", err, err, start, csize);
+        }
+      }
+      _mi_stat_counter_increase(&stats->purge_calls, 1);
+    }
+  }
+  batch->count = 0;
+  return needs_recommit;
+}
+
 // Protect a region in memory to be not accessible.
 static  bool mi_os_protectx(void* addr, size_t size, bool protect) {
   // page align conservatively within the range
@@ -552,7 +839,8 @@ static uint8_t* mi_os_claim_huge_pages(size_t pages, size_t* total_size) {
       // Initialize the start address after the 32TiB area
       start = ((uintptr_t)32 << 40);  // 32TiB virtual start address
     #if (MI_SECURE>0 || MI_DEBUG==0)      // security: randomize start of huge pages unless in debug mode
-      uintptr_t r = _mi_heap_random_next(mi_prim_get_default_heap());
+      mi_heap_t* heap = mi_prim_get_default_heap();   // not initialized on helper threads (see `_mi_prim_numa_run_parallel`)
+      uintptr_t r = (mi_heap_is_initialized(heap) ? _mi_heap_random_next(heap) : _mi_os_random_weak((uintptr_t)&mi_huge_start));
       start = start + ((uintptr_t)MI_HUGE_OS_PAGE_SIZE * ((r>>17) & 0x0FFF));  // (randomly 12bits)*1GiB == between 0 to 4TiB
     #endif
     }
@@ -572,7 +860,8 @@ static uint8_t* mi_os_claim_huge_pages(size_t pages, size_t* total_size) {
 #endif
 
 // Allocate MI_SEGMENT_SIZE aligned huge pages
-void* _mi_os_alloc_huge_os_pages(size_t pages, int numa_node, mi_msecs_t max_msecs, size_t* pages_reserved, size_t* psize, mi_memid_t* memid) {
+// If `prefault` is set, each page is touched after allocation so it is faulted in by the current thread.
+void* _mi_os_alloc_huge_os_pages(size_t pages, int numa_node, mi_msecs_t max_msecs, bool prefault, size_t* pages_reserved, size_t* psize, mi_memid_t* memid) {
   *memid = _mi_memid_none();
   if (psize != NULL) *psize = 0;
   if (pages_reserved != NULL) *pages_reserved = 0;
@@ -609,6 +898,7 @@ void* _mi_os_alloc_huge_os_pages(size_t pages, int numa_node, mi_msecs_t max_mse
     }
 
     // success, record it
+    if (prefault) { *((volatile uint8_t*)p) = 0; }  // (the page is still zero)
     page++;  // increase before timeout check (see issue #711)
     _mi_stat_increase(&_mi_stats_main.committed, MI_HUGE_OS_PAGE_SIZE);
     _mi_stat_increase(&_mi_stats_main.reserved, MI_HUGE_OS_PAGE_SIZE);
@@ -633,6 +923,7 @@ void* _mi_os_alloc_huge_os_pages(size_t pages, int numa_node, mi_msecs_t max_mse
   if (psize != NULL) { *psize = page * MI_HUGE_OS_PAGE_SIZE; }
   if (page != 0) {
     mi_assert(start != NULL);
+    _mi_os_reserve_note_outside();  // huge pages are never in the up-front reservation
     *memid = _mi_memid_create_os(true /* is committed */, all_zero, true /* is_large */);
     memid->memkind = MI_MEM_OS_HUGE;
     mi_assert(memid->is_pinned);
@@ -679,11 +970,227 @@ size_t _mi_os_numa_node_count_get(void) {
 }
 
 int _mi_os_numa_node_get(mi_os_tld_t* tld) {
-  MI_UNUSED(tld);
   size_t numa_count = _mi_os_numa_node_count();
   if (numa_count<=1) return 0; // optimize on single numa node systems: always node 0
   // never more than the node count and >= 0
   size_t numa_node = _mi_prim_numa_node();
   if (numa_node >= numa_count) { numa_node = numa_node % numa_count; }
+  // detect if the thread migrated to another numa node
+  if (tld != NULL && tld->numa_node != (int)numa_node) {
+    if (tld->numa_node >= 0) {
+      tld->numa_epoch++;
+      _mi_stat_counter_increase(&tld->stats->numa_migrations, 1);
+    }
+    tld->numa_node = (int)numa_node;
+  }
   return (int)numa_node;
 }
+
+
+/* -----------------------------------------------------------
+  Memory pressure. With `mi_option_pressure_monitor` enabled, the
+  OS is monitored for memory pressure (on Linux through a PSI trigger
+  and the cgroup v2 `memory.events`). While under pressure we purge
+  more eagerly: the purge delay becomes 0, purging decommits instead
+  of resets, the arenas are purged right away, and every thread
+  collects its heap at its next allocation slow path.
+----------------------------------------------------------- */
+
+#define MI_PRESSURE_MONITOR  (1)   // signaled by the OS pressure monitor
+#define MI_PRESSURE_LIMIT    (2)   // close to the memory limit
+
+static _Atomic(size_t) mi_os_pressure;        // the sources of memory pressure (0 if none)
+static _Atomic(size_t) mi_os_pressure_events; // incremented on every pressure notification
+
+bool _mi_os_under_pressure(void) {
+  return (mi_atomic_load_relaxed(&mi_os_pressure) != 0);
+}
+
+// Threads compare this with their `tld->pressure_epoch` to collect once per pressure notification
+size_t _mi_os_pressure_epoch(void) {
+  return mi_atomic_load_relaxed(&mi_os_pressure_events);
+}
+
+// The purge delay: <0 = no purging allowed, 0=immediate purging, >0=milli-second delay
+long _mi_os_purge_delay(void) {
+  const long delay = mi_option_get(mi_option_purge_delay);
+  return (delay > 0 && _mi_os_under_pressure() ? 0 : delay);
+}
+
+bool _mi_os_purge_decommits(void) {
+  return (mi_option_is_enabled(mi_option_purge_decommits) || _mi_os_under_pressure());
+}
+
+static void mi_os_pressure_set(size_t source, bool under_pressure) {
+  if (under_pressure) {
+    if (mi_atomic_or_acq_rel(&mi_os_pressure, source) == 0) {
+      _mi_verbose_message("memory pressure: purge eagerly\n");
+    }
+    mi_atomic_increment_acq_rel(&mi_os_pressure_events);
+    _mi_arena_collect(true /* force purge */, &_mi_stats_main);
+  }
+  else if ((mi_atomic_load_relaxed(&mi_os_pressure) & source) != 0) {
+    if (mi_atomic_and_acq_rel(&mi_os_pressure, ~source) == source) {
+      _mi_verbose_message("memory pressure is gone: relax purging\n");
+    }
+  }
+}
+
+static void mi_os_pressure_changed(void* arg, bool under_pressure) {
+  MI_UNUSED(arg);
+  mi_os_pressure_set(MI_PRESSURE_MONITOR, under_pressure);
+}
+
+void _mi_os_pressure_monitor_init(void) {
+  if (!mi_option_is_enabled(mi_option_pressure_monitor)) return;
+  const int err = _mi_prim_pressure_monitor_start(&mi_os_pressure_changed, NULL);
+  if (err != 0) {
+    _mi_warning_message("unable to monitor memory pressure (error %d)\n", err);
+  }
+  else {
+    _mi_verbose_message("monitoring memory pressure\n");
+  }
+}
+
+
+/* -----------------------------------------------------------
+  Memory limits. With `mi_option_memory_limit` (in KiB) or
+  `mi_option_memory_limit_cgroup` (using the cgroup v2 `memory.high`
+  and `memory.max`) we keep the memory usage of the process within a
+  soft and a hard limit. The usage is read from the OS at most every
+  few milli-seconds (as our `committed` statistic does not reflect the
+  resident memory with overcommit), and in between we add the sizes of
+  newly committed memory to it; only when that estimate crosses one of the limits
+  we read it again right away. Before growing beyond the soft limit we first purge
+  synchronously (and purge eagerly like under memory pressure); beyond
+  the hard limit the commit fails and so allocations return NULL
+  with `ENOMEM`. Registered watermark callbacks are called when the usage
+  rises above their level.
+----------------------------------------------------------- */
+
+#define MI_LIMIT_SOFT_PERCENT   (90)    // the soft limit as a percentage of the hard limit (if not given)
+#define MI_LIMIT_REFRESH_MSECS  (10)    // read the usage from the OS at most this often (unless a limit is crossed)
+#define MI_LIMIT_PURGE_MSECS    (100)   // and purge at most this often when beyond the soft limit
+#define MI_WATERMARK_MAX        (8)
+
+typedef struct mi_watermark_s {
+  _Atomic(mi_watermark_fun*) fun;   // NULL while being registered
+  void*                      arg;
+  size_t                     level;  // percentage of the limit
+  _Atomic(size_t)            above;  // 1 while the usage is at or above the level
+} mi_watermark_t;
+
+static size_t              mi_os_limit_soft;    // = 0, no limits
+static size_t              mi_os_limit_hard;    // = 0
+static bool                mi_os_limit_cgroup;  // limit the usage of the cgroup instead of the process
+static _Atomic(size_t)     mi_os_limit_usage;   // the usage as last read from the OS plus our commits since
+static _Atomic(mi_msecs_t) mi_os_limit_read;    // time of the last read
+static _Atomic(mi_msecs_t) mi_os_limit_purged;  // time of the last synchronous purge
+
+static mi_watermark_t      mi_watermarks[MI_WATERMARK_MAX];
+static _Atomic(size_t)     mi_watermark_count;  // can exceed `MI_WATERMARK_MAX` on failed registrations
+
+// the limit the watermark levels are relative to
+static size_t mi_os_limit(void) {
+  return (mi_os_limit_hard != 0 ? mi_os_limit_hard : mi_os_limit_soft);
+}
+
+// read the usage from the OS and add the `size` that is about to be committed
+static size_t mi_os_limit_read_usage(mi_msecs_t now, size_t size) {
+  size_t usage;
+  if (!_mi_prim_memory_usage(mi_os_limit_cgroup, &usage)) {
+    // fall back to our own (less precise) statistics
+    mi_stats_t stats;
+    _mi_stats_aggregate(&stats);
+    const int64_t committed = stats.committed.current;
+    usage = (committed > 0 ? (size_t)committed : 0);
+  }
+  usage += size;
+  mi_atomic_store_release(&mi_os_limit_usage, usage);
+  mi_atomic_storei64_release(&mi_os_limit_read, now);
+  return usage;
+}
+
+static void mi_os_watermarks_check(size_t usage) {
+  const size_t limit = mi_os_limit();
+  size_t count = mi_atomic_load_acquire(&mi_watermark_count);
+  if (count > MI_WATERMARK_MAX) { count = MI_WATERMARK_MAX; }
+  for (size_t i = 0; i < count; i++) {
+    mi_watermark_t* wm = &mi_watermarks[i];
+    mi_watermark_fun* fun = mi_atomic_load_ptr_acquire(mi_watermark_fun, &wm->fun);
+    if (fun == NULL) continue;
+    const size_t above = (usage >= (limit / 100) * wm->level ? 1 : 0);
+    size_t expected = 1 - above;
+    if (mi_atomic_cas_strong_acq_rel(&wm->above, &expected, above) && above != 0) {
+      (*fun)(wm->level, usage, limit, wm->arg);
+    }
+  }
+}
+
+// Called before committing `size` bytes of OS memory; returns `false` if that exceeds the hard limit.
+static bool mi_os_limit_commit(size_t size) {
+  if mi_likely(mi_os_limit_soft == 0) return true;  // no limits
+  const size_t prev = mi_atomic_add_acq_rel(&mi_os_limit_usage, size);
+  size_t usage = prev + size;
+  const mi_msecs_t now = _mi_clock_now();
+  // (the estimate only grows between reads, so crossing a limit causes just one extra read)
+  const bool crossed = ((prev < mi_os_limit_soft && usage >= mi_os_limit_soft) ||
+                        (mi_os_limit_hard != 0 && prev <= mi_os_limit_hard && usage > mi_os_limit_hard));
+  if (crossed || now - mi_atomic_loadi64_relaxed(&mi_os_limit_read) >= MI_LIMIT_REFRESH_MSECS) {
+    usage = mi_os_limit_read_usage(now, size);
+    if (usage >= mi_os_limit_soft) {
+      // close to the limit: purge synchronously before asking the OS for more memory
+      mi_msecs_t purged = mi_atomic_loadi64_relaxed(&mi_os_limit_purged);
+      if (now - purged >= MI_LIMIT_PURGE_MSECS && mi_atomic_casi64_strong_acq_rel(&mi_os_limit_purged, &purged, now)) {
+        mi_os_pressure_set(MI_PRESSURE_LIMIT, true);
+        usage = mi_os_limit_read_usage(now, size);
+      }
+    }
+    else {
+      mi_os_pressure_set(MI_PRESSURE_LIMIT, false);
+    }
+    mi_os_watermarks_check(usage);
+  }
+  if (mi_os_limit_hard != 0 && usage > mi_os_limit_hard) {
+    _mi_warning_message("unable to allocate memory as the memory limit is reached (size: %zu KiB, usage: %zu MiB, limit: %zu MiB)\n",
+                        size / MI_KiB, usage / MI_MiB, mi_os_limit_hard / MI_MiB);
+    mi_os_limit_uncommit(size);  // not committed after all
+    errno = ENOMEM;
+    return false;
+  }
+  return true;
+}
+
+// Undo the charge of `mi_os_limit_commit` if the memory could not be committed after all.
+static void mi_os_limit_uncommit(size_t size) {
+  if (mi_os_limit_soft == 0) return;
+  size_t usage = mi_atomic_load_relaxed(&mi_os_limit_usage);
+  while (!mi_atomic_cas_weak_acq_rel(&mi_os_limit_usage, &usage, (usage > size ? usage - size : 0))) { /* nothing */ };
+}
+
+void _mi_os_limit_init(void) {
+  size_t soft = 0;
+  size_t hard = mi_option_get_size(mi_option_memory_limit);
+  if (hard == 0 && mi_option_is_enabled(mi_option_memory_limit_cgroup)) {
+    mi_os_limit_cgroup = _mi_prim_memory_limits(&soft, &hard);
+  }
+  if (hard == 0 && soft == 0) return;
+  if (soft == 0 || (hard != 0 && soft > hard)) {
+    soft = (hard / 100) * MI_LIMIT_SOFT_PERCENT;
+  }
+  mi_os_limit_hard = hard;
+  mi_os_limit_soft = soft;
+  mi_os_limit_read_usage(_mi_clock_now(), 0);
+  _mi_verbose_message("memory limits: soft %zu MiB, hard %zu MiB%s\n", soft / MI_MiB, hard / MI_MiB, (mi_os_limit_cgroup ? " (cgroup)" : ""));
+}
+
+bool mi_register_watermark(size_t level, mi_watermark_fun* fun, void* arg) mi_attr_noexcept {
+  if (fun == NULL || level == 0 || level > 100) return false;
+  const size_t i = mi_atomic_increment_acq_rel(&mi_watermark_count);
+  if (i >= MI_WATERMARK_MAX) return false;
+  mi_watermark_t* wm = &mi_watermarks[i];
+  wm->arg = arg;
+  wm->level = level;
+  mi_atomic_store_ptr_release(mi_watermark_fun, &wm->fun, fun);
+  return true;
+}
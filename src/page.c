@@ -289,7 +289,9 @@ static mi_page_t* mi_page_fresh_alloc(mi_heap_t* heap, mi_page_queue_t* pq, size
   const size_t full_block_size = ((pq == NULL || mi_page_queue_is_huge(pq)) ? mi_page_block_size(page) : block_size); // see also: mi_segment_huge_page_alloc
   mi_assert_internal(full_block_size >= block_size);
   mi_page_init(heap, page, full_block_size, heap->tld);
-  mi_heap_stat_increase(heap, pages, 1);
+  _mi_stat_increase(&heap->tld->stats.pages, 1);
+  mi_probe3(page_alloc, heap, page, full_block_size);
+  mi_event(mi_event_page_alloc, _mi_page_start(_mi_page_segment(page), page, NULL), (size_t)page->slice_count * MI_SEGMENT_SLICE_SIZE);
   if (pq != NULL) { mi_page_queue_push(heap, pq, page); }
   mi_assert_expensive(_mi_page_is_valid(page));
   return page;
@@ -412,10 +414,12 @@ void _mi_page_free(mi_page_t* page, mi_page_queue_t* pq, bool force) {
   mi_assert_internal(mi_page_all_free(page));
   mi_assert_internal(mi_page_thread_free_flag(page)!=MI_DELAYED_FREEING);
 
-  // no more aligned blocks in here
+  // no more aligned or sampled blocks in here
   mi_page_set_has_aligned(page, false);
+  mi_page_set_has_sampled(page, false);
 
   mi_heap_t* heap = mi_page_heap(page);
+  mi_probe3(page_free, heap, page, mi_page_block_size(page));
 
   // remove from the page list
   // (no need to do _mi_heap_delayed_free first as all blocks are already free)
@@ -443,6 +447,7 @@ void _mi_page_retire(mi_page_t* page) mi_attr_noexcept {
   mi_assert_internal(mi_page_all_free(page));
   
   mi_page_set_has_aligned(page, false);
+  mi_page_set_has_sampled(page, false);
 
   // don't retire too often..
   // (or we end up retiring and re-allocating most of the time)
@@ -453,6 +458,7 @@ void _mi_page_retire(mi_page_t* page) mi_attr_noexcept {
   mi_page_queue_t* pq = mi_page_queue_of(page);
   if mi_likely(page->xblock_size <= MI_MAX_RETIRE_SIZE && !mi_page_queue_is_special(pq)) {  // not too large && not full or huge queue?
     if (pq->last==page && pq->first==page) { // the only page in the queue?
+      mi_probe3(page_retire, mi_page_heap(page), page, mi_page_block_size(page));
       mi_stat_counter_increase(_mi_stats_main.page_no_retire,1);
       page->retire_expire = 1 + (page->xblock_size <= MI_SMALL_OBJ_SIZE_MAX ? MI_RETIRE_CYCLES : MI_RETIRE_CYCLES/4);      
       mi_heap_t* heap = mi_page_heap(page);
@@ -840,6 +846,8 @@ static mi_page_t* mi_large_huge_page_alloc(mi_heap_t* heap, size_t size, size_t
     mi_assert_internal(mi_page_immediate_available(page));
     
     if (is_huge) {
+      mi_probe3(huge_alloc, heap, page, block_size);
+      mi_event(mi_event_huge_alloc, _mi_page_start(_mi_page_segment(page), page, NULL), mi_page_block_size(page));
       mi_assert_internal(_mi_page_segment(page)->kind == MI_SEGMENT_HUGE);
       mi_assert_internal(_mi_page_segment(page)->used==1);
       #if MI_HUGE_PAGE_ABANDON
@@ -888,11 +896,31 @@ static mi_page_t* mi_find_page(mi_heap_t* heap, size_t size, size_t huge_alignme
   }
 }
 
+static void* mi_malloc_generic(mi_heap_t* heap, size_t size, bool zero, size_t huge_alignment) mi_attr_noexcept;
+
+// Allocate from the heap of the current processor (see `mi_option_percpu_heaps`).
+// A thread backing heap that redirects never owns pages itself, so its fast path always fails
+// and all its allocations end up here; we then use the fast path of the per-CPU heap.
+static mi_decl_noinline void* mi_malloc_generic_cpu(size_t size, bool zero, size_t huge_alignment) mi_attr_noexcept
+{
+  mi_heap_t* const heap = _mi_heap_cpu_acquire();
+  if (heap == NULL) return NULL;
+  void* p;
+  if (huge_alignment == 0 && size <= MI_SMALL_SIZE_MAX + MI_PADDING_SIZE) {
+    p = _mi_page_malloc(heap, _mi_heap_get_free_small_page(heap, size), size, zero);
+  }
+  else {
+    p = mi_malloc_generic(heap, size, zero, huge_alignment);
+  }
+  _mi_heap_cpu_release(heap);
+  return p;
+}
+
 // Generic allocation routine if the fast path (`alloc.c:mi_page_malloc`) does not succeed.
 // Note: in debug mode the size includes MI_PADDING_SIZE and might have overflowed.
 // The `huge_alignment` is normally 0 but is set to a multiple of MI_SEGMENT_SIZE for
 // very large requested alignments in which case we use a huge segment.
-void* _mi_malloc_generic(mi_heap_t* heap, size_t size, bool zero, size_t huge_alignment) mi_attr_noexcept
+static void* mi_malloc_generic(mi_heap_t* heap, size_t size, bool zero, size_t huge_alignment) mi_attr_noexcept
 {
   mi_assert_internal(heap != NULL);
 
@@ -903,9 +931,19 @@ void* _mi_malloc_generic(mi_heap_t* heap, size_t size, bool zero, size_t huge_al
   }
   mi_assert_internal(mi_heap_is_initialized(heap));
 
+  // allocate from the per-CPU heap instead? (the backing heap then has no pages so we always get here)
+  if mi_unlikely(heap->cpu_heaps) { return mi_malloc_generic_cpu(size, zero, huge_alignment); }
+
   // call potential deferred free routines
   _mi_deferred_free(heap, false);
 
+  // collect once after each memory pressure notification
+  const size_t pressure_epoch = _mi_os_pressure_epoch();
+  if mi_unlikely(heap->tld->pressure_epoch != pressure_epoch) {
+    heap->tld->pressure_epoch = pressure_epoch;
+    mi_heap_collect(heap, false);
+  }
+
   // free delayed frees from other threads (but skip contended ones)
   _mi_heap_delayed_free_partial(heap);
 
@@ -937,3 +975,11 @@ void* _mi_malloc_generic(mi_heap_t* heap, size_t size, bool zero, size_t huge_al
     return _mi_page_malloc(heap, page, size, zero);
   }
 }
+
+void* _mi_malloc_generic(mi_heap_t* heap, size_t size, bool zero, size_t huge_alignment) mi_attr_noexcept
+{
+  const mi_ticks_t start = mi_latency_start();
+  void* const p = mi_malloc_generic(heap, size, zero, huge_alignment);
+  mi_latency_end(mi_latency_malloc_generic, start);
+  return p;
+}
@@ -335,6 +335,13 @@ int _mi_prim_alloc(size_t size, size_t try_alignment, bool commit, bool allow_la
 }
 
 
+int _mi_prim_reserve(size_t size, void** addr) {
+  mi_assert_internal(size > 0 && (size % _mi_os_page_size()) == 0);
+  // always use NORESERVE: the range can be much larger than the available memory
+  *addr = unix_mmap_prim(NULL, size, 1, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, unix_mmap_fd());
+  return (*addr != NULL ? 0 : errno);
+}
+
 //---------------------------------------------
 // Commit/Reset
 //---------------------------------------------
@@ -407,6 +414,59 @@ int _mi_prim_reset(void* start, size_t size) {
   return err;
 }
 
+#if defined(__linux__) && defined(MI_HAS_SYSCALL_H) && defined(SYS_process_madvise)
+#include <sys/uio.h>  // struct iovec
+
+#ifndef PIDFD_SELF_THREAD_GROUP
+#define PIDFD_SELF_THREAD_GROUP  (-10001)  // the current process (Linux 6.15+)
+#endif
+
+static _Atomic(size_t) mi_process_madvise_unsupported; // = 0
+
+int _mi_prim_purge_batch(const mi_os_range_t* ranges, size_t count, bool decommit, bool* needs_recommit) {
+  *needs_recommit = decommit;
+  #if MI_DEBUG || MI_SECURE
+  if (decommit) return ENOSYS;  // decommit also protects each range (see `_mi_prim_decommit`)
+  #endif
+  if (count == 0) return 0;
+  if (count > MI_PURGE_BATCH_MAX || mi_atomic_load_relaxed(&mi_process_madvise_unsupported) != 0) return ENOSYS;
+  struct iovec iov[MI_PURGE_BATCH_MAX];
+  size_t total = 0;
+  for (size_t i = 0; i < count; i++) {
+    iov[i].iov_base = ranges[i].start;
+    iov[i].iov_len  = ranges[i].size;
+    total += ranges[i].size;
+  }
+  // use the same advice as `_mi_prim_decommit` and `_mi_prim_reset`
+  #if defined(MADV_FREE)
+  const int advice = (decommit ? MADV_DONTNEED : MADV_FREE);
+  #else
+  const int advice = MADV_DONTNEED;
+  #endif
+  const long res = syscall(SYS_process_madvise, PIDFD_SELF_THREAD_GROUP, iov, count, advice, 0);
+  if (res < 0) {
+    const int err = errno;
+    if (err == EINVAL || err == EBADF || err == ENOSYS || err == EPERM || err == ESRCH) {
+      // the kernel does not support process_madvise on ourselves with this advice; don't try again
+      mi_atomic_store_release(&mi_process_madvise_unsupported, (size_t)1);
+    }
+    return (err == 0 ? ENOSYS : err);
+  }
+  if ((size_t)res != total) return EAGAIN;  // only partially advised
+  *needs_recommit = false;
+  return 0;
+}
+
+#else
+
+int _mi_prim_purge_batch(const mi_os_range_t* ranges, size_t count, bool decommit, bool* needs_recommit) {
+  MI_UNUSED(ranges); MI_UNUSED(count);
+  *needs_recommit = decommit;
+  return ENOSYS;
+}
+
+#endif
+
 int _mi_prim_protect(void* start, size_t size, bool protect) {
   int err = mprotect(start, size, protect ? PROT_NONE : (PROT_READ | PROT_WRITE));
   if (err != 0) { err = errno; }  
@@ -466,6 +526,79 @@ int _mi_prim_alloc_huge_os_pages(void* hint_addr, size_t size, int numa_node, bo
 
 #endif
 
+//---------------------------------------------
+// Shared memory files (for arena snapshots)
+//---------------------------------------------
+
+#if defined(__linux__) && defined(MI_HAS_SYSCALL_H) && defined(SYS_memfd_create)
+
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC  0x0001U
+#endif
+
+int _mi_prim_alloc_shared(void* addr, size_t size, int* fd) {
+  *fd = (int)syscall(SYS_memfd_create, "mimalloc", MFD_CLOEXEC);
+  if (*fd < 0) { *fd = -1; return errno; }
+  int err = 0;
+  if (ftruncate(*fd, (off_t)size) != 0) {
+    err = errno;
+  }
+  else if (mmap(addr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, *fd, 0) == MAP_FAILED) {
+    err = errno;
+  }
+  if (err != 0) {
+    mi_prim_close(*fd);
+    *fd = -1;
+  }
+  return err;
+}
+
+int _mi_prim_snapshot_shared(int fd, void* addr, size_t size, void** snapshot) {
+  // map the reader view first so a failure leaves the owner mapping untouched
+  void* p = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+  if (p == MAP_FAILED) { *snapshot = NULL; return errno; }
+  // and remap the owner copy-on-write; its current contents are all in the file already
+  if (mmap(addr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+    int err = errno;
+    munmap(p, size);
+    *snapshot = NULL;
+    return err;
+  }
+  *snapshot = p;
+  return 0;
+}
+
+int _mi_prim_free_shared(int fd, void* addr, size_t size) {
+  int err = 0;
+  // drop the file mapping: otherwise a later private allocation in this range would still be shared (also with a forked child)
+  if (mmap(addr, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, unix_mmap_fd(), 0) == MAP_FAILED) {
+    err = errno;
+  }
+  if (mi_prim_close(fd) != 0 && err == 0) { err = errno; }
+  return err;
+}
+
+#else
+
+int _mi_prim_alloc_shared(void* addr, size_t size, int* fd) {
+  MI_UNUSED(addr); MI_UNUSED(size);
+  *fd = -1;
+  return ENOSYS;
+}
+
+int _mi_prim_snapshot_shared(int fd, void* addr, size_t size, void** snapshot) {
+  MI_UNUSED(fd); MI_UNUSED(addr); MI_UNUSED(size);
+  *snapshot = NULL;
+  return ENOSYS;
+}
+
+int _mi_prim_free_shared(int fd, void* addr, size_t size) {
+  MI_UNUSED(fd); MI_UNUSED(addr); MI_UNUSED(size);
+  return 0;
+}
+
+#endif
+
 //---------------------------------------------
 // NUMA nodes
 //---------------------------------------------
@@ -474,7 +607,55 @@ int _mi_prim_alloc_huge_os_pages(void* hint_addr, size_t size, int numa_node, bo
 
 #include <stdio.h>    // snprintf
 
+// Use the `node_id` field of the restartable sequence area that glibc (2.35+) registers for
+// each thread; the kernel keeps it up-to-date on migration so we can read it without a syscall.
+// (`node_id` is available since Linux 6.3 as indicated by the rseq feature size)
+#if defined(__GLIBC__) && ((__GLIBC__ > 2) || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 35)) && defined(__has_include) && defined(__has_builtin)
+#if __has_include(<sys/rseq.h>) && __has_builtin(__builtin_thread_pointer) && (defined(__x86_64__) || defined(__aarch64__))
+#define MI_HAS_RSEQ_NODE_ID  1
+#endif
+#endif
+
+#if defined(MI_HAS_RSEQ_NODE_ID)
+#include <sys/rseq.h>
+#include <sys/auxv.h>
+#ifndef AT_RSEQ_FEATURE_SIZE
+#define AT_RSEQ_FEATURE_SIZE  27
+#endif
+#define MI_RSEQ_CPU_ID_OFS    4    // offset of `cpu_id` in the kernel `struct rseq`
+#define MI_RSEQ_NODE_ID_OFS   20   // offset of `node_id` in the kernel `struct rseq`
+
+static _Atomic(uintptr_t) mi_rseq_node_id_state;  // = 0: not yet checked, 1: unavailable, 2: available
+
+// Return the rseq area of the current thread, or NULL if it is not registered
+static inline const uint8_t* mi_prim_rseq_area(void) {
+  if (__rseq_size == 0) return NULL;
+  const uint8_t* rs = (const uint8_t*)__builtin_thread_pointer() + __rseq_offset;
+  const int32_t cpu_id = *((const volatile int32_t*)(rs + MI_RSEQ_CPU_ID_OFS));
+  if (cpu_id < 0) return NULL;  // not registered for this thread
+  return rs;
+}
+
+static bool mi_prim_rseq_numa_node(size_t* node) {
+  uintptr_t state = mi_atomic_load_relaxed(&mi_rseq_node_id_state);
+  if mi_unlikely(state == 0) {
+    // any thread may check; they all find the same result
+    state = (__rseq_size > 0 && getauxval(AT_RSEQ_FEATURE_SIZE) >= MI_RSEQ_NODE_ID_OFS + 4 ? 2 : 1);
+    mi_atomic_store_relaxed(&mi_rseq_node_id_state, state);
+  }
+  if (state != 2) return false;
+  const uint8_t* rs = mi_prim_rseq_area();
+  if (rs == NULL) return false;
+  *node = *((const volatile uint32_t*)(rs + MI_RSEQ_NODE_ID_OFS));
+  return true;
+}
+#endif
+
 size_t _mi_prim_numa_node(void) {
+  #if defined(MI_HAS_RSEQ_NODE_ID)
+    size_t rnode;
+    if (mi_prim_rseq_numa_node(&rnode)) return rnode;
+  #endif
   #if defined(MI_HAS_SYSCALL_H) && defined(SYS_getcpu)
     unsigned long node = 0;
     unsigned long ncpu = 0;
@@ -544,6 +725,393 @@ size_t _mi_prim_numa_node_count(void) {
 
 #endif
 
+// Return the current cpu (only if it can be read cheaply from the rseq area)
+bool _mi_prim_cpu_id(size_t* cpu) {
+  #if defined(MI_HAS_RSEQ_NODE_ID)
+    const uint8_t* rs = mi_prim_rseq_area();
+    if (rs != NULL) {
+      *cpu = *((const volatile uint32_t*)(rs + MI_RSEQ_CPU_ID_OFS));
+      return true;
+    }
+  #endif
+  *cpu = 0;
+  return false;
+}
+
+#if defined(__linux__) && defined(MI_HAS_SYSCALL_H) && defined(SYS_sched_setaffinity)
+
+// bind the current thread to the processors of a NUMA node (as listed in `/sys/devices/system/node/node<N>/cpulist`)
+static void mi_prim_thread_bind_numa_node(size_t node) {
+  char buf[256];
+  snprintf(buf, sizeof(buf), "/sys/devices/system/node/node%zu/cpulist", node);
+  int fd = mi_prim_open(buf, O_RDONLY);
+  if (fd < 0) return;
+  ssize_t nread = mi_prim_read(fd, buf, sizeof(buf) - 1);
+  mi_prim_close(fd);
+  if (nread <= 0) return;
+  buf[nread] = 0;
+  // parse a list of ranges, like "0-3,8-11"
+  unsigned long mask[1024 / (8*sizeof(unsigned long))];
+  const size_t mask_bits = 8*sizeof(mask);
+  _mi_memzero(mask, sizeof(mask));
+  bool any = false;
+  const char* s = buf;
+  while (*s >= '0' && *s <= '9') {
+    size_t lo = 0;
+    while (*s >= '0' && *s <= '9') { lo = 10*lo + (size_t)(*s - '0'); s++; }
+    size_t hi = lo;
+    if (*s == '-') {
+      s++; hi = 0;
+      while (*s >= '0' && *s <= '9') { hi = 10*hi + (size_t)(*s - '0'); s++; }
+    }
+    for (size_t cpu = lo; cpu <= hi && cpu < mask_bits; cpu++) {
+      mask[cpu / (8*sizeof(unsigned long))] |= (1UL << (cpu % (8*sizeof(unsigned long))));
+      any = true;
+    }
+    if (*s == ',') s++;
+  }
+  if (any && syscall(SYS_sched_setaffinity, 0, sizeof(mask), mask) != 0) {
+    _mi_verbose_message("unable to bind helper thread to numa node %zu (error: %d)\n", node, errno);
+  }
+}
+
+#else
+
+static void mi_prim_thread_bind_numa_node(size_t node) {
+  MI_UNUSED(node);
+}
+
+#endif
+
+#if defined(MI_USE_PTHREADS)
+
+#define MI_NUMA_THREADS_MAX  (64)   // at most this many helper threads at a time
+
+typedef struct mi_prim_numa_thread_s {
+  mi_prim_numa_fun_t* fun;
+  void*               arg;
+  size_t              node;
+} mi_prim_numa_thread_t;
+
+static void* mi_prim_numa_thread_start(void* p) {
+  const mi_prim_numa_thread_t* t = (const mi_prim_numa_thread_t*)p;
+  mi_prim_thread_bind_numa_node(t->node);
+  (*t->fun)(t->arg, t->node);
+  return NULL;
+}
+
+void _mi_prim_numa_run_parallel(size_t node_count, mi_prim_numa_fun_t* fun, void* arg) {
+  pthread_t             threads[MI_NUMA_THREADS_MAX];
+  mi_prim_numa_thread_t targs[MI_NUMA_THREADS_MAX];
+  bool                  started[MI_NUMA_THREADS_MAX];
+  for (size_t base = 0; base < node_count; base += MI_NUMA_THREADS_MAX) {
+    const size_t count = (node_count - base < MI_NUMA_THREADS_MAX ? node_count - base : MI_NUMA_THREADS_MAX);
+    for (size_t i = 0; i < count; i++) {
+      targs[i].fun = fun;
+      targs[i].arg = arg;
+      targs[i].node = base + i;
+      started[i] = (pthread_create(&threads[i], NULL, &mi_prim_numa_thread_start, &targs[i]) == 0);
+    }
+    for (size_t i = 0; i < count; i++) {
+      if (started[i]) {
+        pthread_join(threads[i], NULL);
+      }
+      else {
+        (*fun)(arg, base + i);  // could not create a helper thread, run it here
+      }
+    }
+  }
+}
+
+#else
+
+void _mi_prim_numa_run_parallel(size_t node_count, mi_prim_numa_fun_t* fun, void* arg) {
+  for (size_t node = 0; node < node_count; node++) {
+    (*fun)(arg, node);
+  }
+}
+
+#endif
+
+//----------------------------------------------------------------
+// Memory limits
+//----------------------------------------------------------------
+
+#if defined(__linux__)
+
+// Read a (small) file at offset 0 into a zero terminated buffer
+static ssize_t mi_prim_pread_str(int fd, char* buf, size_t bufsize) {
+  ssize_t n = pread(fd, buf, bufsize - 1, 0);
+  buf[n > 0 ? n : 0] = 0;
+  return n;
+}
+
+static ssize_t mi_prim_read_str(const char* fpath, char* buf, size_t bufsize) {
+  int fd = mi_prim_open(fpath, O_RDONLY);
+  if (fd < 0) return -1;
+  ssize_t n = mi_prim_pread_str(fd, buf, bufsize);
+  mi_prim_close(fd);
+  return n;
+}
+
+// Parse a decimal number; returns `false` if there is none (like "max")
+static bool mi_prim_parse_size(const char* s, size_t* n) {
+  if (*s < '0' || *s > '9') return false;
+  size_t x = 0;
+  for (; *s >= '0' && *s <= '9'; s++) { x = (x * 10) + (size_t)(*s - '0'); }
+  *n = x;
+  return true;
+}
+
+static const char* mi_prim_next_line(const char* line) {
+  const char* nl = strchr(line, '\n');
+  return (nl == NULL ? NULL : nl + 1);
+}
+
+// Find the value of `key` in a flat keyed file (like `memory.events`)
+static size_t mi_prim_parse_keyed(const char* buf, const char* key) {
+  const size_t klen = strlen(key);
+  for (const char* line = buf; line != NULL && *line != 0; line = mi_prim_next_line(line)) {
+    if (strncmp(line, key, klen) == 0 && line[klen] == ' ') {
+      size_t n = 0;
+      mi_prim_parse_size(line + klen + 1, &n);
+      return n;
+    }
+  }
+  return 0;
+}
+
+// Find the cgroup v2 directory of this process (from the `0::<path>` entry in `/proc/self/cgroup`)
+static bool mi_prim_cgroup_dir(char* dir, size_t dirsize) {
+  char buf[512];
+  if (mi_prim_read_str("/proc/self/cgroup", buf, sizeof(buf)) <= 0) return false;
+  for (const char* line = buf; line != NULL && *line != 0; line = mi_prim_next_line(line)) {
+    if (strncmp(line, "0::", 3) == 0) {
+      const char* path = line + 3;
+      const char* end = strchr(path, '\n');
+      const int len = (int)(end != NULL ? end - path : (ptrdiff_t)strlen(path));
+      const int n = snprintf(dir, dirsize, "/sys/fs/cgroup%.*s", len, path);
+      return (n > 0 && (size_t)n < dirsize);
+    }
+  }
+  return false;
+}
+
+static bool mi_prim_cgroup_read_size(const char* dir, const char* fname, size_t* n) {
+  char fpath[320];
+  char buf[64];
+  snprintf(fpath, sizeof(fpath), "%s/%s", dir, fname);
+  if (mi_prim_read_str(fpath, buf, sizeof(buf)) <= 0) return false;
+  return mi_prim_parse_size(buf, n);
+}
+
+static char mi_prim_cgroup[256];  // cgroup v2 directory of the process (or empty)
+
+// Use the cgroup v2 `memory.high` and `memory.max` (which are "max" if unlimited)
+bool _mi_prim_memory_limits(size_t* soft_limit, size_t* hard_limit) {
+  *soft_limit = 0;
+  *hard_limit = 0;
+  if (!mi_prim_cgroup_dir(mi_prim_cgroup, sizeof(mi_prim_cgroup))) {
+    mi_prim_cgroup[0] = 0;
+    return false;
+  }
+  const bool has_high = mi_prim_cgroup_read_size(mi_prim_cgroup, "memory.high", soft_limit);
+  const bool has_max  = mi_prim_cgroup_read_size(mi_prim_cgroup, "memory.max", hard_limit);
+  return (has_high || has_max);
+}
+
+bool _mi_prim_memory_usage(bool cgroup, size_t* usage) {
+  if (cgroup && mi_prim_cgroup[0] != 0) {
+    // only count the anonymous memory of the cgroup as the page cache can be reclaimed
+    char fpath[320];
+    char buf[4096];
+    snprintf(fpath, sizeof(fpath), "%s/memory.stat", mi_prim_cgroup);
+    if (mi_prim_read_str(fpath, buf, sizeof(buf)) > 0) {
+      *usage = mi_prim_parse_keyed(buf, "anon");
+      return true;
+    }
+    return mi_prim_cgroup_read_size(mi_prim_cgroup, "memory.current", usage);
+  }
+  // the resident set size is the second field of `/proc/self/statm` (in pages)
+  char buf[128];
+  if (mi_prim_read_str("/proc/self/statm", buf, sizeof(buf)) <= 0) return false;
+  const char* s = strchr(buf, ' ');
+  size_t pages;
+  if (s == NULL || !mi_prim_parse_size(s + 1, &pages)) return false;
+  *usage = pages * _mi_os_page_size();
+  return true;
+}
+
+#else
+
+bool _mi_prim_memory_limits(size_t* soft_limit, size_t* hard_limit) {
+  *soft_limit = 0;
+  *hard_limit = 0;
+  return false;
+}
+
+bool _mi_prim_memory_usage(bool cgroup, size_t* usage) {
+  MI_UNUSED(cgroup);
+  *usage = 0;
+  return false;
+}
+
+#endif
+
+
+//----------------------------------------------------------------
+// Memory pressure
+//----------------------------------------------------------------
+
+#if defined(__linux__) && defined(MI_USE_PTHREADS)
+
+#include <poll.h>
+
+#define MI_PRESSURE_PSI_TRIGGER   "some 150000 2000000"  // 150ms of stalls within a 2s window (unprivileged triggers need a multiple of 2s)
+#define MI_PRESSURE_RELAX_MSECS   (5000)                 // pressure is gone if nothing is signaled for this long
+#define MI_PRESSURE_HIGH_PERCENT  (90)                   // under pressure above this percentage of the cgroup `memory.high` (or `memory.max`)
+
+typedef struct mi_prim_pressure_monitor_s {
+  mi_prim_pressure_fun_t* fun;
+  void*                   arg;
+  int                     psi_fd;       // `/proc/pressure/memory` with a trigger (or -1)
+  int                     events_fd;    // cgroup `memory.events` (or -1)
+  char                    cgroup[256];  // cgroup directory (or empty)
+} mi_prim_pressure_monitor_t;
+
+static mi_prim_pressure_monitor_t mi_pressure_monitor;
+
+// Is the cgroup memory usage close to its `memory.high` (or `memory.max`) limit?
+static bool mi_prim_cgroup_near_limit(const char* dir) {
+  if (dir[0] == 0) return false;
+  size_t limit;
+  if (!mi_prim_cgroup_read_size(dir, "memory.high", &limit) &&
+      !mi_prim_cgroup_read_size(dir, "memory.max", &limit)) return false;  // unlimited
+  size_t current;
+  if (!mi_prim_cgroup_read_size(dir, "memory.current", &current)) return false;
+  return (current >= (limit / 100) * MI_PRESSURE_HIGH_PERCENT);
+}
+
+// The number of times the cgroup was throttled at `memory.high` or hit `memory.max`
+static size_t mi_prim_cgroup_limit_events(int events_fd) {
+  char buf[256];
+  if (mi_prim_pread_str(events_fd, buf, sizeof(buf)) <= 0) return 0;
+  return (mi_prim_parse_keyed(buf, "high") + mi_prim_parse_keyed(buf, "max"));
+}
+
+static void* mi_prim_pressure_thread(void* p) {
+  mi_prim_pressure_monitor_t* m = (mi_prim_pressure_monitor_t*)p;
+  size_t limit_events = (m->events_fd >= 0 ? mi_prim_cgroup_limit_events(m->events_fd) : 0);
+  bool pressure = false;
+  mi_msecs_t last_signaled = 0;
+  mi_msecs_t last_notified = 0;
+  while (m->psi_fd >= 0 || m->events_fd >= 0) {
+    struct pollfd fds[2];
+    nfds_t nfds = 0;
+    if (m->psi_fd >= 0)    { fds[nfds].fd = m->psi_fd;    fds[nfds].events = POLLPRI; fds[nfds].revents = 0; nfds++; }
+    if (m->events_fd >= 0) { fds[nfds].fd = m->events_fd; fds[nfds].events = POLLPRI; fds[nfds].revents = 0; nfds++; }
+    const int res = poll(fds, nfds, (pressure ? 1000 : -1));
+    if (res < 0) {
+      if (errno == EINTR || errno == EAGAIN) continue;
+      break;
+    }
+    bool signaled = false;
+    for (nfds_t i = 0; i < nfds; i++) {
+      if (fds[i].revents == 0) continue;
+      if (fds[i].fd == m->psi_fd) {
+        if (fds[i].revents & POLLERR) { mi_prim_close(m->psi_fd); m->psi_fd = -1; }  // the monitor was destroyed
+                                 else { signaled = true; }
+      }
+      else {
+        // `memory.events` was modified
+        const size_t events = mi_prim_cgroup_limit_events(m->events_fd);
+        if (events > limit_events) { signaled = true; }
+        limit_events = events;
+      }
+    }
+    const mi_msecs_t now = _mi_prim_clock_now();
+    if (!signaled && pressure && mi_prim_cgroup_near_limit(m->cgroup)) { signaled = true; }
+    if (signaled) {
+      last_signaled = now;
+      if (!pressure || now - last_notified >= 1000) {  // notify at most once per second
+        pressure = true;
+        last_notified = now;
+        (*m->fun)(m->arg, true);
+      }
+    }
+    else if (pressure && now - last_signaled >= MI_PRESSURE_RELAX_MSECS) {
+      pressure = false;
+      (*m->fun)(m->arg, false);
+    }
+  }
+  return NULL;
+}
+
+// start monitoring on a detached helper thread
+static int mi_prim_pressure_thread_start(mi_prim_pressure_monitor_t* m) {
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  pthread_t thread;
+  const int err = pthread_create(&thread, &attr, &mi_prim_pressure_thread, m);
+  pthread_attr_destroy(&attr);
+  return err;
+}
+
+// the helper thread does not survive a `fork`: restart it in the child (which inherits the monitored files)
+static void mi_prim_pressure_fork_child(void) {
+  mi_prim_pressure_monitor_t* m = &mi_pressure_monitor;
+  if (m->psi_fd < 0 && m->events_fd < 0) return;
+  (*m->fun)(m->arg, false);  // the new thread starts without pressure
+  const int err = mi_prim_pressure_thread_start(m);
+  if (err != 0) {
+    _mi_warning_message("unable to monitor memory pressure in the forked child (error %d)\n", err);
+  }
+}
+
+int _mi_prim_pressure_monitor_start(mi_prim_pressure_fun_t* fun, void* arg) {
+  mi_prim_pressure_monitor_t* m = &mi_pressure_monitor;
+  m->fun = fun;
+  m->arg = arg;
+  // PSI trigger (Linux 5.2+)
+  m->psi_fd = mi_prim_open("/proc/pressure/memory", O_RDWR | O_NONBLOCK);
+  if (m->psi_fd >= 0) {
+    if (write(m->psi_fd, MI_PRESSURE_PSI_TRIGGER, strlen(MI_PRESSURE_PSI_TRIGGER) + 1) < 0) {
+      _mi_verbose_message("unable to set a memory pressure trigger (error %d)\n", errno);
+      mi_prim_close(m->psi_fd);
+      m->psi_fd = -1;
+    }
+  }
+  // cgroup v2 memory events
+  m->events_fd = -1;
+  m->cgroup[0] = 0;
+  if (mi_prim_cgroup_dir(m->cgroup, sizeof(m->cgroup))) {
+    char fpath[320];
+    snprintf(fpath, sizeof(fpath), "%s/memory.events", m->cgroup);
+    m->events_fd = mi_prim_open(fpath, O_RDONLY);
+  }
+  if (m->psi_fd < 0 && m->events_fd < 0) return ENOSYS;
+  const int err = mi_prim_pressure_thread_start(m);
+  if (err != 0) {
+    if (m->psi_fd >= 0) mi_prim_close(m->psi_fd);
+    if (m->events_fd >= 0) mi_prim_close(m->events_fd);
+    m->psi_fd = m->events_fd = -1;
+    return err;
+  }
+  _mi_prim_atfork(NULL, NULL, &mi_prim_pressure_fork_child);
+  return 0;
+}
+
+#else
+
+int _mi_prim_pressure_monitor_start(mi_prim_pressure_fun_t* fun, void* arg) {
+  MI_UNUSED(fun); MI_UNUSED(arg);
+  return ENOSYS;
+}
+
+#endif
+
+
 // ----------------------------------------------------------------
 // Clock
 // ----------------------------------------------------------------
@@ -666,6 +1234,112 @@ void _mi_prim_out_stderr( const char* msg ) {
   fputs(msg,stderr);
 }
 
+int _mi_prim_write(int fd, const void* buf, size_t size) {
+  const uint8_t* p = (const uint8_t*)buf;
+  while (size > 0) {
+    const ssize_t n = write(fd, p, size);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return errno;
+    }
+    p += n;
+    size -= (size_t)n;
+  }
+  return 0;
+}
+
+#include <fcntl.h>  // open
+
+int _mi_prim_file_create(const char* fpath) {
+  int flags = O_WRONLY | O_CREAT | O_TRUNC;
+  #if defined(O_CLOEXEC)
+  flags |= O_CLOEXEC;
+  #endif
+  return open(fpath, flags, 0644);
+}
+
+void _mi_prim_file_close(int fd) {
+  close(fd);
+}
+
+size_t _mi_prim_getpid(void) {
+  return (size_t)getpid();
+}
+
+#include <pthread.h>  // pthread_atfork
+
+bool _mi_prim_atfork(void (*prepare)(void), void (*parent)(void), void (*child)(void)) {
+  return (pthread_atfork(prepare, parent, child) == 0);
+}
+
+#if defined(__linux__)
+int _mi_prim_write_mappings(int fd) {
+  const int maps = mi_prim_open("/proc/self/maps", O_RDONLY);
+  if (maps < 0) return errno;
+  char buf[1024];
+  int err = 0;
+  ssize_t n;
+  while (err == 0 && (n = mi_prim_read(maps, buf, sizeof(buf))) != 0) {
+    if (n < 0) {
+      if (errno != EINTR) { err = errno; }
+    }
+    else {
+      err = _mi_prim_write(fd, buf, (size_t)n);
+    }
+  }
+  mi_prim_close(maps);
+  return err;
+}
+#else
+int _mi_prim_write_mappings(int fd) {
+  MI_UNUSED(fd);
+  return ENOSYS;
+}
+#endif
+
+
+//----------------------------------------------------------------
+// Backtrace
+//----------------------------------------------------------------
+
+#if defined(__has_include)
+#if __has_include(<unwind.h>)
+#define MI_HAS_UNWIND_H
+#endif
+#endif
+
+#if defined(MI_HAS_UNWIND_H)
+#include <unwind.h>
+
+typedef struct mi_backtrace_state_s {
+  void**  frames;
+  size_t  max_frames;
+  size_t  count;
+  size_t  skip;
+} mi_backtrace_state_t;
+
+static _Unwind_Reason_Code mi_backtrace_frame(struct _Unwind_Context* ctx, void* arg) {
+  mi_backtrace_state_t* state = (mi_backtrace_state_t*)arg;
+  const uintptr_t pc = (uintptr_t)_Unwind_GetIP(ctx);
+  if (pc == 0) return _URC_END_OF_STACK;
+  if (state->skip > 0) { state->skip--; return _URC_NO_REASON; }
+  state->frames[state->count++] = (void*)pc;
+  return (state->count >= state->max_frames ? _URC_END_OF_STACK : _URC_NO_REASON);
+}
+
+mi_decl_noinline size_t _mi_prim_backtrace(void** frames, size_t max_frames, size_t skip) {
+  if (max_frames == 0) return 0;
+  mi_backtrace_state_t state = { frames, max_frames, 0, skip + 1 /* this function */ };
+  _Unwind_Backtrace(&mi_backtrace_frame, &state);
+  return state.count;
+}
+#else
+size_t _mi_prim_backtrace(void** frames, size_t max_frames, size_t skip) {
+  MI_UNUSED(frames); MI_UNUSED(max_frames); MI_UNUSED(skip);
+  return 0;
+}
+#endif
+
 
 //----------------------------------------------------------------
 // Environment
@@ -128,6 +128,12 @@ int _mi_prim_alloc(size_t size, size_t try_alignment, bool commit, bool allow_la
 // Commit/Reset/Protect
 //---------------------------------------------
 
+int _mi_prim_reserve(size_t size, void** addr) {
+  MI_UNUSED(size);
+  *addr = NULL;
+  return ENOSYS;
+}
+
 int _mi_prim_commit(void* addr, size_t size, bool* is_zero) {
   MI_UNUSED(addr); MI_UNUSED(size); 
   *is_zero = false;
@@ -145,6 +151,12 @@ int _mi_prim_reset(void* addr, size_t size) {
   return 0;
 }
 
+int _mi_prim_purge_batch(const mi_os_range_t* ranges, size_t count, bool decommit, bool* needs_recommit) {
+  MI_UNUSED(ranges); MI_UNUSED(count); MI_UNUSED(decommit);
+  *needs_recommit = false;
+  return ENOSYS;
+}
+
 int _mi_prim_protect(void* addr, size_t size, bool protect) {
   MI_UNUSED(addr); MI_UNUSED(size); MI_UNUSED(protect);
   return 0;
@@ -162,6 +174,23 @@ int _mi_prim_alloc_huge_os_pages(void* hint_addr, size_t size, int numa_node, bo
   return ENOSYS;
 }
 
+int _mi_prim_alloc_shared(void* addr, size_t size, int* fd) {
+  MI_UNUSED(addr); MI_UNUSED(size);
+  *fd = -1;
+  return ENOSYS;
+}
+
+int _mi_prim_snapshot_shared(int fd, void* addr, size_t size, void** snapshot) {
+  MI_UNUSED(fd); MI_UNUSED(addr); MI_UNUSED(size);
+  *snapshot = NULL;
+  return ENOSYS;
+}
+
+int _mi_prim_free_shared(int fd, void* addr, size_t size) {
+  MI_UNUSED(fd); MI_UNUSED(addr); MI_UNUSED(size);
+  return 0;
+}
+
 size_t _mi_prim_numa_node(void) {
   return 0;
 }
@@ -170,6 +199,44 @@ size_t _mi_prim_numa_node_count(void) {
   return 1;
 }
 
+bool _mi_prim_cpu_id(size_t* cpu) {
+  *cpu = 0;
+  return false;
+}
+
+void _mi_prim_numa_run_parallel(size_t node_count, mi_prim_numa_fun_t* fun, void* arg) {
+  for (size_t node = 0; node < node_count; node++) {
+    (*fun)(arg, node);
+  }
+}
+
+
+//----------------------------------------------------------------
+// Memory pressure
+//----------------------------------------------------------------
+
+int _mi_prim_pressure_monitor_start(mi_prim_pressure_fun_t* fun, void* arg) {
+  MI_UNUSED(fun); MI_UNUSED(arg);
+  return ENOSYS;
+}
+
+
+//----------------------------------------------------------------
+// Memory limits
+//----------------------------------------------------------------
+
+bool _mi_prim_memory_limits(size_t* soft_limit, size_t* hard_limit) {
+  *soft_limit = 0;
+  *hard_limit = 0;
+  return false;
+}
+
+bool _mi_prim_memory_usage(bool cgroup, size_t* usage) {
+  MI_UNUSED(cgroup);
+  *usage = 0;
+  return false;
+}
+
 
 //----------------------------------------------------------------
 // Clock
@@ -224,6 +291,39 @@ void _mi_prim_out_stderr( const char* msg ) {
   fputs(msg,stderr);
 }
 
+int _mi_prim_write(int fd, const void* buf, size_t size) {
+  MI_UNUSED(fd); MI_UNUSED(buf); MI_UNUSED(size);
+  return ENOSYS;
+}
+
+int _mi_prim_file_create(const char* fpath) {
+  MI_UNUSED(fpath);
+  return -1;
+}
+
+void _mi_prim_file_close(int fd) {
+  MI_UNUSED(fd);
+}
+
+size_t _mi_prim_getpid(void) {
+  return 0;
+}
+
+bool _mi_prim_atfork(void (*prepare)(void), void (*parent)(void), void (*child)(void)) {
+  MI_UNUSED(prepare); MI_UNUSED(parent); MI_UNUSED(child);
+  return false;
+}
+
+int _mi_prim_write_mappings(int fd) {
+  MI_UNUSED(fd);
+  return ENOSYS;
+}
+
+size_t _mi_prim_backtrace(void** frames, size_t max_frames, size_t skip) {
+  MI_UNUSED(frames); MI_UNUSED(max_frames); MI_UNUSED(skip);
+  return 0;
+}
+
 
 //----------------------------------------------------------------
 // Environment
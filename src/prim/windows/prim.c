@@ -12,6 +12,9 @@ terms of the MIT license. A copy of the license can be found in the file
 #include "mimalloc/atomic.h"
 #include "mimalloc/prim.h"
 #include <stdio.h>   // fputs, stderr
+#include <io.h>      // _write, _open
+#include <fcntl.h>   // _O_WRONLY etc.
+#include <sys/stat.h>
 
 
 //---------------------------------------------
@@ -58,10 +61,12 @@ typedef VOID (__stdcall *PGetCurrentProcessorNumberEx)(MI_PROCESSOR_NUMBER* Proc
 typedef BOOL (__stdcall *PGetNumaProcessorNodeEx)(MI_PROCESSOR_NUMBER* Processor, PUSHORT NodeNumber);
 typedef BOOL (__stdcall* PGetNumaNodeProcessorMaskEx)(USHORT Node, PGROUP_AFFINITY ProcessorMask);
 typedef BOOL (__stdcall *PGetNumaProcessorNode)(UCHAR Processor, PUCHAR NodeNumber);
+typedef BOOL (__stdcall *PSetThreadGroupAffinity)(HANDLE Thread, const GROUP_AFFINITY* GroupAffinity, PGROUP_AFFINITY PreviousGroupAffinity);
 static PGetCurrentProcessorNumberEx pGetCurrentProcessorNumberEx = NULL;
 static PGetNumaProcessorNodeEx      pGetNumaProcessorNodeEx = NULL;
 static PGetNumaNodeProcessorMaskEx  pGetNumaNodeProcessorMaskEx = NULL;
 static PGetNumaProcessorNode        pGetNumaProcessorNode = NULL;
+static PSetThreadGroupAffinity      pSetThreadGroupAffinity = NULL;
 
 //---------------------------------------------
 // Enable large page support dynamically (if possible)
@@ -141,6 +146,7 @@ void _mi_prim_mem_init( mi_os_mem_config_t* config )
     pGetNumaProcessorNodeEx = (PGetNumaProcessorNodeEx)(void (*)(void))GetProcAddress(hDll, "GetNumaProcessorNodeEx");
     pGetNumaNodeProcessorMaskEx = (PGetNumaNodeProcessorMaskEx)(void (*)(void))GetProcAddress(hDll, "GetNumaNodeProcessorMaskEx");
     pGetNumaProcessorNode = (PGetNumaProcessorNode)(void (*)(void))GetProcAddress(hDll, "GetNumaProcessorNode");
+    pSetThreadGroupAffinity = (PSetThreadGroupAffinity)(void (*)(void))GetProcAddress(hDll, "SetThreadGroupAffinity");
     FreeLibrary(hDll);
   }
   if (mi_option_is_enabled(mi_option_allow_large_os_pages) || mi_option_is_enabled(mi_option_reserve_huge_os_pages)) {
@@ -259,6 +265,11 @@ int _mi_prim_alloc(size_t size, size_t try_alignment, bool commit, bool allow_la
 #pragma warning(disable:6250)   // suppress warning calling VirtualFree without MEM_RELEASE (for decommit)
 #endif
 
+int _mi_prim_reserve(size_t size, void** addr) {
+  *addr = VirtualAlloc(NULL, size, MEM_RESERVE, PAGE_NOACCESS);
+  return (*addr != NULL ? 0 : (int)GetLastError());
+}
+
 int _mi_prim_commit(void* addr, size_t size, bool* is_zero) {
   *is_zero = false;
   /*
@@ -293,6 +304,12 @@ int _mi_prim_reset(void* addr, size_t size) {
   return (p != NULL ? 0 : (int)GetLastError());
 }
 
+int _mi_prim_purge_batch(const mi_os_range_t* ranges, size_t count, bool decommit, bool* needs_recommit) {
+  MI_UNUSED(ranges); MI_UNUSED(count);
+  *needs_recommit = decommit;
+  return ENOSYS;  // there is no vectored VirtualFree; purge one by one
+}
+
 int _mi_prim_protect(void* addr, size_t size, bool protect) {
   DWORD oldprotect = 0;
   BOOL ok = VirtualProtect(addr, size, protect ? PAGE_NOACCESS : PAGE_READWRITE, &oldprotect);
@@ -352,6 +369,28 @@ int _mi_prim_alloc_huge_os_pages(void* hint_addr, size_t size, int numa_node, bo
 }
 
 
+//---------------------------------------------
+// Shared memory files (not supported)
+//---------------------------------------------
+
+int _mi_prim_alloc_shared(void* addr, size_t size, int* fd) {
+  MI_UNUSED(addr); MI_UNUSED(size);
+  *fd = -1;
+  return ENOSYS;
+}
+
+int _mi_prim_snapshot_shared(int fd, void* addr, size_t size, void** snapshot) {
+  MI_UNUSED(fd); MI_UNUSED(addr); MI_UNUSED(size);
+  *snapshot = NULL;
+  return ENOSYS;
+}
+
+int _mi_prim_free_shared(int fd, void* addr, size_t size) {
+  MI_UNUSED(fd); MI_UNUSED(addr); MI_UNUSED(size);
+  return 0;
+}
+
+
 //---------------------------------------------
 // Numa nodes
 //---------------------------------------------
@@ -401,6 +440,109 @@ size_t _mi_prim_numa_node_count(void) {
   return ((size_t)numa_max + 1);
 }
 
+bool _mi_prim_cpu_id(size_t* cpu) {
+  if (pGetCurrentProcessorNumberEx != NULL) {
+    MI_PROCESSOR_NUMBER pnum;
+    (*pGetCurrentProcessorNumberEx)(&pnum);
+    *cpu = ((size_t)pnum.Group * 64) + pnum.Number;
+  }
+  else {
+    *cpu = GetCurrentProcessorNumber();
+  }
+  return true;
+}
+
+#define MI_NUMA_THREADS_MAX  (64)   // at most this many helper threads at a time
+
+typedef struct mi_prim_numa_thread_s {
+  mi_prim_numa_fun_t* fun;
+  void*               arg;
+  size_t              node;
+} mi_prim_numa_thread_t;
+
+static DWORD WINAPI mi_prim_numa_thread_start(LPVOID p) {
+  const mi_prim_numa_thread_t* t = (const mi_prim_numa_thread_t*)p;
+  if (pGetNumaNodeProcessorMaskEx != NULL && pSetThreadGroupAffinity != NULL) {
+    GROUP_AFFINITY affinity;
+    if ((*pGetNumaNodeProcessorMaskEx)((USHORT)t->node, &affinity) && affinity.Mask != 0) {
+      (*pSetThreadGroupAffinity)(GetCurrentThread(), &affinity, NULL);
+    }
+  }
+  (*t->fun)(t->arg, t->node);
+  return 0;
+}
+
+void _mi_prim_numa_run_parallel(size_t node_count, mi_prim_numa_fun_t* fun, void* arg) {
+  HANDLE                threads[MI_NUMA_THREADS_MAX];
+  mi_prim_numa_thread_t targs[MI_NUMA_THREADS_MAX];
+  for (size_t base = 0; base < node_count; base += MI_NUMA_THREADS_MAX) {
+    const size_t count = (node_count - base < MI_NUMA_THREADS_MAX ? node_count - base : MI_NUMA_THREADS_MAX);
+    for (size_t i = 0; i < count; i++) {
+      targs[i].fun = fun;
+      targs[i].arg = arg;
+      targs[i].node = base + i;
+      threads[i] = CreateThread(NULL, 0, &mi_prim_numa_thread_start, &targs[i], 0, NULL);
+    }
+    for (size_t i = 0; i < count; i++) {
+      if (threads[i] != NULL) {
+        WaitForSingleObject(threads[i], INFINITE);
+        CloseHandle(threads[i]);
+      }
+      else {
+        (*fun)(arg, base + i);  // could not create a helper thread, run it here
+      }
+    }
+  }
+}
+
+
+//----------------------------------------------------------------
+// Memory pressure
+//----------------------------------------------------------------
+
+#define MI_PRESSURE_RELAX_MSECS  (5000)   // pressure is gone if the low-memory notification stays off this long
+
+typedef struct mi_prim_pressure_monitor_s {
+  mi_prim_pressure_fun_t* fun;
+  void*                   arg;
+  HANDLE                  low_memory;     // signaled while the system is low on memory
+} mi_prim_pressure_monitor_t;
+
+static mi_prim_pressure_monitor_t mi_pressure_monitor;
+
+static DWORD WINAPI mi_prim_pressure_thread(LPVOID p) {
+  const mi_prim_pressure_monitor_t* m = (const mi_prim_pressure_monitor_t*)p;
+  while (true) {
+    if (WaitForSingleObject(m->low_memory, INFINITE) != WAIT_OBJECT_0) return 0;
+    (*m->fun)(m->arg, true);
+    // wait until the notification stays off for a while
+    DWORD quiet = 0;
+    while (quiet < MI_PRESSURE_RELAX_MSECS) {
+      Sleep(1000);
+      BOOL low = FALSE;
+      if (!QueryMemoryResourceNotification(m->low_memory, &low)) return 0;
+      if (low) { quiet = 0; (*m->fun)(m->arg, true); }
+          else { quiet += 1000; }
+    }
+    (*m->fun)(m->arg, false);
+  }
+}
+
+int _mi_prim_pressure_monitor_start(mi_prim_pressure_fun_t* fun, void* arg) {
+  mi_pressure_monitor.fun = fun;
+  mi_pressure_monitor.arg = arg;
+  mi_pressure_monitor.low_memory = CreateMemoryResourceNotification(LowMemoryResourceNotification);
+  if (mi_pressure_monitor.low_memory == NULL) return (int)GetLastError();
+  HANDLE thread = CreateThread(NULL, 0, &mi_prim_pressure_thread, &mi_pressure_monitor, 0, NULL);
+  if (thread == NULL) {
+    int err = (int)GetLastError();
+    CloseHandle(mi_pressure_monitor.low_memory);
+    return err;
+  }
+  CloseHandle(thread);  // detach
+  return 0;
+}
+
 
 //----------------------------------------------------------------
 // Clock
@@ -442,6 +584,18 @@ static mi_msecs_t filetime_msecs(const FILETIME* ftime) {
 typedef BOOL (WINAPI *PGetProcessMemoryInfo)(HANDLE, PPROCESS_MEMORY_COUNTERS, DWORD);
 static PGetProcessMemoryInfo pGetProcessMemoryInfo = NULL;
 
+static bool mi_prim_memory_info(PROCESS_MEMORY_COUNTERS* info) {
+  // load psapi on demand
+  if (pGetProcessMemoryInfo == NULL) {
+    HINSTANCE hDll = LoadLibrary(TEXT("psapi.dll"));
+    if (hDll != NULL) {
+      pGetProcessMemoryInfo = (PGetProcessMemoryInfo)(void (*)(void))GetProcAddress(hDll, "GetProcessMemoryInfo");
+    }
+  }
+  memset(info, 0, sizeof(*info));
+  return (pGetProcessMemoryInfo != NULL && pGetProcessMemoryInfo(GetCurrentProcess(), info, sizeof(*info)));
+}
+
 void _mi_prim_process_info(mi_process_info_t* pinfo)
 {
   FILETIME ct;
@@ -452,20 +606,9 @@ void _mi_prim_process_info(mi_process_info_t* pinfo)
   pinfo->utime = filetime_msecs(&ut);
   pinfo->stime = filetime_msecs(&st);
   
-  // load psapi on demand
-  if (pGetProcessMemoryInfo == NULL) {
-    HINSTANCE hDll = LoadLibrary(TEXT("psapi.dll"));
-    if (hDll != NULL) {
-      pGetProcessMemoryInfo = (PGetProcessMemoryInfo)(void (*)(void))GetProcAddress(hDll, "GetProcessMemoryInfo");
-    }
-  }
-
   // get process info
   PROCESS_MEMORY_COUNTERS info;
-  memset(&info, 0, sizeof(info));
-  if (pGetProcessMemoryInfo != NULL) {
-    pGetProcessMemoryInfo(GetCurrentProcess(), &info, sizeof(info));
-  } 
+  mi_prim_memory_info(&info);
   pinfo->current_rss    = (size_t)info.WorkingSetSize;
   pinfo->peak_rss       = (size_t)info.PeakWorkingSetSize;
   pinfo->current_commit = (size_t)info.PagefileUsage;
@@ -473,6 +616,27 @@ void _mi_prim_process_info(mi_process_info_t* pinfo)
   pinfo->page_faults    = (size_t)info.PageFaultCount;
 }
 
+
+//----------------------------------------------------------------
+// Memory limits
+//----------------------------------------------------------------
+
+// job object limits are not detected (yet)
+bool _mi_prim_memory_limits(size_t* soft_limit, size_t* hard_limit) {
+  *soft_limit = 0;
+  *hard_limit = 0;
+  return false;
+}
+
+// use the commit charge as that is what counts against the Windows memory limits
+bool _mi_prim_memory_usage(bool cgroup, size_t* usage) {
+  MI_UNUSED(cgroup);
+  PROCESS_MEMORY_COUNTERS info;
+  if (!mi_prim_memory_info(&info)) return false;
+  *usage = (size_t)info.PagefileUsage;
+  return true;
+}
+
 //----------------------------------------------------------------
 // Output
 //----------------------------------------------------------------
@@ -508,6 +672,45 @@ void _mi_prim_out_stderr( const char* msg )
   }
 }
 
+int _mi_prim_write(int fd, const void* buf, size_t size) {
+  const uint8_t* p = (const uint8_t*)buf;
+  while (size > 0) {
+    const unsigned int chunk = (size > INT_MAX ? INT_MAX : (unsigned int)size);
+    const int n = _write(fd, p, chunk);
+    if (n < 0) return errno;
+    p += n;
+    size -= (size_t)n;
+  }
+  return 0;
+}
+
+int _mi_prim_file_create(const char* fpath) {
+  return _open(fpath, _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+}
+
+void _mi_prim_file_close(int fd) {
+  _close(fd);
+}
+
+size_t _mi_prim_getpid(void) {
+  return (size_t)GetCurrentProcessId();
+}
+
+bool _mi_prim_atfork(void (*prepare)(void), void (*parent)(void), void (*child)(void)) {
+  MI_UNUSED(prepare); MI_UNUSED(parent); MI_UNUSED(child);
+  return false;  // no fork
+}
+
+int _mi_prim_write_mappings(int fd) {
+  MI_UNUSED(fd);
+  return ENOSYS;
+}
+
+size_t _mi_prim_backtrace(void** frames, size_t max_frames, size_t skip) {
+  if (max_frames > UINT16_MAX) { max_frames = UINT16_MAX; }
+  return RtlCaptureStackBackTrace((DWORD)(skip + 1), (DWORD)max_frames, frames, NULL);
+}
+
 
 //----------------------------------------------------------------
 // Environment
@@ -0,0 +1,516 @@
+/* ----------------------------------------------------------------------------
+Copyright (c) 2018-2023, Microsoft Research, Daan Leijen
+This is free software; you can redistribute it and/or modify it under the
+terms of the MIT license. A copy of the license can be found in the file
+"LICENSE" at the root of this distribution.
+-----------------------------------------------------------------------------*/
+#include "mimalloc.h"
+#include "mimalloc/internal.h"
+#include "mimalloc/atomic.h"
+#include "mimalloc/prim.h"  // _mi_prim_backtrace, _mi_prim_write
+
+#include <stdio.h>  // snprintf
+
+/* -----------------------------------------------------------
+  Sampling heap profiler
+
+  Each heap counts down the bytes it allocates in `profile_countdown`
+  (in `_mi_page_malloc`) and once that drops below zero the allocated block
+  is sampled: we record its size and the call stack in a side table and set
+  the `has_sampled` flag of its page. The flag makes `mi_free` take the generic
+  path for blocks in that page (like `has_aligned`) where the sample is removed
+  again, so the free fast path stays unchanged. The next countdown is drawn
+  uniformly from `[1, 2*interval]` to avoid aliasing with allocation patterns.
+
+  The side table is allocated from the OS on the first sample and is a fixed
+  size hash table (with linear probing) protected by a spin lock. Samples are
+  dropped if the table is full.
+----------------------------------------------------------- */
+
+#define MI_PROFILE_MAX_FRAMES   (32)
+#define MI_PROFILE_SAMPLES_SHIFT (12)
+#define MI_PROFILE_MAX_SAMPLES  (1UL<<MI_PROFILE_SAMPLES_SHIFT)  // at most 3/4 is used
+#define MI_PROFILE_RECHECK      (64*MI_MiB)     // re-read the interval option after this many bytes when disabled
+
+typedef struct mi_profile_sample_s {
+  const void* block;        // NULL if the entry is free
+  size_t      size;         // requested size
+  size_t      frame_count;
+  void*       frames[MI_PROFILE_MAX_FRAMES];
+} mi_profile_sample_t;
+
+typedef struct mi_profile_table_s {
+  size_t              count;
+  size_t              dropped;
+  mi_memid_t          memid;
+  mi_profile_sample_t samples[MI_PROFILE_MAX_SAMPLES];
+} mi_profile_table_t;
+
+static _Atomic(mi_profile_table_t*) mi_profile_table;       // = NULL
+static _Atomic(uintptr_t)           mi_profile_table_lock;  // = 0
+
+static void mi_profile_acquire(void) {
+  uintptr_t expected = 0;
+  while (!mi_atomic_cas_weak_acq_rel(&mi_profile_table_lock, &expected, (uintptr_t)1)) {
+    expected = 0;
+    mi_atomic_yield();
+  }
+}
+
+static void mi_profile_release(void) {
+  mi_atomic_store_release(&mi_profile_table_lock, (uintptr_t)0);
+}
+
+static mi_profile_table_t* mi_profile_table_get(void) {
+  mi_profile_table_t* table = mi_atomic_load_ptr_acquire(mi_profile_table_t, &mi_profile_table);
+  if mi_likely(table != NULL) return table;
+  mi_memid_t memid;
+  table = (mi_profile_table_t*)_mi_os_alloc(sizeof(mi_profile_table_t), &memid, &_mi_stats_main);  // zero initialized
+  if (table == NULL) return NULL;
+  table->memid = memid;
+  mi_profile_table_t* expected = NULL;
+  if (!mi_atomic_cas_ptr_strong_release(mi_profile_table_t, &mi_profile_table, &expected, table)) {
+    // another thread was first
+    _mi_os_free(table, sizeof(mi_profile_table_t), memid, &_mi_stats_main);
+    table = expected;
+  }
+  return table;
+}
+
+static size_t mi_profile_hash(const void* block) {
+  uintptr_t x = (uintptr_t)block >> 3;
+  x *= (uintptr_t)0x9E3779B97F4A7C15ULL;  // fibonacci hashing
+  return (size_t)(x >> (MI_INTPTR_BITS - MI_PROFILE_SAMPLES_SHIFT));
+}
+
+// Remove the sample at index `i` and shift back later entries of the same probe run (called with the lock held)
+static void mi_profile_remove_at(mi_profile_table_t* table, size_t i) {
+  size_t j = i;
+  while (true) {
+    j = (j + 1) & (MI_PROFILE_MAX_SAMPLES - 1);
+    mi_profile_sample_t* s = &table->samples[j];
+    if (s->block == NULL) break;
+    const size_t home = mi_profile_hash(s->block);
+    // move `s` into the hole at `i` if its home is not cyclically in `(i,j]`
+    const bool in_range = (i <= j ? (i < home && home <= j) : (i < home || home <= j));
+    if (!in_range) {
+      table->samples[i] = *s;
+      i = j;
+    }
+  }
+  table->samples[i].block = NULL;
+  table->count--;
+}
+
+// Remove the sample of `block` if present (called with the lock held)
+static void mi_profile_remove(mi_profile_table_t* table, const void* block) {
+  for (size_t i = mi_profile_hash(block); table->samples[i].block != NULL; i = (i + 1) & (MI_PROFILE_MAX_SAMPLES - 1)) {
+    if (table->samples[i].block == block) {
+      mi_profile_remove_at(table, i);
+      return;
+    }
+  }
+}
+
+static void mi_heap_tag_block(mi_page_t* page, mi_block_t* block);
+
+// Sample the block if this is not the first countdown of the heap, and return the next countdown
+static mi_decl_noinline ptrdiff_t mi_heap_profile_next(mi_heap_t* heap, mi_page_t* page, mi_block_t* block, size_t size, ptrdiff_t countdown) {
+  const bool first = (countdown + (ptrdiff_t)size == 0);  // a fresh heap starts at zero
+  const size_t interval = mi_option_get_size(mi_option_profile_interval);
+  if mi_likely(interval == 0) return MI_PROFILE_RECHECK;
+  const ptrdiff_t next = (ptrdiff_t)(_mi_heap_random_next(heap) % (2*interval)) + 1;
+  if (first) return next;  // only start sampling after a random initial countdown
+
+  // capture the call stack outside the lock
+  mi_profile_sample_t sample;
+  sample.block = block;
+  sample.size = (size > MI_PADDING_SIZE ? size - MI_PADDING_SIZE : 0);
+  sample.frame_count = _mi_prim_backtrace(sample.frames, MI_PROFILE_MAX_FRAMES, 2 /* this function and the caller */);
+
+  mi_profile_table_t* table = mi_profile_table_get();
+  if (table == NULL) return next;
+  mi_profile_acquire();
+  if (table->count >= (3*MI_PROFILE_MAX_SAMPLES)/4) {
+    table->dropped++;
+  }
+  else {
+    size_t i = mi_profile_hash(block);
+    while (table->samples[i].block != NULL) { i = (i + 1) & (MI_PROFILE_MAX_SAMPLES - 1); }
+    table->samples[i] = sample;
+    table->count++;
+    mi_page_set_has_sampled(page, true);
+  }
+  mi_profile_release();
+  return next;
+}
+
+mi_decl_noinline void _mi_heap_profile_sample(mi_heap_t* heap, mi_page_t* page, mi_block_t* block, size_t size) {
+  // when tagging, the `profile_countdown` is kept at zero so every allocation comes here,
+  // and the profiler counts down in `sample_countdown` instead
+  if (!heap->tag_allocs || (heap->sample_countdown -= (ptrdiff_t)size) < 0) {
+    const ptrdiff_t countdown = (heap->tag_allocs ? heap->sample_countdown : heap->profile_countdown);
+    const ptrdiff_t next = mi_heap_profile_next(heap, page, block, size, countdown);
+    heap->tag_allocs = mi_option_is_enabled(mi_option_alloc_tags);  // re-read with the interval
+    heap->sample_countdown = next;
+    heap->profile_countdown = next;
+  }
+  if (heap->tag_allocs) {
+    heap->profile_countdown = 0;
+    mi_heap_tag_block(page, block);
+  }
+}
+
+void _mi_heap_profile_free(const mi_block_t* block) {
+  mi_profile_table_t* table = mi_atomic_load_ptr_acquire(mi_profile_table_t, &mi_profile_table);
+  if (table == NULL) return;
+  mi_profile_acquire();
+  mi_profile_remove(table, block);
+  mi_profile_release();
+}
+
+void _mi_heap_profile_free_page(const mi_segment_t* segment, mi_page_t* page) {
+  mi_page_set_has_sampled(page, false);
+  mi_profile_table_t* table = mi_atomic_load_ptr_acquire(mi_profile_table_t, &mi_profile_table);
+  if (table == NULL) return;
+  size_t psize;
+  const uint8_t* start = _mi_page_start(segment, page, &psize);
+  const uint8_t* end = start + psize;
+  mi_profile_acquire();
+  size_t i = 0;
+  while (i < MI_PROFILE_MAX_SAMPLES) {
+    const uint8_t* p = (const uint8_t*)table->samples[i].block;
+    if (p != NULL && p >= start && p < end) {
+      mi_profile_remove_at(table, i);  // re-examine `i` as a later entry may have moved into it
+    }
+    else {
+      i++;
+    }
+  }
+  mi_profile_release();
+}
+
+
+/* -----------------------------------------------------------
+  Dump the samples in the (legacy) text heap profile format
+  of gperftools that `pprof` understands:
+
+    heap profile: <count>: <bytes> [<count>: <bytes>] @ heap_v2/<interval>
+    # dropped: <count>
+    1: <size> [1: <size>] @ 0x<pc> 0x<pc> ...
+    ...
+
+    MAPPED_LIBRARIES:
+    <contents of /proc/self/maps>
+
+  The `dropped` comment line (skipped by `pprof`) counts the samples
+  that did not fit in the table. The samples are copied under the lock
+  and written after releasing it, so frees of sampled blocks do not
+  wait for the output.
+----------------------------------------------------------- */
+
+typedef struct mi_profile_out_s {
+  int    fd;
+  int    err;
+  size_t len;
+  char   buf[1024];
+} mi_profile_out_t;
+
+static void mi_profile_flush(mi_profile_out_t* out) {
+  if (out->err == 0 && out->len > 0) {
+    out->err = _mi_prim_write(out->fd, out->buf, out->len);
+  }
+  out->len = 0;
+}
+
+static void mi_profile_puts(mi_profile_out_t* out, const char* s) {
+  while (*s != 0) {
+    if (out->len >= sizeof(out->buf)) { mi_profile_flush(out); }
+    out->buf[out->len++] = *s++;
+  }
+}
+
+int mi_heap_profile_dump(int fd) mi_attr_noexcept {
+  mi_profile_out_t out;
+  out.fd = fd;
+  out.err = 0;
+  out.len = 0;
+  char line[64];
+  // copy the samples (compacted) under the lock
+  mi_profile_table_t* copy = NULL;
+  mi_memid_t copy_memid = _mi_memid_none();
+  size_t total = 0;
+  mi_profile_table_t* table = mi_atomic_load_ptr_acquire(mi_profile_table_t, &mi_profile_table);
+  if (table != NULL) {
+    copy = (mi_profile_table_t*)_mi_os_alloc(sizeof(mi_profile_table_t), &copy_memid, &_mi_stats_main);
+    if (copy == NULL) return ENOMEM;
+    mi_profile_acquire();
+    for (size_t i = 0; i < MI_PROFILE_MAX_SAMPLES; i++) {
+      if (table->samples[i].block != NULL) {
+        copy->samples[copy->count++] = table->samples[i];
+        total += table->samples[i].size;
+      }
+    }
+    copy->dropped = table->dropped;
+    mi_profile_release();
+  }
+  const size_t count = (copy != NULL ? copy->count : 0);
+  snprintf(line, sizeof(line), "heap profile: %zu: %zu [%zu: %zu] @ heap_v2/%zu\n",
+           count, total, count, total, mi_option_get_size(mi_option_profile_interval));
+  mi_profile_puts(&out, line);
+  if (copy != NULL) {
+    snprintf(line, sizeof(line), "# dropped: %zu\n", copy->dropped);
+    mi_profile_puts(&out, line);
+    for (size_t i = 0; i < copy->count && out.err == 0; i++) {
+      const mi_profile_sample_t* s = &copy->samples[i];
+      snprintf(line, sizeof(line), "1: %zu [1: %zu] @", s->size, s->size);
+      mi_profile_puts(&out, line);
+      for (size_t j = 0; j < s->frame_count; j++) {
+        snprintf(line, sizeof(line), " 0x%zx", (size_t)s->frames[j]);
+        mi_profile_puts(&out, line);
+      }
+      mi_profile_puts(&out, "\n");
+    }
+    _mi_os_free(copy, sizeof(mi_profile_table_t), copy_memid, &_mi_stats_main);
+  }
+  mi_profile_puts(&out, "\nMAPPED_LIBRARIES:\n");
+  mi_profile_flush(&out);
+  if (out.err != 0) return out.err;
+  const int err = _mi_prim_write_mappings(fd);
+  return (err == ENOSYS ? 0 : err);
+}
+
+
+/* -----------------------------------------------------------
+  Allocation site tags
+
+  With `mi_option_alloc_tags` enabled, each allocation records
+  a site id in a side array of its page (`page->tags`) so the
+  block layout stays the same. The site is the user tag of the
+  thread (see `mi_set_alloc_tag`) or otherwise the innermost
+  return addresses of the allocation. A site id with the high bit
+  set is a user tag; otherwise it is an index (+1) into a global
+  table of call stacks (and 0 is unknown). Allocations come here
+  through `_mi_heap_profile_sample` as the profile countdown is
+  kept at zero while tagging, so the allocation fast path stays
+  unchanged. Capturing the call stack on every allocation is slow
+  though, so this is meant for debugging leaks.
+----------------------------------------------------------- */
+
+#define MI_TAG_USER           (0x80000000UL)
+#define MI_TAG_FRAMES         (8)
+#define MI_TAG_SITES_SHIFT    (12)
+#define MI_TAG_MAX_SITES      (1UL<<MI_TAG_SITES_SHIFT)  // at most 3/4 is used
+
+typedef struct mi_page_tags_s {
+  mi_memid_t memid;
+  size_t     size;
+  uint32_t   sites[1];        // a site id per block
+} mi_page_tags_t;
+
+typedef struct mi_tag_site_s {
+  size_t frame_count;         // 0 if the entry is free
+  void*  frames[MI_TAG_FRAMES];
+} mi_tag_site_t;
+
+typedef struct mi_tag_sites_s {
+  size_t        count;
+  mi_memid_t    memid;
+  mi_tag_site_t sites[MI_TAG_MAX_SITES];
+} mi_tag_sites_t;
+
+static _Atomic(mi_tag_sites_t*) mi_tag_sites;         // = NULL
+static _Atomic(uintptr_t)       mi_tag_sites_lock;    // = 0
+static mi_decl_thread uint32_t  mi_alloc_tag;         // = 0
+
+uint32_t mi_set_alloc_tag(uint32_t tag) mi_attr_noexcept {
+  const uint32_t prev = mi_alloc_tag;
+  mi_alloc_tag = (uint32_t)(tag & ~MI_TAG_USER);
+  return prev;
+}
+
+static mi_tag_sites_t* mi_tag_sites_get(void) {
+  mi_tag_sites_t* sites = mi_atomic_load_ptr_acquire(mi_tag_sites_t, &mi_tag_sites);
+  if mi_likely(sites != NULL) return sites;
+  mi_memid_t memid;
+  sites = (mi_tag_sites_t*)_mi_os_alloc(sizeof(mi_tag_sites_t), &memid, &_mi_stats_main);  // zero initialized
+  if (sites == NULL) return NULL;
+  sites->memid = memid;
+  mi_tag_sites_t* expected = NULL;
+  if (!mi_atomic_cas_ptr_strong_release(mi_tag_sites_t, &mi_tag_sites, &expected, sites)) {
+    _mi_os_free(sites, sizeof(mi_tag_sites_t), memid, &_mi_stats_main);
+    sites = expected;
+  }
+  return sites;
+}
+
+// Find or insert the call stack in the site table and return its id (or 0 if the table is full)
+static uint32_t mi_tag_site_id(void** frames, size_t frame_count) {
+  if (frame_count == 0) return 0;
+  mi_tag_sites_t* sites = mi_tag_sites_get();
+  if (sites == NULL) return 0;
+  uintptr_t h = 0;
+  for (size_t i = 0; i < frame_count; i++) {
+    h = (h ^ (uintptr_t)frames[i]) * (uintptr_t)0x9E3779B97F4A7C15ULL;  // fibonacci hashing
+  }
+  size_t i = (size_t)(h >> (MI_INTPTR_BITS - MI_TAG_SITES_SHIFT));
+  uint32_t id = 0;
+  uintptr_t expected = 0;
+  while (!mi_atomic_cas_weak_acq_rel(&mi_tag_sites_lock, &expected, (uintptr_t)1)) {
+    expected = 0;
+    mi_atomic_yield();
+  }
+  for (; sites->sites[i].frame_count != 0; i = (i + 1) & (MI_TAG_MAX_SITES - 1)) {
+    const mi_tag_site_t* site = &sites->sites[i];
+    if (site->frame_count == frame_count && memcmp(site->frames, frames, frame_count * sizeof(void*)) == 0) {
+      id = (uint32_t)i + 1;
+      break;
+    }
+  }
+  if (id == 0 && sites->count < (3*MI_TAG_MAX_SITES)/4) {
+    _mi_memcpy(sites->sites[i].frames, frames, frame_count * sizeof(void*));
+    sites->sites[i].frame_count = frame_count;
+    sites->count++;
+    id = (uint32_t)i + 1;
+  }
+  mi_atomic_store_release(&mi_tag_sites_lock, (uintptr_t)0);
+  return id;
+}
+
+static mi_decl_noinline void mi_heap_tag_block(mi_page_t* page, mi_block_t* block) {
+  uint32_t id = mi_alloc_tag;
+  if (id != 0) {
+    id |= MI_TAG_USER;
+  }
+  else {
+    void* frames[MI_TAG_FRAMES];
+    const size_t frame_count = _mi_prim_backtrace(frames, MI_TAG_FRAMES, 2 /* this function and the caller */);
+    id = mi_tag_site_id(frames, frame_count);
+  }
+  // allocate the side array of the page on demand
+  if (page->tags == NULL) {
+    const size_t size = offsetof(mi_page_tags_t, sites) + page->reserved * sizeof(uint32_t);
+    mi_memid_t memid;
+    mi_page_tags_t* tags = (mi_page_tags_t*)_mi_os_alloc(size, &memid, &_mi_stats_main);  // zero initialized
+    if (tags == NULL) return;
+    tags->memid = memid;
+    tags->size = size;
+    page->tags = tags;
+  }
+  const uint8_t* start = _mi_page_start(_mi_page_segment(page), page, NULL);
+  const size_t idx = ((uint8_t*)block - start) / mi_page_block_size(page);
+  mi_assert_internal(idx < page->reserved);
+  page->tags->sites[idx] = id;
+}
+
+// Called when a page with tags is freed
+void _mi_page_tags_free(mi_page_t* page) {
+  mi_page_tags_t* tags = page->tags;
+  page->tags = NULL;
+  _mi_os_free(tags, tags->size, tags->memid, &_mi_stats_main);
+}
+
+
+/* -----------------------------------------------------------
+  Aggregate the live blocks of a heap by allocation site
+----------------------------------------------------------- */
+
+#define MI_LIVE_SITES_SHIFT   (13)
+#define MI_LIVE_MAX_SITES     (1UL<<MI_LIVE_SITES_SHIFT)
+
+typedef struct mi_live_site_s {
+  uint32_t id;
+  bool     in_use;
+  size_t   count;
+  size_t   size;
+} mi_live_site_t;
+
+typedef struct mi_live_sites_s {
+  size_t         count;
+  mi_live_site_t other;         // sites that did not fit
+  mi_live_site_t sites[MI_LIVE_MAX_SITES];
+} mi_live_sites_t;
+
+static bool mi_live_block_visit(const mi_heap_t* heap, const mi_heap_area_t* area, void* block, size_t block_size, void* arg) {
+  MI_UNUSED(heap); MI_UNUSED(area);
+  if (block == NULL) return true;  // a page area
+  mi_live_sites_t* live = (mi_live_sites_t*)arg;
+  const mi_page_t* page = _mi_ptr_page(block);
+  uint32_t id = 0;
+  if (page->tags != NULL) {
+    const uint8_t* start = _mi_page_start(_mi_page_segment(page), page, NULL);
+    id = page->tags->sites[((uint8_t*)block - start) / mi_page_block_size(page)];
+  }
+  const uintptr_t h = (uintptr_t)(id + 1) * (uintptr_t)0x9E3779B97F4A7C15ULL;
+  mi_live_site_t* site = &live->other;
+  for (size_t i = (size_t)(h >> (MI_INTPTR_BITS - MI_LIVE_SITES_SHIFT)); ; i = (i + 1) & (MI_LIVE_MAX_SITES - 1)) {
+    mi_live_site_t* s = &live->sites[i];
+    if (s->in_use && s->id == id) { site = s; break; }
+    if (!s->in_use) {
+      if (live->count < (3*MI_LIVE_MAX_SITES)/4) {
+        s->in_use = true;
+        s->id = id;
+        live->count++;
+        site = s;
+      }
+      break;
+    }
+  }
+  site->count++;
+  site->size += block_size;
+  return true;
+}
+
+bool mi_heap_dump_live(mi_heap_t* heap, mi_alloc_site_fun* visitor, void* arg) mi_attr_noexcept {
+  if (heap == NULL || visitor == NULL) return false;
+  mi_memid_t memid;
+  mi_live_sites_t* live = (mi_live_sites_t*)_mi_os_alloc(sizeof(mi_live_sites_t), &memid, &_mi_stats_main);  // zero initialized
+  if (live == NULL) return false;
+  live->other.id = MI_ALLOC_SITE_OTHER;  // (does not collide with a user tag, which has the high bit set, nor a call stack index)
+  mi_heap_visit_blocks(heap, true, &mi_live_block_visit, live);
+
+  // report each site
+  const mi_tag_sites_t* sites = mi_atomic_load_ptr_acquire(mi_tag_sites_t, &mi_tag_sites);
+  bool ok = true;
+  for (size_t i = 0; i <= MI_LIVE_MAX_SITES && ok; i++) {
+    const mi_live_site_t* s = (i < MI_LIVE_MAX_SITES ? &live->sites[i] : &live->other);
+    if (s->count == 0) continue;
+    mi_alloc_site_t site;
+    site.id = s->id;
+    site.tag = ((s->id & MI_TAG_USER) != 0 ? (s->id & ~MI_TAG_USER) : 0);
+    site.frame_count = 0;
+    site.frames = NULL;
+    if (sites != NULL && s->id != 0 && s->id != MI_ALLOC_SITE_OTHER && (s->id & MI_TAG_USER) == 0) {
+      const mi_tag_site_t* ts = &sites->sites[s->id - 1];
+      site.frame_count = ts->frame_count;
+      site.frames = (void* const*)ts->frames;
+    }
+    site.count = s->count;
+    site.size = s->size;
+    ok = visitor(heap, &site, arg);
+  }
+  _mi_os_free(live, sizeof(mi_live_sites_t), memid, &_mi_stats_main);
+  return ok;
+}
+
+static bool mi_live_site_print(const mi_heap_t* heap, const mi_alloc_site_t* site, void* arg) {
+  MI_UNUSED(arg);
+  char buf[32 + MI_TAG_FRAMES*20];
+  size_t len = 0;
+  if (site->tag != 0) {
+    len = (size_t)snprintf(buf, sizeof(buf), " tag %u", site->tag);
+  }
+  else if (site->frame_count == 0) {
+    len = (size_t)snprintf(buf, sizeof(buf), " %s", (site->id == MI_ALLOC_SITE_OTHER ? "other sites" : "an unknown site"));
+  }
+  for (size_t i = 0; i < site->frame_count && len < sizeof(buf); i++) {
+    len += (size_t)snprintf(buf + len, sizeof(buf) - len, " %p", site->frames[i]);
+  }
+  _mi_fprintf(NULL, NULL, "heap %p: %zu live blocks (%zu bytes) allocated at%s\n", (void*)heap, site->count, site->size, buf);
+  return true;
+}
+
+// Print the live blocks by allocation site (called from `mi_heap_destroy` if `mi_option_alloc_tags` is 2)
+void _mi_heap_tags_print_live(mi_heap_t* heap) {
+  mi_heap_dump_live(heap, &mi_live_site_print, NULL);
+}
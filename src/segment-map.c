@@ -81,7 +81,8 @@ static mi_segment_t* _mi_segment_of(const void* p) {
   }
   if (index==MI_SEGMENT_MAP_WSIZE) return NULL;
 
-  // TODO: maintain max/min allocated range for efficiency for more efficient rejection of invalid pointers?
+  // if all OS memory is in the up-front reservation we can reject pointers outside of it directly
+  if (_mi_os_reserve_is_complete() && !_mi_os_reserve_contains(p)) return NULL;
 
   // search downwards for the first segment in case it is an interior pointer
   // could be slow but searches in MI_INTPTR_SIZE * MI_SEGMENT_SIZE (512MiB) steps trough
@@ -124,6 +125,7 @@ static mi_segment_t* _mi_segment_of(const void* p) {
 }
 
 // Is this a valid pointer in our heap?
+// (with a complete up-front reservation both lookups reject pointers outside it with a single range check)
 static bool  mi_is_valid_pointer(const void* p) {
   return ((_mi_segment_of(p) != NULL) || (_mi_arena_contains(p)));
 }
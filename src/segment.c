@@ -14,6 +14,13 @@ terms of the MIT license. A copy of the license can be found in the file
 #define MI_PAGE_HUGE_ALIGN   (256*1024)
 
 static void mi_segment_try_purge(mi_segment_t* segment, bool force, mi_stats_t* stats);
+static void mi_abandoned_visited_push(mi_segment_t* segment);
+
+// The owner id of segments allocated or reclaimed through `tld`: usually the current
+// thread, but per-CPU heaps own their segments through a unique id.
+static inline mi_threadid_t mi_segments_owner_id(const mi_segments_tld_t* tld) {
+  return (tld->owner_id != 0 ? tld->owner_id : _mi_thread_id());
+}
 
 
 // -------------------------------------------------------------------
@@ -88,9 +95,7 @@ size_t _mi_commit_mask_committed_size(const mi_commit_mask_t* cm, size_t total)
       count += MI_COMMIT_MASK_FIELD_BITS;
     }
     else {
-      for (; mask != 0; mask >>= 1) {  // todo: use popcount
-        if ((mask&1)!=0) count++;
-      }
+      count += mi_popcount(mask);
     }
   }
   // we use total since for huge segments each commit bit may represent a larger size
@@ -256,7 +261,7 @@ static bool mi_segment_is_valid(mi_segment_t* segment, mi_segments_tld_t* tld) {
   mi_assert_internal(segment != NULL);
   mi_assert_internal(_mi_ptr_cookie(segment) == segment->cookie);
   mi_assert_internal(segment->abandoned <= segment->used);
-  mi_assert_internal(segment->thread_id == 0 || segment->thread_id == _mi_thread_id());
+  mi_assert_internal(segment->thread_id == 0 || segment->thread_id == mi_segments_owner_id(tld));
   mi_assert_internal(mi_commit_mask_all_set(&segment->commit_mask, &segment->purge_mask)); // can only decommit committed blocks
   //mi_assert_internal(segment->segment_info_size % MI_SEGMENT_SLICE_SIZE == 0);
   mi_slice_t* slice = &segment->slices[0];
@@ -482,7 +487,7 @@ static bool mi_segment_commit(mi_segment_t* segment, uint8_t* p, size_t size, mi
   
   // increase purge expiration when using part of delayed purges -- we assume more allocations are coming soon.
   if (mi_commit_mask_any_set(&segment->purge_mask, &mask)) {
-    segment->purge_expire = _mi_clock_now() + mi_option_get(mi_option_purge_delay);
+    segment->purge_expire = _mi_clock_now() + _mi_os_purge_delay();
   }
 
   // always clear any delayed purges in our range (as they are either committed now)
@@ -498,7 +503,67 @@ static bool mi_segment_ensure_committed(mi_segment_t* segment, uint8_t* p, size_
   return mi_segment_commit(segment, p, size, stats);
 }
 
-static bool mi_segment_purge(mi_segment_t* segment, uint8_t* p, size_t size, mi_stats_t* stats) {    
+// Purges of (possibly) several segments that are issued together in one batch. Ranges of
+// different segments are never adjacent (as each segment starts with its committed info slices)
+// but with `process_madvise` all ranges in the batch are still purged with a single system call.
+// The commit masks of the segments are only updated when the batch is flushed; segments that are
+// `release`d are pushed on the abandoned visited list after the flush (see `_mi_abandoned_collect`).
+#define MI_SEGMENTS_PURGE_MAX  (8)
+
+typedef struct mi_segments_purge_s {
+  mi_purge_batch_t  batch;
+  bool              release;                           // push the segments on the visited list after the flush?
+  size_t            count;                             // segments with ranges in the batch
+  mi_segment_t*     segments[MI_SEGMENTS_PURGE_MAX];
+  mi_commit_mask_t  purged[MI_SEGMENTS_PURGE_MAX];     // the purged ranges of each segment
+} mi_segments_purge_t;
+
+static void mi_segments_purge_init(mi_segments_purge_t* sp, bool release) {
+  _mi_os_purge_batch_init(&sp->batch);
+  sp->release = release;
+  sp->count = 0;
+}
+
+// Purge the ranges in the batch and update the commit masks for the purged ranges.
+// The `keep` segment is not released as more of its ranges are still being added.
+static void mi_segments_purge_flush(mi_segments_purge_t* sp, mi_segment_t* keep, mi_stats_t* stats) {
+  const bool decommitted = _mi_os_purge_batch_flush(&sp->batch, stats);  // reset or decommit
+  for (size_t i = 0; i < sp->count; i++) {
+    mi_segment_t* const segment = sp->segments[i];
+    mi_commit_mask_t* const purged = &sp->purged[i];
+    if (decommitted && !mi_commit_mask_is_empty(purged)) {
+      mi_commit_mask_t cmask;
+      mi_commit_mask_create_intersect(&segment->commit_mask, purged, &cmask);
+      _mi_stat_increase(&_mi_stats_main.committed, _mi_commit_mask_committed_size(purged, MI_SEGMENT_SIZE) - _mi_commit_mask_committed_size(&cmask, MI_SEGMENT_SIZE)); // adjust for double counting 
+      mi_commit_mask_clear(&segment->commit_mask, purged);
+    }
+    if (sp->release && segment != keep) { mi_abandoned_visited_push(segment); }
+  }
+  sp->count = 0;
+  if (keep != NULL) {
+    sp->segments[0] = keep;
+    mi_commit_mask_create_empty(&sp->purged[0]);
+    sp->count = 1;
+  }
+}
+
+// Add a range of `segment` to the batch (flushing it first if it is full)
+static void mi_segments_purge_add(mi_segments_purge_t* sp, mi_segment_t* segment, uint8_t* start, size_t full_size, const mi_commit_mask_t* mask, mi_stats_t* stats) {
+  if (sp->count == 0 || sp->segments[sp->count-1] != segment) {
+    if (sp->count >= MI_SEGMENTS_PURGE_MAX) { mi_segments_purge_flush(sp, NULL, stats); }
+    sp->segments[sp->count] = segment;
+    mi_commit_mask_create_empty(&sp->purged[sp->count]);
+    sp->count++;
+  }
+  if (!_mi_os_purge_batch_add(&sp->batch, start, full_size, true /* allow reset? */, stats)) {
+    mi_segments_purge_flush(sp, segment, stats);
+    _mi_os_purge_batch_add(&sp->batch, start, full_size, true, stats);
+  }
+  mi_commit_mask_set(&sp->purged[sp->count-1], mask);
+}
+
+// Add a range to the purge batch; the commit mask is updated when the batch is flushed
+static bool mi_segment_purge(mi_segment_t* segment, uint8_t* p, size_t size, mi_segments_purge_t* sp, mi_stats_t* stats) {    
   mi_assert_internal(mi_commit_mask_all_set(&segment->commit_mask, &segment->purge_mask));
   if (!segment->allow_purge) return true;
 
@@ -513,13 +578,7 @@ static bool mi_segment_purge(mi_segment_t* segment, uint8_t* p, size_t size, mi_
     // purging
     mi_assert_internal((void*)start != (void*)segment);
     mi_assert_internal(segment->allow_decommit);
-    const bool decommitted = _mi_os_purge(start, full_size, stats);  // reset or decommit
-    if (decommitted) {
-      mi_commit_mask_t cmask;
-      mi_commit_mask_create_intersect(&segment->commit_mask, &mask, &cmask);
-      _mi_stat_increase(&_mi_stats_main.committed, full_size - _mi_commit_mask_committed_size(&cmask, MI_SEGMENT_SIZE)); // adjust for double counting 
-      mi_commit_mask_clear(&segment->commit_mask, &mask);
-    }        
+    mi_segments_purge_add(sp, segment, start, full_size, &mask, stats);
   }
   
   // always clear any scheduled purges in our range
@@ -530,8 +589,11 @@ static bool mi_segment_purge(mi_segment_t* segment, uint8_t* p, size_t size, mi_
 static void mi_segment_schedule_purge(mi_segment_t* segment, uint8_t* p, size_t size, mi_stats_t* stats) {
   if (!segment->allow_purge) return;
 
-  if (mi_option_get(mi_option_purge_delay) == 0) {
-    mi_segment_purge(segment, p, size, stats);
+  if (_mi_os_purge_delay() == 0) {
+    mi_segments_purge_t sp;
+    mi_segments_purge_init(&sp, false);
+    mi_segment_purge(segment, p, size, &sp, stats);
+    mi_segments_purge_flush(&sp, NULL, stats);
   }
   else {
     // register for future purge in the purge mask
@@ -549,7 +611,7 @@ static void mi_segment_schedule_purge(mi_segment_t* segment, uint8_t* p, size_t
     mi_msecs_t now = _mi_clock_now();    
     if (segment->purge_expire == 0) {
       // no previous purgess, initialize now
-      segment->purge_expire = now + mi_option_get(mi_option_purge_delay);
+      segment->purge_expire = now + _mi_os_purge_delay();
     }
     else if (segment->purge_expire <= now) {
       // previous purge mask already expired
@@ -567,7 +629,8 @@ static void mi_segment_schedule_purge(mi_segment_t* segment, uint8_t* p, size_t
   }  
 }
 
-static void mi_segment_try_purge(mi_segment_t* segment, bool force, mi_stats_t* stats) {
+// Add the expired purges of a segment to the batch `sp`
+static void mi_segment_try_purge_ex(mi_segment_t* segment, bool force, mi_segments_purge_t* sp, mi_stats_t* stats) {
   if (!segment->allow_purge || mi_commit_mask_is_empty(&segment->purge_mask)) return;
   mi_msecs_t now = _mi_clock_now();
   if (!force && now < segment->purge_expire) return;
@@ -576,6 +639,7 @@ static void mi_segment_try_purge(mi_segment_t* segment, bool force, mi_stats_t*
   segment->purge_expire = 0;
   mi_commit_mask_create_empty(&segment->purge_mask);
 
+  // collect all sequences in the batch so they are purged with as few system calls as possible
   size_t idx;
   size_t count;
   mi_commit_mask_foreach(&mask, idx, count) {
@@ -583,13 +647,20 @@ static void mi_segment_try_purge(mi_segment_t* segment, bool force, mi_stats_t*
     if (count > 0) {
       uint8_t* p = (uint8_t*)segment + (idx*MI_COMMIT_SIZE);
       size_t size = count * MI_COMMIT_SIZE;
-      mi_segment_purge(segment, p, size, stats);
+      mi_segment_purge(segment, p, size, sp, stats);
     }
   }
   mi_commit_mask_foreach_end()
   mi_assert_internal(mi_commit_mask_is_empty(&segment->purge_mask));
 }
 
+static void mi_segment_try_purge(mi_segment_t* segment, bool force, mi_stats_t* stats) {
+  mi_segments_purge_t sp;
+  mi_segments_purge_init(&sp, false);
+  mi_segment_try_purge_ex(segment, force, &sp, stats);
+  mi_segments_purge_flush(&sp, NULL, stats);
+}
+
 
 /* -----------------------------------------------------------
    Span free
@@ -756,6 +827,28 @@ static void mi_segment_slice_split(mi_segment_t* segment, mi_slice_t* slice, siz
   slice->slice_count = (uint32_t)slice_count;
 }
 
+// After a thread migrated to another numa node, we no longer reuse free spans of the
+// segments on other nodes that were allocated (or reclaimed) before the migration;
+// instead we allocate a fresh segment that is local to the new node. Segments allocated
+// after the migration have the current epoch and are always used (even if remote) as
+// there was no local memory available at that point.
+// The node of the thread is the last one seen (see `mi_segments_numa_refresh`) so this
+// check never needs a system call.
+static bool mi_segment_is_numa_stale(const mi_segment_t* segment, const mi_segments_tld_t* tld) {
+  const int numa_node = tld->os->numa_node;  // -1 if not yet known (or if there is only one numa node)
+  return (numa_node >= 0 && segment->numa_node >= 0 && segment->numa_node != numa_node && segment->numa_epoch != tld->os->numa_epoch);
+}
+
+// Look up the numa node of the thread (which can take a system call) now and then to detect migration.
+// It is also looked up when a segment is allocated or reclaimed.
+#define MI_NUMA_REFRESH_HEARTBEATS  (64)
+
+static void mi_segments_numa_refresh(mi_heap_t* heap, mi_segments_tld_t* tld) {
+  if ((heap->tld->heartbeat % MI_NUMA_REFRESH_HEARTBEATS) == 0) {
+    _mi_os_numa_node(tld->os);
+  }
+}
+
 static mi_page_t* mi_segments_page_find_and_allocate(size_t slice_count, mi_arena_id_t req_arena_id, mi_segments_tld_t* tld) {
   mi_assert_internal(slice_count*MI_SEGMENT_SLICE_SIZE <= MI_LARGE_OBJ_SIZE_MAX);
   // search from best fit up
@@ -766,7 +859,8 @@ static mi_page_t* mi_segments_page_find_and_allocate(size_t slice_count, mi_aren
       if (slice->slice_count >= slice_count) {
         // found one
         mi_segment_t* segment = _mi_ptr_segment(slice);
-        if (_mi_arena_memid_is_suitable(segment->memid, req_arena_id)) {
+        // stale spans stay in the queue (and are skipped) so they are used again when the thread migrates back
+        if (_mi_arena_memid_is_suitable(segment->memid, req_arena_id) && !mi_segment_is_numa_stale(segment, tld)) {
           // found a suitable page span
           mi_span_queue_delete(sq, slice);
 
@@ -780,6 +874,9 @@ static mi_page_t* mi_segments_page_find_and_allocate(size_t slice_count, mi_aren
             mi_segment_span_free_coalesce(slice, tld);
             return NULL;
           }
+          if (segment->numa_node >= 0 && tld->os->numa_node >= 0 && segment->numa_node != tld->os->numa_node) {
+            _mi_stat_counter_increase(&tld->stats->pages_remote, 1);
+          }
           return page;
         }
       }
@@ -821,6 +918,8 @@ static mi_segment_t* mi_segment_os_alloc( size_t required, size_t page_alignment
   if (segment == NULL) {
     return NULL;  // failed to allocate
   }
+  // heaps in an exclusive arena (like caged heaps) must never receive memory from elsewhere
+  mi_assert_internal(_mi_arena_memid_is_suitable(memid, req_arena_id) || req_arena_id == _mi_arena_id_none());
 
   // ensure metadata part of the segment is committed  
   mi_commit_mask_t commit_mask; 
@@ -844,6 +943,9 @@ static mi_segment_t* mi_segment_os_alloc( size_t required, size_t page_alignment
   segment->allow_decommit = !memid.is_pinned;
   segment->allow_purge = segment->allow_decommit && (mi_option_get(mi_option_purge_delay) >= 0);
   segment->segment_size = segment_size;
+  segment->numa_node = _mi_arena_memid_numa_node(memid);   // -1 if the memory is not bound to a node
+  if (segment->numa_node < 0) { segment->numa_node = _mi_os_numa_node(os_tld); }  // assume first touch by this thread
+  segment->numa_epoch = os_tld->numa_epoch;
   segment->commit_mask = commit_mask;
   segment->purge_expire = 0;
   mi_commit_mask_create_empty(&segment->purge_mask);
@@ -889,7 +991,7 @@ static mi_segment_t* mi_segment_alloc(size_t required, size_t page_alignment, mi
   const size_t slice_entries = (segment_slices > MI_SLICES_PER_SEGMENT ? MI_SLICES_PER_SEGMENT : segment_slices);
   segment->segment_slices = segment_slices;
   segment->segment_info_slices = info_slices;
-  segment->thread_id = _mi_thread_id();
+  segment->thread_id = mi_segments_owner_id(tld);
   segment->cookie = _mi_ptr_cookie(segment);
   segment->slice_entries = slice_entries;
   segment->kind = (required == 0 ? MI_SEGMENT_NORMAL : MI_SEGMENT_HUGE);
@@ -932,6 +1034,8 @@ static mi_segment_t* mi_segment_alloc(size_t required, size_t page_alignment, mi
   }
 
   mi_assert_expensive(mi_segment_is_valid(segment,tld));
+  mi_probe2(segment_alloc, segment, mi_segment_size(segment));
+  mi_event(mi_event_segment_alloc, segment, mi_segment_size(segment));
   return segment;
 }
 
@@ -941,6 +1045,8 @@ static void mi_segment_free(mi_segment_t* segment, bool force, mi_segments_tld_t
   mi_assert_internal(segment != NULL);
   mi_assert_internal(segment->next == NULL);
   mi_assert_internal(segment->used == 0);
+  mi_probe2(segment_free, segment, mi_segment_size(segment));
+  mi_event(mi_event_segment_free, segment, mi_segment_size(segment));
 
   // Remove the free pages
   mi_slice_t* slice = &segment->slices[0];
@@ -994,6 +1100,9 @@ static mi_slice_t* mi_segment_page_clear(mi_page_t* page, mi_segments_tld_t* tld
     _mi_os_reset(start, psize, tld->stats);
   }
 
+  // free the allocation site tags
+  if mi_unlikely(page->tags != NULL) { _mi_page_tags_free(page); }
+
   // zero the page data, but not the segment fields
   page->is_zero_init = false;
   ptrdiff_t ofs = offsetof(mi_page_t, capacity);
@@ -1014,6 +1123,10 @@ void _mi_segment_page_free(mi_page_t* page, bool force, mi_segments_tld_t* tld)
 
   mi_segment_t* segment = _mi_page_segment(page);
   mi_assert_expensive(mi_segment_is_valid(segment,tld));
+  if (segment->kind == MI_SEGMENT_HUGE) {
+    mi_event(mi_event_huge_free, _mi_page_start(segment, page, NULL), mi_page_block_size(page));
+  }
+  mi_event(mi_event_page_retire, _mi_page_start(segment, page, NULL), (size_t)page->slice_count * MI_SEGMENT_SLICE_SIZE);
 
   // mark it as free now
   mi_segment_page_clear(page, tld);
@@ -1214,6 +1327,8 @@ static void mi_segment_abandon(mi_segment_t* segment, mi_segments_tld_t* tld) {
   mi_assert_internal(mi_atomic_load_ptr_relaxed(mi_segment_t, &segment->abandoned_next) == NULL);
   mi_assert_internal(segment->abandoned_visits == 0);
   mi_assert_expensive(mi_segment_is_valid(segment,tld));
+  mi_probe2(segment_abandon, segment, segment->used);
+  mi_event(mi_event_segment_abandon, segment, mi_segment_size(segment));
   
   // remove the free pages from the free page queues
   mi_slice_t* slice = &segment->slices[0];
@@ -1321,9 +1436,13 @@ static mi_segment_t* mi_segment_reclaim(mi_segment_t* segment, mi_heap_t* heap,
   mi_assert_internal(mi_atomic_load_ptr_relaxed(mi_segment_t, &segment->abandoned_next) == NULL);
   mi_assert_expensive(mi_segment_is_valid(segment, tld));
   if (right_page_reclaimed != NULL) { *right_page_reclaimed = false; }
+  mi_probe2(segment_reclaim, segment, heap);
+  mi_event(mi_event_segment_reclaim, segment, mi_segment_size(segment));
 
-  segment->thread_id = _mi_thread_id();
+  segment->thread_id = mi_segments_owner_id(tld);
   segment->abandoned_visits = 0;
+  _mi_os_numa_node(tld->os);                  // detect migration
+  segment->numa_epoch = tld->os->numa_epoch;  // the thread chose to reclaim it, so don't consider it stale
   mi_segments_track_size((long)mi_segment_size(segment), tld);
   mi_assert_internal(segment->next == NULL);
   _mi_stat_decrease(&tld->stats->segments_abandoned, 1);
@@ -1380,10 +1499,12 @@ static mi_segment_t* mi_segment_reclaim(mi_segment_t* segment, mi_heap_t* heap,
 
 
 void _mi_abandoned_reclaim_all(mi_heap_t* heap, mi_segments_tld_t* tld) {
+  const mi_ticks_t start = mi_latency_start();
   mi_segment_t* segment;
   while ((segment = mi_abandoned_pop()) != NULL) {
     mi_segment_reclaim(segment, heap, 0, NULL, tld);
   }
+  mi_latency_end(mi_latency_abandoned_reclaim, start);
 }
 
 static mi_segment_t* mi_segment_try_reclaim(mi_heap_t* heap, size_t needed_slices, size_t block_size, bool* reclaimed, mi_segments_tld_t* tld)
@@ -1432,6 +1553,10 @@ void _mi_abandoned_collect(mi_heap_t* heap, bool force, mi_segments_tld_t* tld)
   if (force) {
     mi_abandoned_visited_revisit(); 
   }
+  // purge the segments in one batch; segments with ranges in the batch are only pushed
+  // on the visited list after the batch is flushed (as they can be reclaimed from there)
+  mi_segments_purge_t sp;
+  mi_segments_purge_init(&sp, true /* release */);
   while ((max_tries-- > 0) && ((segment = mi_abandoned_pop()) != NULL)) {
     mi_segment_check_free(segment,0,0,tld); // try to free up pages (due to concurrent frees)
     if (segment->used == 0) {
@@ -1443,10 +1568,13 @@ void _mi_abandoned_collect(mi_heap_t* heap, bool force, mi_segments_tld_t* tld)
     else {
       // otherwise, purge if needed and push on the visited list 
       // note: forced purge can be expensive if many threads are destroyed/created as in mstress.
-      mi_segment_try_purge(segment, force, tld->stats);
-      mi_abandoned_visited_push(segment);
+      mi_segment_try_purge_ex(segment, force, &sp, tld->stats);
+      if (sp.count == 0 || sp.segments[sp.count-1] != segment) {
+        mi_abandoned_visited_push(segment);  // nothing to purge
+      }
     }
   }
+  mi_segments_purge_flush(&sp, NULL, tld->stats);
 }
 
 /* -----------------------------------------------------------
@@ -1483,6 +1611,8 @@ static mi_page_t* mi_segments_page_alloc(mi_heap_t* heap, mi_page_kind_t page_ki
 {
   mi_assert_internal(required <= MI_LARGE_OBJ_SIZE_MAX && page_kind <= MI_PAGE_LARGE);
 
+  mi_segments_numa_refresh(heap, tld);
+
   // find a free page
   size_t page_size = _mi_align_up(required, (required > MI_MEDIUM_PAGE_SIZE ? MI_MEDIUM_PAGE_SIZE : MI_SEGMENT_SLICE_SIZE));
   size_t slices_needed = page_size / MI_SEGMENT_SLICE_SIZE;
@@ -1490,7 +1620,10 @@ static mi_page_t* mi_segments_page_alloc(mi_heap_t* heap, mi_page_kind_t page_ki
   mi_page_t* page = mi_segments_page_find_and_allocate(slices_needed, heap->arena_id, tld); //(required <= MI_SMALL_SIZE_MAX ? 0 : slices_needed), tld);
   if (page==NULL) {
     // no free page, allocate a new segment and try again
-    if (mi_segment_reclaim_or_alloc(heap, slices_needed, block_size, tld, os_tld) == NULL) {
+    const mi_ticks_t start = mi_latency_start();
+    mi_segment_t* const segment = mi_segment_reclaim_or_alloc(heap, slices_needed, block_size, tld, os_tld);
+    mi_latency_end(mi_latency_segment_alloc, start);
+    if (segment == NULL) {
       // OOM or reclaimed a good page in the heap
       return NULL;  
     }
@@ -1500,7 +1633,7 @@ static mi_page_t* mi_segments_page_alloc(mi_heap_t* heap, mi_page_kind_t page_ki
     }
   }
   mi_assert_internal(page != NULL && page->slice_count*MI_SEGMENT_SLICE_SIZE == page_size);
-  mi_assert_internal(_mi_ptr_segment(page)->thread_id == _mi_thread_id());
+  mi_assert_internal(_mi_ptr_segment(page)->thread_id == mi_segments_owner_id(tld));
   mi_segment_try_purge(_mi_ptr_segment(page), false, tld->stats);
   return page;
 }
@@ -1517,6 +1650,9 @@ static mi_page_t* mi_segment_huge_page_alloc(size_t size, size_t page_alignment,
   mi_segment_t* segment = mi_segment_alloc(size,page_alignment,req_arena_id,tld,os_tld,&page);
   if (segment == NULL || page==NULL) return NULL;
   mi_assert_internal(segment->used==1);
+  if (segment->numa_node >= 0 && os_tld->numa_node >= 0 && segment->numa_node != os_tld->numa_node) {
+    _mi_stat_counter_increase(&tld->stats->pages_remote, 1);
+  }
   mi_assert_internal(mi_page_block_size(page) >= size);  
   #if MI_HUGE_PAGE_ABANDON
   segment->thread_id = 0; // huge segments are immediately abandoned
@@ -1617,3 +1753,137 @@ mi_page_t* _mi_segment_page_alloc(mi_heap_t* heap, size_t block_size, size_t pag
 }
 
 
+
+/* -----------------------------------------------------------
+   Fragmentation report
+
+   We find the segments owned by the calling thread through the
+   pages of its heaps (and those of the per-CPU heaps), and visit
+   a segment when we encounter its first page in use.
+----------------------------------------------------------- */
+
+// The first page in use after the segment info
+static const mi_page_t* mi_segment_first_page(const mi_segment_t* segment) {
+  const mi_slice_t* slice = &segment->slices[0];
+  const mi_slice_t* end = mi_segment_slices_end(segment);
+  slice = slice + slice->slice_count;  // skip the segment info
+  while (slice < end) {
+    mi_assert_internal(slice->slice_count > 0);
+    if (mi_slice_is_used(slice)) return mi_slice_to_page((mi_slice_t*)slice);
+    slice = slice + slice->slice_count;
+  }
+  return NULL;
+}
+
+static bool mi_segment_frag_visit(mi_segment_t* segment, mi_frag_visit_fun* visitor, void* arg) {
+  mi_frag_segment_t info;
+  _mi_memzero(&info, sizeof(info));
+  info.segment = segment;
+  info.size = mi_segment_size(segment);
+  info.slice_size = MI_SEGMENT_SLICE_SIZE;
+  info.slices = segment->segment_slices;
+  info.committed = _mi_commit_mask_committed_size(&segment->commit_mask, info.size);
+  info.pages = segment->used;
+  const mi_slice_t* slice = &segment->slices[0];
+  const mi_slice_t* end = mi_segment_slices_end(segment);
+  while (slice < end) {
+    const size_t count = slice->slice_count;
+    mi_assert_internal(count > 0);
+    if (mi_slice_is_used(slice)) {
+      info.used_slices += count;
+    }
+    else {
+      info.free_slices += count;
+      info.free_spans++;
+      if (count > info.largest_free_span) { info.largest_free_span = count; }
+    }
+    slice = slice + count;
+  }
+  if (!visitor(&info, NULL, arg)) return false;
+
+  // and the pages in use
+  slice = &segment->slices[0];
+  slice = slice + slice->slice_count;  // skip the segment info
+  while (slice < end) {
+    if (mi_slice_is_used(slice)) {
+      const mi_page_t* page = mi_slice_to_page((mi_slice_t*)slice);
+      mi_frag_page_t pinfo;
+      pinfo.start = _mi_page_start(segment, page, &pinfo.size);
+      pinfo.block_size = mi_page_block_size(page);
+      pinfo.used = page->used;
+      pinfo.capacity = page->capacity;
+      pinfo.reserved = page->reserved;
+      if (!visitor(&info, &pinfo, arg)) return false;
+    }
+    slice = slice + slice->slice_count;
+  }
+  return true;
+}
+
+typedef struct mi_frag_visit_args_s {
+  mi_frag_visit_fun* visitor;
+  void* arg;
+  bool  ok;
+} mi_frag_visit_args_t;
+
+static void mi_heaps_frag_visit(mi_heap_t* bheap, void* varg) {
+  mi_frag_visit_args_t* args = (mi_frag_visit_args_t*)varg;
+  for (mi_heap_t* heap = bheap->tld->heaps; heap != NULL && args->ok; heap = heap->next) {
+    for (size_t i = 0; i <= MI_BIN_FULL && args->ok; i++) {
+      for (mi_page_t* page = heap->pages[i].first; page != NULL && args->ok; page = page->next) {
+        mi_segment_t* segment = _mi_page_segment(page);
+        if (mi_segment_first_page(segment) == page) {
+          args->ok = mi_segment_frag_visit(segment, args->visitor, args->arg);
+        }
+      }
+    }
+  }
+}
+
+bool mi_frag_visit(mi_frag_visit_fun* visitor, void* arg) mi_attr_noexcept {
+  if (visitor == NULL) return false;
+  mi_frag_visit_args_t args = { visitor, arg, true };
+  mi_heaps_frag_visit(mi_heap_get_backing(), &args);
+  if (args.ok) { _mi_heap_cpu_visit(&mi_heaps_frag_visit, &args); }
+  return args.ok;
+}
+
+static bool mi_frag_report_visitor(const mi_frag_segment_t* segment, const mi_frag_page_t* page, void* arg) {
+  mi_frag_report_t* report = (mi_frag_report_t*)arg;
+  if (page == NULL) {
+    report->segments++;
+    report->slices += segment->slices;
+    report->used_slices += segment->used_slices;
+    report->free_slices += segment->free_slices;
+    report->free_spans += segment->free_spans;
+    report->largest_free_spans += segment->largest_free_span;
+    report->committed += segment->committed;
+    return true;
+  }
+  mi_frag_bin_t* bin = &report->bins[_mi_bin(page->block_size)];
+  const bool sparse = (4*page->used < page->reserved);
+  const size_t free = (page->reserved - page->used) * page->block_size;
+  bin->pages++;
+  bin->used += page->used;
+  bin->capacity += page->capacity;
+  bin->reserved += page->reserved;
+  report->pages++;
+  report->page_reserved += page->reserved * page->block_size;
+  report->page_used += page->used * page->block_size;
+  if (sparse) {
+    bin->sparse_pages++;
+    bin->sparse_free += free;
+    report->sparse_pages++;
+    report->sparse_free += free;
+  }
+  return true;
+}
+
+void mi_frag_get(mi_frag_report_t* report) mi_attr_noexcept {
+  if (report == NULL) return;
+  _mi_memzero(report, sizeof(*report));
+  for (size_t i = 0; i < MI_STATS_SNAPSHOT_BINS; i++) {
+    report->bins[i].block_size = _mi_bin_size((uint8_t)i);
+  }
+  mi_frag_visit(&mi_frag_report_visitor, report);
+}
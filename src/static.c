@@ -27,6 +27,7 @@ terms of the MIT license. A copy of the license can be found in the file
 #include "bitmap.c"
 #include "heap.c"
 #include "init.c"
+#include "libc.c"
 #if !defined(__ANDROID__)
 #include "options.c"
 #else /* __ANDROID__ */
@@ -34,6 +35,7 @@ terms of the MIT license. A copy of the license can be found in the file
 #endif /* __ANDROID__ */
 #include "os.c"
 #include "page.c"           // includes page-queue.c
+#include "profile.c"
 #include "random.c" 
 #include "segment.c"
 #include "segment-map.c"
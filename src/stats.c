@@ -16,7 +16,6 @@ terms of the MIT license. A copy of the license can be found in the file
 #pragma warning(disable:4204)  // non-constant aggregate initializer
 #endif
 
-#if !defined(__ANDROID__)
 /* -----------------------------------------------------------
   Statistics operations
 ----------------------------------------------------------- */
@@ -26,13 +25,23 @@ static bool mi_is_in_main(void* stat) {
          && (uint8_t*)stat < ((uint8_t*)&_mi_stats_main + sizeof(mi_stats_t)));
 }
 
+// Statistics are only ever updated by the thread that owns them. Updates to
+// `_mi_stats_main` (from code that has no thread local data at hand) go to the
+// same statistic of the current thread instead. Returns NULL if the current
+// thread has no statistics (during initialization or termination).
+static void* mi_stat_thread_local(void* stat) {
+  if mi_likely(!mi_is_in_main(stat)) return stat;
+  mi_heap_t* heap = mi_prim_get_default_heap();
+  if mi_unlikely(!mi_heap_is_initialized(heap)) return NULL;
+  return ((uint8_t*)&heap->tld->stats + ((uint8_t*)stat - (uint8_t*)&_mi_stats_main));
+}
+
 static void mi_stat_update(mi_stat_count_t* stat, int64_t amount) {
   if (amount == 0) return;
-  if (mi_is_in_main(stat))
-  {
-    // add atomically (for abandoned pages)
-    int64_t current = mi_atomic_addi64_relaxed(&stat->current, amount);
-    mi_atomic_maxi64_relaxed(&stat->peak, current + amount);
+  mi_stat_count_t* const local = (mi_stat_count_t*)mi_stat_thread_local(stat);
+  if mi_unlikely(local == NULL) {
+    // add atomically to the main statistics; the peak is updated on aggregation
+    mi_atomic_addi64_relaxed(&stat->current, amount);
     if (amount > 0) {
       mi_atomic_addi64_relaxed(&stat->allocated,amount);
     }
@@ -42,25 +51,44 @@ static void mi_stat_update(mi_stat_count_t* stat, int64_t amount) {
   }
   else {
     // add thread local
-    stat->current += amount;
-    if (stat->current > stat->peak) stat->peak = stat->current;
+    local->current += amount;
+    if (local->current > local->peak) local->peak = local->current;
     if (amount > 0) {
-      stat->allocated += amount;
+      local->allocated += amount;
     }
     else {
-      stat->freed += -amount;
+      local->freed += -amount;
     }
   }
 }
 
 void _mi_stat_counter_increase(mi_stat_counter_t* stat, size_t amount) {
-  if (mi_is_in_main(stat)) {
+  mi_stat_counter_t* const local = (mi_stat_counter_t*)mi_stat_thread_local(stat);
+  if mi_unlikely(local == NULL) {
     mi_atomic_addi64_relaxed( &stat->count, 1 );
     mi_atomic_addi64_relaxed( &stat->total, (int64_t)amount );
   }
   else {
-    stat->count++;
-    stat->total += amount;
+    local->count++;
+    local->total += amount;
+  }
+}
+
+void _mi_stat_latency(mi_latency_kind_t kind, uint64_t ticks) {
+  mi_assert_internal(kind < _mi_latency_last);
+  // bucket `i > 0` holds `[2^(i-1), 2^i)` ticks, the last bucket holds everything longer
+  const size_t bucket = (ticks == 0 ? 0 : (ticks >= ((uint64_t)1 << (MI_STATS_LATENCY_BUCKETS - 2)) ? MI_STATS_LATENCY_BUCKETS - 1 : mi_bsr((uintptr_t)ticks) + 1));
+  mi_stat_latency_t* const stat = &_mi_stats_main.latency[kind];
+  mi_stat_latency_t* const local = (mi_stat_latency_t*)mi_stat_thread_local(stat);
+  if mi_unlikely(local == NULL) {
+    mi_atomic_addi64_relaxed(&stat->count, 1);
+    mi_atomic_addi64_relaxed(&stat->total, (int64_t)ticks);
+    mi_atomic_addi64_relaxed(&stat->buckets[bucket], 1);
+  }
+  else {
+    local->count++;
+    local->total += (int64_t)ticks;
+    local->buckets[bucket]++;
   }
 }
 
@@ -79,8 +107,8 @@ static void mi_stat_add(mi_stat_count_t* stat, const mi_stat_count_t* src, int64
   mi_atomic_addi64_relaxed( &stat->allocated, src->allocated * unit);
   mi_atomic_addi64_relaxed( &stat->current, src->current * unit);
   mi_atomic_addi64_relaxed( &stat->freed, src->freed * unit);
-  // peak scores do not work across threads..
-  mi_atomic_addi64_relaxed( &stat->peak, src->peak * unit);
+  // peak scores do not add up across threads, but the total peak is at least that of each thread (see `mi_stat_peak_update`)
+  mi_atomic_maxi64_relaxed( &stat->peak, src->peak * unit);
 }
 
 static void mi_stat_counter_add(mi_stat_counter_t* stat, const mi_stat_counter_t* src, int64_t unit) {
@@ -89,6 +117,15 @@ static void mi_stat_counter_add(mi_stat_counter_t* stat, const mi_stat_counter_t
   mi_atomic_addi64_relaxed( &stat->count, src->count * unit);
 }
 
+static void mi_stat_latency_add(mi_stat_latency_t* stat, const mi_stat_latency_t* src) {
+  if (stat==src || src->count==0) return;
+  mi_atomic_addi64_relaxed( &stat->count, src->count);
+  mi_atomic_addi64_relaxed( &stat->total, src->total);
+  for (size_t i = 0; i < MI_STATS_LATENCY_BUCKETS; i++) {
+    if (src->buckets[i] != 0) { mi_atomic_addi64_relaxed( &stat->buckets[i], src->buckets[i]); }
+  }
+}
+
 // must be thread safe as it is called from stats_merge
 static void mi_stats_add(mi_stats_t* stats, const mi_stats_t* src) {
   if (stats==src) return;
@@ -121,6 +158,14 @@ static void mi_stats_add(mi_stats_t* stats, const mi_stats_t* src) {
   mi_stat_counter_add(&stats->normal_count, &src->normal_count, 1);
   mi_stat_counter_add(&stats->huge_count, &src->huge_count, 1);
   mi_stat_counter_add(&stats->large_count, &src->large_count, 1);
+  mi_stat_counter_add(&stats->pages_remote, &src->pages_remote, 1);
+  mi_stat_counter_add(&stats->numa_migrations, &src->numa_migrations, 1);
+  mi_stat_counter_add(&stats->free_mt, &src->free_mt, 1);
+  mi_stat_counter_add(&stats->free_mt_retries, &src->free_mt_retries, 1);
+  mi_stat_counter_add(&stats->free_delayed, &src->free_delayed, 1);
+  for (size_t i = 0; i < _mi_latency_last; i++) {
+    mi_stat_latency_add(&stats->latency[i], &src->latency[i]);
+  }
 #if MI_STAT>1
   for (size_t i = 0; i <= MI_BIN_HUGE; i++) {
     if (src->normal_bins[i].allocated > 0 || src->normal_bins[i].freed > 0) {
@@ -130,6 +175,40 @@ static void mi_stats_add(mi_stats_t* stats, const mi_stats_t* src) {
 #endif
 }
 
+/* -----------------------------------------------------------
+  Latency histograms
+----------------------------------------------------------- */
+
+static const char* mi_latency_names[_mi_latency_last] = {
+  "malloc_generic", "segment_alloc", "os_commit", "arena_purge", "abandoned_reclaim",
+  "prim_alloc", "prim_commit", "prim_decommit", "prim_reset", "prim_purge_batch"
+};
+
+// Return the bucket that contains the `permille` percentile
+static size_t mi_stat_latency_percentile(const mi_stat_latency_t* stat, int64_t permille) {
+  const int64_t target = (stat->count * permille + 999) / 1000;
+  int64_t sum = 0;
+  for (size_t i = 0; i < MI_STATS_LATENCY_BUCKETS; i++) {
+    sum += stat->buckets[i];
+    if (sum >= target) return i;
+  }
+  return MI_STATS_LATENCY_BUCKETS - 1;
+}
+
+// Format one line with the count, the average, and the upper bound of the 50, 99, and 99.9 percentiles
+// of a latency histogram (in timestamp counter ticks). Returns `false` if there were no calls.
+bool _mi_stat_latency_format(const mi_stat_latency_t* stat, mi_latency_kind_t kind, char* buf, size_t len) {
+  if (stat->count <= 0) return false;
+  const size_t p50  = mi_stat_latency_percentile(stat, 500);
+  const size_t p99  = mi_stat_latency_percentile(stat, 990);
+  const size_t p999 = mi_stat_latency_percentile(stat, 999);
+  snprintf(buf, len, "%17s: %10lld calls, avg %8lld, p50 < 2^%zu, p99 < 2^%zu, p99.9 < 2^%zu%s ticks\n",
+           mi_latency_names[kind], (long long)stat->count, (long long)(stat->total / stat->count),
+           p50, p99, p999, (p999 == MI_STATS_LATENCY_BUCKETS - 1 ? "+" : ""));
+  return true;
+}
+
+#if !defined(__ANDROID__)  // Android prints a smaller set of statistics (see `android-stats.c`)
 /* -----------------------------------------------------------
   Display statistics
 ----------------------------------------------------------- */
@@ -324,6 +403,7 @@ static void _mi_stats_print(mi_stats_t* stats, mi_output_fun* out0, void* arg0)
   mi_stat_add(&total, &stats->normal, 1);
   mi_stat_add(&total, &stats->large, 1);
   mi_stat_add(&total, &stats->huge, 1);
+  total.peak = stats->normal.peak + stats->large.peak + stats->huge.peak;  // an upper bound
   mi_stat_print(&total, "total", 1, out, arg);
   #endif
   #if MI_STAT>1
@@ -342,6 +422,7 @@ static void _mi_stats_print(mi_stats_t* stats, mi_output_fun* out0, void* arg0)
   mi_stat_print(&stats->pages_abandoned, "-abandoned", -1, out, arg);
   mi_stat_counter_print(&stats->pages_extended, "-extended", out, arg);
   mi_stat_counter_print(&stats->page_no_retire, "-noretire", out, arg);
+  mi_stat_counter_print(&stats->pages_remote, "-remote", out, arg);
   mi_stat_counter_print(&stats->mmap_calls, "mmaps", out, arg);
   mi_stat_counter_print(&stats->commit_calls, "commits", out, arg);
   mi_stat_counter_print(&stats->reset_calls, "resets", out, arg);
@@ -349,6 +430,18 @@ static void _mi_stats_print(mi_stats_t* stats, mi_output_fun* out0, void* arg0)
   mi_stat_print(&stats->threads, "threads", -1, out, arg);
   mi_stat_counter_print_avg(&stats->searches, "searches", out, arg);
   _mi_fprintf(out, arg, "%10s: %5zu\n", "numa nodes", _mi_os_numa_node_count());
+  mi_stat_counter_print(&stats->numa_migrations, "migrations", out, arg);
+  #if MI_STAT
+  mi_stat_counter_print(&stats->free_mt, "xfrees", out, arg);
+  mi_stat_counter_print(&stats->free_mt_retries, "-retries", out, arg);
+  mi_stat_counter_print(&stats->free_delayed, "-delayed", out, arg);
+  #endif
+  for (size_t i = 0; i < _mi_latency_last; i++) {
+    char line[128];
+    if (_mi_stat_latency_format(&stats->latency[i], (mi_latency_kind_t)i, line, sizeof(line))) {
+      _mi_fputs(out, arg, NULL, line);
+    }
+  }
 
   size_t elapsed;
   size_t user_time;
@@ -369,6 +462,7 @@ static void _mi_stats_print(mi_stats_t* stats, mi_output_fun* out0, void* arg0)
   }
   _mi_fprintf(out, arg, "\n");
 }
+#endif /* __ANDROID__ */
 
 static mi_msecs_t mi_process_start; // = 0
 
@@ -377,13 +471,108 @@ static mi_stats_t* mi_stats_get_default(void) {
   return &heap->tld->stats;
 }
 
+/* -----------------------------------------------------------
+  The statistics of all live threads (and per-CPU heaps) are kept
+  in a list so a reader can aggregate them without stopping the
+  threads. The lock is only taken on thread creation and termination,
+  when merging, and when aggregating; the statistics themselves
+  are updated by the owning thread with plain stores.
+----------------------------------------------------------- */
+
+#define MI_STATS_COUNTS(X) \
+  X(segments) X(pages) X(reserved) X(committed) X(reset) X(purged) X(page_committed) \
+  X(segments_abandoned) X(pages_abandoned) X(threads) X(normal) X(huge) X(large) X(malloc) X(segments_cache)
+
+#define MI_STATS_COUNTERS(X) \
+  X(pages_extended) X(mmap_calls) X(commit_calls) X(reset_calls) X(purge_calls) X(page_no_retire) \
+  X(searches) X(normal_count) X(huge_count) X(large_count) X(pages_remote) X(numa_migrations) \
+  X(free_mt) X(free_mt_retries) X(free_delayed)
+
+static mi_tld_t*          mi_stats_threads;       // = NULL
+static _Atomic(uintptr_t) mi_stats_threads_lock;  // = 0
+
+static void mi_stats_threads_acquire(void) {
+  uintptr_t expected = 0;
+  while (!mi_atomic_cas_weak_acq_rel(&mi_stats_threads_lock, &expected, (uintptr_t)1)) {
+    expected = 0;
+    mi_atomic_yield();
+  }
+}
+
+static void mi_stats_threads_release(void) {
+  mi_atomic_store_release(&mi_stats_threads_lock, (uintptr_t)0);
+}
+
+// hold the lock over a `fork` so the child never inherits it locked (or the list half updated)
+void _mi_stats_init(void) {
+  _mi_prim_atfork(&mi_stats_threads_acquire, &mi_stats_threads_release, &mi_stats_threads_release);
+}
+
+void _mi_stats_register(mi_tld_t* tld) {
+  mi_stats_threads_acquire();
+  tld->stats_prev = NULL;
+  tld->stats_next = mi_stats_threads;
+  if (mi_stats_threads != NULL) { mi_stats_threads->stats_prev = tld; }
+  mi_stats_threads = tld;
+  mi_stats_threads_release();
+}
+
+// The peak of a sum cannot be tracked by the threads themselves without a shared
+// atomic on every update. Instead, the peak of each statistic in `_mi_stats_main`
+// is raised to the total current value whenever the statistics are aggregated, and
+// to the peak of each thread (which `mi_stat_add` takes the maximum of, also when a
+// thread merges or terminates). So it never double counts, is always at least the
+// current value, and does not miss the peak of a thread between aggregations.
+static void mi_stat_peak_update(mi_stat_count_t* total, mi_stat_count_t* main) {
+  mi_atomic_maxi64_relaxed(&main->peak, (total->peak > total->current ? total->peak : total->current));
+  total->peak = mi_atomic_loadi64_relaxed(&main->peak);
+}
+
+// Sum the main statistics and those of all live threads (called with the lock held)
+static void mi_stats_aggregate_locked(mi_stats_t* stats) {
+  memset(stats, 0, sizeof(mi_stats_t));
+  mi_stats_add(stats, &_mi_stats_main);
+  for (const mi_tld_t* tld = mi_stats_threads; tld != NULL; tld = tld->stats_next) {
+    mi_stats_add(stats, &tld->stats);
+  }
+  #define MI_STAT_PEAK_UPDATE(name)  mi_stat_peak_update(&stats->name, &_mi_stats_main.name);
+  MI_STATS_COUNTS(MI_STAT_PEAK_UPDATE)
+  #undef MI_STAT_PEAK_UPDATE
+  #if MI_STAT>1
+  for (size_t i = 0; i <= MI_BIN_HUGE; i++) {
+    mi_stat_peak_update(&stats->normal_bins[i], &_mi_stats_main.normal_bins[i]);
+  }
+  #endif
+}
+
+// Aggregate the statistics of the whole process into `stats`; the threads keep
+// running so their statistics can be slightly out of date but are never counted twice.
+void _mi_stats_aggregate(mi_stats_t* stats) {
+  mi_stats_threads_acquire();
+  mi_stats_aggregate_locked(stats);
+  mi_stats_threads_release();
+}
+
 static void mi_stats_merge_from(mi_stats_t* stats) {
   if (stats != &_mi_stats_main) {
+    mi_stats_threads_acquire();  // so a concurrent aggregation does not count the statistics twice
     mi_stats_add(&_mi_stats_main, stats);
     memset(stats, 0, sizeof(mi_stats_t));
+    mi_stats_threads_release();
   }
 }
 
+void _mi_stats_unregister(mi_tld_t* tld) {
+  mi_stats_threads_acquire();
+  mi_stats_add(&_mi_stats_main, &tld->stats);
+  memset(&tld->stats, 0, sizeof(mi_stats_t));
+  if (tld->stats_prev != NULL) { tld->stats_prev->stats_next = tld->stats_next; }
+                          else { mi_stats_threads = tld->stats_next; }
+  if (tld->stats_next != NULL) { tld->stats_next->stats_prev = tld->stats_prev; }
+  tld->stats_next = tld->stats_prev = NULL;
+  mi_stats_threads_release();
+}
+
 void mi_stats_reset(void) mi_attr_noexcept {
   mi_stats_t* stats = mi_stats_get_default();
   if (stats != &_mi_stats_main) { memset(stats, 0, sizeof(mi_stats_t)); }
@@ -393,15 +582,170 @@ void mi_stats_reset(void) mi_attr_noexcept {
 
 void mi_stats_merge(void) mi_attr_noexcept {
   mi_stats_merge_from( mi_stats_get_default() );
+  _mi_heap_cpu_stats_merge();
 }
 
 void _mi_stats_done(mi_stats_t* stats) {  // called from `mi_thread_done`
   mi_stats_merge_from(stats);
 }
 
+
+/* -----------------------------------------------------------
+  Statistics snapshot
+----------------------------------------------------------- */
+
+// the public snapshot must have room for all bins and latency kinds (checked at compile time)
+typedef char mi_stats_snapshot_bins_check[(MI_STATS_SNAPSHOT_BINS == MI_BIN_HUGE+1) ? 1 : -1];
+typedef char mi_stats_snapshot_latency_check[(_mi_latency_last <= MI_STATS_LATENCY_KINDS) ? 1 : -1];
+
+static void mi_stat_count_snapshot(mi_stat_count_snapshot_t* dst, const mi_stat_count_t* src) {
+  dst->allocated = src->allocated;
+  dst->freed     = src->freed;
+  dst->peak      = src->peak;
+  dst->current   = src->current;
+}
+
+static void mi_stat_counter_snapshot(mi_stat_counter_snapshot_t* dst, const mi_stat_counter_t* src) {
+  dst->total = src->total;
+  dst->count = src->count;
+}
+
+static void mi_stats_snapshot(mi_stats_snapshot_t* snapshot) {
+  mi_stats_t stats;
+  _mi_stats_aggregate(&stats);
+
+  memset(snapshot, 0, sizeof(*snapshot));
+  snapshot->version = MI_STATS_SNAPSHOT_VERSION;
+  snapshot->size = sizeof(*snapshot);
+  #define MI_STAT_COUNT_SNAPSHOT(name)    mi_stat_count_snapshot(&snapshot->name, &stats.name);
+  #define MI_STAT_COUNTER_SNAPSHOT(name)  mi_stat_counter_snapshot(&snapshot->name, &stats.name);
+  MI_STATS_COUNTS(MI_STAT_COUNT_SNAPSHOT)
+  MI_STATS_COUNTERS(MI_STAT_COUNTER_SNAPSHOT)
+  #undef MI_STAT_COUNT_SNAPSHOT
+  #undef MI_STAT_COUNTER_SNAPSHOT
+  #if MI_STAT>1
+  for (size_t i = 0; i <= MI_BIN_HUGE; i++) {
+    mi_stat_count_snapshot(&snapshot->normal_bins[i], &stats.normal_bins[i]);
+  }
+  #endif
+  for (size_t i = 0; i < _mi_latency_last; i++) {
+    mi_stat_latency_snapshot_t* const dst = &snapshot->latency[i];
+    dst->count = stats.latency[i].count;
+    dst->total = stats.latency[i].total;
+    for (size_t j = 0; j < MI_STATS_LATENCY_BUCKETS; j++) { dst->buckets[j] = stats.latency[i].buckets[j]; }
+  }
+}
+
+bool mi_stats_get(mi_stats_snapshot_t* stats, size_t size) mi_attr_noexcept {
+  if (stats == NULL || size < offsetof(mi_stats_snapshot_t, segments)) return false;
+  mi_stats_snapshot_t snapshot;
+  mi_stats_snapshot(&snapshot);
+  if (size < sizeof(snapshot)) { snapshot.size = size; }
+  _mi_memcpy(stats, &snapshot, snapshot.size);
+  return true;
+}
+
+static void mi_stats_json_out(mi_output_fun* out, void* arg, const char* msg) {
+  #if defined(__ANDROID__)
+  // the regular output functions are disabled on Android
+  if (out == NULL || (void*)out == (void*)stdout || (void*)out == (void*)stderr) {
+    _mi_prim_out_stderr(msg);
+  }
+  else {
+    out(msg, arg);
+  }
+  #else
+  _mi_fputs(out, arg, NULL, msg);
+  #endif
+}
+
+static void mi_stat_count_json(const mi_stat_count_snapshot_t* stat, const char* name, bool first, mi_output_fun* out, void* arg) {
+  char buf[192];
+  snprintf(buf, sizeof(buf), "%s\"%s\":{\"allocated\":%lld,\"freed\":%lld,\"peak\":%lld,\"current\":%lld}",
+           (first ? "" : ","), name, (long long)stat->allocated, (long long)stat->freed, (long long)stat->peak, (long long)stat->current);
+  mi_stats_json_out(out, arg, buf);
+}
+
+static void mi_stat_counter_json(const mi_stat_counter_snapshot_t* stat, const char* name, mi_output_fun* out, void* arg) {
+  char buf[128];
+  snprintf(buf, sizeof(buf), ",\"%s\":{\"total\":%lld,\"count\":%lld}", name, (long long)stat->total, (long long)stat->count);
+  mi_stats_json_out(out, arg, buf);
+}
+
+// Print the same data as `mi_stats_get` as a single line of JSON.
+// Bins that were never used are omitted from `normal_bins`, which maps the block size to the statistics,
+// and so are the histograms without any calls from `latency`.
+void mi_stats_print_json(mi_output_fun* out, void* arg) mi_attr_noexcept {
+  mi_stats_snapshot_t snapshot;
+  mi_stats_snapshot(&snapshot);
+  char buf[128];
+  snprintf(buf, sizeof(buf), "{\"version\":%zu", snapshot.version);
+  mi_stats_json_out(out, arg, buf);
+  #define MI_STAT_COUNT_JSON(name)    mi_stat_count_json(&snapshot.name, #name, false, out, arg);
+  #define MI_STAT_COUNTER_JSON(name)  mi_stat_counter_json(&snapshot.name, #name, out, arg);
+  MI_STATS_COUNTS(MI_STAT_COUNT_JSON)
+  MI_STATS_COUNTERS(MI_STAT_COUNTER_JSON)
+  #undef MI_STAT_COUNT_JSON
+  #undef MI_STAT_COUNTER_JSON
+  mi_stats_json_out(out, arg, ",\"normal_bins\":{");
+  bool first = true;
+  for (size_t i = 0; i < MI_STATS_SNAPSHOT_BINS; i++) {
+    const mi_stat_count_snapshot_t* bin = &snapshot.normal_bins[i];
+    if (bin->allocated == 0 && bin->freed == 0) continue;
+    snprintf(buf, sizeof(buf), "%zu", _mi_bin_size((uint8_t)i));
+    mi_stat_count_json(bin, buf, first, out, arg);
+    first = false;
+  }
+  mi_stats_json_out(out, arg, "},\"latency\":{");
+  first = true;
+  for (size_t i = 0; i < _mi_latency_last; i++) {
+    const mi_stat_latency_snapshot_t* lat = &snapshot.latency[i];
+    if (lat->count == 0) continue;
+    snprintf(buf, sizeof(buf), "%s\"%s\":{\"count\":%lld,\"total\":%lld,\"buckets\":[", (first ? "" : ","),
+             mi_latency_names[i], (long long)lat->count, (long long)lat->total);
+    mi_stats_json_out(out, arg, buf);
+    for (size_t j = 0; j < MI_STATS_LATENCY_BUCKETS; j++) {
+      snprintf(buf, sizeof(buf), "%s%lld", (j == 0 ? "" : ","), (long long)lat->buckets[j]);
+      mi_stats_json_out(out, arg, buf);
+    }
+    mi_stats_json_out(out, arg, "]}");
+    first = false;
+  }
+  mi_stats_json_out(out, arg, "}}\n");
+}
+
+// Print the fragmentation report of `mi_frag_get` as a single line of JSON with two ratios:
+// `external` is the part of the free slices that is not in the largest free span of its segment,
+// and `utilization` is the part of the page blocks that is in use. Unused size classes are omitted from `bins`.
+void mi_frag_print_json(mi_output_fun* out, void* arg) mi_attr_noexcept {
+  mi_frag_report_t report;
+  mi_frag_get(&report);
+  const double external = (report.free_slices == 0 ? 0.0 : 1.0 - ((double)report.largest_free_spans / (double)report.free_slices));
+  const double utilization = (report.page_reserved == 0 ? 1.0 : (double)report.page_used / (double)report.page_reserved);
+  char buf[256];
+  snprintf(buf, sizeof(buf), "{\"segments\":%zu,\"slices\":%zu,\"used_slices\":%zu,\"free_slices\":%zu,\"free_spans\":%zu,\"largest_free_spans\":%zu,\"committed\":%zu,\"external\":%.4f",
+           report.segments, report.slices, report.used_slices, report.free_slices, report.free_spans, report.largest_free_spans, report.committed, external);
+  mi_stats_json_out(out, arg, buf);
+  snprintf(buf, sizeof(buf), ",\"pages\":%zu,\"page_reserved\":%zu,\"page_used\":%zu,\"utilization\":%.4f,\"sparse_pages\":%zu,\"sparse_free\":%zu,\"bins\":{",
+           report.pages, report.page_reserved, report.page_used, utilization, report.sparse_pages, report.sparse_free);
+  mi_stats_json_out(out, arg, buf);
+  bool first = true;
+  for (size_t i = 0; i < MI_STATS_SNAPSHOT_BINS; i++) {
+    const mi_frag_bin_t* bin = &report.bins[i];
+    if (bin->pages == 0) continue;
+    snprintf(buf, sizeof(buf), "%s\"%zu\":{\"pages\":%zu,\"used\":%zu,\"capacity\":%zu,\"reserved\":%zu,\"sparse_pages\":%zu,\"sparse_free\":%zu}",
+             (first ? "" : ","), bin->block_size, bin->pages, bin->used, bin->capacity, bin->reserved, bin->sparse_pages, bin->sparse_free);
+    mi_stats_json_out(out, arg, buf);
+    first = false;
+  }
+  mi_stats_json_out(out, arg, "}}\n");
+}
+
+#if !defined(__ANDROID__)
 void mi_stats_print_out(mi_output_fun* out, void* arg) mi_attr_noexcept {
-  mi_stats_merge_from(mi_stats_get_default());
-  _mi_stats_print(&_mi_stats_main, out, arg);
+  mi_stats_t stats;
+  _mi_stats_aggregate(&stats);
+  _mi_stats_print(&stats, out, arg);
 }
 
 void mi_stats_print(void* out) mi_attr_noexcept {
@@ -439,7 +783,6 @@ mi_msecs_t _mi_clock_end(mi_msecs_t start) {
 }
 
 
-#if !defined(__ANDROID__)
 // --------------------------------------------------------
 // Basic process statistics
 // --------------------------------------------------------
@@ -449,8 +792,10 @@ mi_decl_export void mi_process_info(size_t* elapsed_msecs, size_t* user_msecs, s
   mi_process_info_t pinfo;
   _mi_memzero_var(pinfo);
   pinfo.elapsed        = _mi_clock_end(mi_process_start);
-  pinfo.current_commit = (size_t)(mi_atomic_loadi64_relaxed((_Atomic(int64_t)*)&_mi_stats_main.committed.current));
-  pinfo.peak_commit    = (size_t)(mi_atomic_loadi64_relaxed((_Atomic(int64_t)*)&_mi_stats_main.committed.peak));
+  mi_stats_t stats;
+  _mi_stats_aggregate(&stats);
+  pinfo.current_commit = (size_t)(stats.committed.current);
+  pinfo.peak_commit    = (size_t)(stats.committed.peak);
   pinfo.current_rss    = pinfo.current_commit;
   pinfo.peak_rss       = pinfo.peak_commit;
   pinfo.utime          = 0;
@@ -468,10 +813,53 @@ mi_decl_export void mi_process_info(size_t* elapsed_msecs, size_t* user_msecs, s
   if (peak_commit!=NULL)    *peak_commit    = pinfo.peak_commit;
   if (page_faults!=NULL)    *page_faults    = pinfo.page_faults;
 }
-#endif /* __ANDROID__ */
 
 mi_decl_nodiscard mi_decl_restrict struct mallinfo mi_mallinfo() mi_attr_noexcept {
   struct mallinfo mi;
   memset(&mi, 0, sizeof(mi));
   return mi;
 }
+
+
+// --------------------------------------------------------
+// Allocator events
+// --------------------------------------------------------
+
+// The callback and its argument are published together under a sequence lock: a
+// registration makes `mi_event_seq` odd while it writes both, and an emit retries
+// until it reads them under the same even sequence number. This way an event never
+// calls the new callback with the old argument (or the other way around).
+_Atomic(mi_event_fun*)    _mi_event_fun;       // = NULL
+static _Atomic(void*)     mi_event_arg;        // = NULL
+static _Atomic(uintptr_t) mi_event_seq;        // = 0
+static mi_decl_thread bool mi_event_recurse;   // = false
+
+void _mi_event_emit(mi_event_t event, void* p, size_t size) {
+  if (mi_event_recurse) return;
+  mi_event_fun* fun;
+  void* arg;
+  uintptr_t seq;
+  do {
+    seq = mi_atomic_load_acquire(&mi_event_seq);
+    fun = mi_atomic_load_ptr_acquire(mi_event_fun, &_mi_event_fun);
+    arg = mi_atomic_load_ptr_acquire(void, &mi_event_arg);
+  } while ((seq & 1) != 0 || mi_atomic_load_acquire(&mi_event_seq) != seq);
+  if (fun == NULL) return;
+  mi_event_recurse = true;
+  fun(event, p, size, arg);
+  mi_event_recurse = false;
+}
+
+void mi_register_event(mi_event_fun* fun, void* arg) mi_attr_noexcept {
+  uintptr_t seq;
+  do {
+    seq = mi_atomic_load_relaxed(&mi_event_seq);
+    while ((seq & 1) != 0) {  // another registration is in progress
+      mi_atomic_yield();
+      seq = mi_atomic_load_relaxed(&mi_event_seq);
+    }
+  } while (!mi_atomic_cas_weak_acq_rel(&mi_event_seq, &seq, seq + 1));
+  mi_atomic_store_ptr_release(void, &mi_event_arg, arg);
+  mi_atomic_store_ptr_release(mi_event_fun, &_mi_event_fun, fun);
+  mi_atomic_store_release(&mi_event_seq, seq + 2);
+}
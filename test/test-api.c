@@ -7,6 +7,9 @@ terms of the MIT license. A copy of the license can be found in the file
 #if defined(__GNUC__) && !defined(__clang__)
 #pragma GCC diagnostic ignored "-Walloc-size-larger-than="
 #endif
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE   // sched_setaffinity
+#endif
 
 /*
 Testing allocators is difficult as bugs may only surface after particular
@@ -27,11 +30,19 @@ we therefore test the API over various inputs. Please add more tests :-)
 #include <stdbool.h>
 #include <stdint.h>
 #include <errno.h>
+#include <string.h>
 
 #ifdef __cplusplus
 #include <vector>
 #endif
 
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
 #include "mimalloc.h"
 // #include "mimalloc/internal.h"
 #include "mimalloc/types.h" // for MI_DEBUG and MI_ALIGNMENT_MAX
@@ -43,9 +54,32 @@ we therefore test the API over various inputs. Please add more tests :-)
 // ---------------------------------------------------------------------------
 bool test_heap1(void);
 bool test_heap2(void);
+bool test_heap_snapshot(void);
+bool test_heap_caged(void);
+bool test_arena_info(void);
+bool test_os_reserve(void);
+bool test_purge_batch(void);
+bool test_purge_commit(void);
+bool test_numa_local(void);
+bool test_reserve_huge(void);
+bool test_stats_get(void);
+bool test_stats_peak(void);
+bool test_heap_profile(void);
+bool test_stats_latency(void);
+bool test_frag_report(void);
+bool test_alloc_tags(void);
+bool test_events(void);
+bool test_events_register(void);
+bool test_percpu_heaps(void);
+bool test_memory_limit(void);
 bool test_stl_allocator1(void);
 bool test_stl_allocator2(void);
 
+static void test_watermark(size_t level, size_t usage, size_t limit, void* arg) {
+  (void)level; (void)usage; (void)limit;
+  if (arg != NULL) { (*(size_t*)arg)++; }
+}
+
 bool mem_is_zero(uint8_t* p, size_t size) {
   if (p==NULL) return false;
   for (size_t i = 0; i < size; ++i) {
@@ -289,6 +323,14 @@ int main(void) {
   // ---------------------------------------------------
   CHECK("heap_destroy", test_heap1());
   CHECK("heap_delete", test_heap2());
+  CHECK("heap_snapshot", test_heap_snapshot());
+  CHECK("heap_caged", test_heap_caged());
+  CHECK("arena_info", test_arena_info());
+  CHECK("os_reserve", test_os_reserve());
+  CHECK("purge_batch", test_purge_batch());
+  CHECK("purge_commit", test_purge_commit());
+  CHECK("numa_local", test_numa_local());
+  CHECK("reserve_huge", test_reserve_huge());
 
   //mi_stats_print(NULL);
 
@@ -301,6 +343,23 @@ int main(void) {
     mi_free(s);
   };
 
+  CHECK_BODY("register_watermark") {
+    result = (!mi_register_watermark(0, &test_watermark, NULL) &&
+              !mi_register_watermark(101, &test_watermark, NULL) &&
+              mi_register_watermark(90, &test_watermark, NULL));
+  };
+
+  CHECK("stats_get", test_stats_get());
+  CHECK("stats_peak", test_stats_peak());
+  CHECK("heap_profile", test_heap_profile());
+  CHECK("stats_latency", test_stats_latency());
+  CHECK("frag_report", test_frag_report());
+  CHECK("alloc_tags", test_alloc_tags());
+  CHECK("events", test_events());
+  CHECK("events_register", test_events_register());
+  CHECK("percpu_heaps", test_percpu_heaps());
+  CHECK("memory_limit", test_memory_limit());  // last, as it runs into the limit
+
   CHECK("stl_allocator1", test_stl_allocator1());
   CHECK("stl_allocator2", test_stl_allocator2());
 
@@ -334,6 +393,522 @@ bool test_heap2(void) {
   return true;
 }
 
+bool test_heap_snapshot(void) {
+  mi_arena_id_t arena_id;
+  int err = mi_reserve_os_memory_shared_ex(32 * 1024 * 1024, &arena_id);
+  if (err == ENOSYS) return true;  // not supported on this platform
+  if (err != 0) return false;
+  mi_heap_t* heap = mi_heap_new_in_arena(arena_id);
+  volatile int* p = mi_heap_malloc_tp(heap,int);  // volatile: the snapshot reads the store below
+  *p = 42;
+  size_t size;
+  const uint8_t* snapshot = (const uint8_t*)mi_heap_snapshot(heap, &size);
+  if (snapshot == NULL) return false;
+  *p = 43;
+  const int* q = (const int*)(snapshot + ((uint8_t*)p - (uint8_t*)mi_arena_area(arena_id, NULL)));
+  bool ok = (*q == 42 && *p == 43 && !mi_is_in_heap_region(q));
+  ok = ok && (mi_heap_snapshot(heap, NULL) == NULL);  // only one generation
+  mi_heap_snapshot_free(snapshot, size);
+  mi_heap_destroy(heap);
+  return ok;
+}
+
+bool test_heap_caged(void) {
+  mi_heap_t* heap = mi_heap_new_caged(256 * 1024 * 1024);
+  if (heap == NULL) return false;
+  size_t size;
+  uint8_t* base = (uint8_t*)mi_heap_cage_base(heap, &size);
+  bool ok = (base != NULL && size == 256 * 1024 * 1024 && ((uintptr_t)base % size) == 0);
+  const size_t sizes[] = { 8, 4000, 200 * 1024, 4 * 1024 * 1024, 40 * 1024 * 1024 };  // small, medium, large, huge
+  for (size_t i = 0; ok && i < sizeof(sizes)/sizeof(sizes[0]); i++) {
+    uint8_t* p = (uint8_t*)mi_heap_malloc(heap, sizes[i]);
+    ok = (p != NULL && p >= base && p + sizes[i] <= base + size);
+  }
+  ok = ok && (mi_heap_malloc(heap, 512 * 1024 * 1024) == NULL);  // does not fit the cage
+  mi_heap_destroy(heap);
+  return ok;
+}
+
+static bool count_arena(mi_arena_id_t arena_id, const mi_arena_info_t* info, void* arg) {
+  (void)arena_id; (void)info;
+  (*(size_t*)arg)++;
+  return true;
+}
+
+bool test_arena_info(void) {
+  mi_arena_id_t arena_id;
+  if (mi_reserve_os_memory_ex(64 * 1024 * 1024, false, false, true /* exclusive */, &arena_id) != 0) return false;
+  mi_arena_info_t info;
+  if (!mi_arena_info(arena_id, &info)) return false;
+  bool ok = (info.block_count * info.block_size >= 64 * 1024 * 1024 && info.blocks_inuse == 0 && info.is_exclusive);
+  mi_heap_t* heap = mi_heap_new_in_arena(arena_id);
+  void* p = mi_heap_malloc(heap, 8);
+  ok = ok && mi_arena_info(arena_id, &info) && info.blocks_inuse == 1 && info.blocks_dirty >= 1 && info.blocks_committed >= 1;
+  mi_heap_destroy(heap);
+  (void)p;
+  size_t count = 0;
+  ok = ok && mi_arenas_visit(&count_arena, &count) && count >= 1;
+  ok = ok && !mi_arena_info(-1, &info);
+  // a committed arena has no more committed (or dirty) blocks than it has blocks
+  mi_arena_id_t committed_id;
+  if (mi_reserve_os_memory_ex(64 * 1024 * 1024, true /* commit */, false, true /* exclusive */, &committed_id) != 0) return false;
+  ok = ok && mi_arena_info(committed_id, &info) && info.blocks_inuse == 0 &&
+             info.blocks_committed == info.block_count && info.blocks_dirty <= info.block_count;
+  return ok;
+}
+
+// also run with `MIMALLOC_OS_RESERVE` set (see `test-api-reserve`)
+bool test_os_reserve(void) {
+  const size_t align = 4 * MI_ALIGNMENT_MAX;    // allocated at an offset in a dedicated segment
+  mi_free(mi_malloc_aligned(1024, align));      // warm up
+  mi_stats_snapshot_t before, after;
+  if (!mi_stats_get(&before, sizeof(before))) return false;
+  bool ok = true;
+  for (int i = 0; i < 4 && ok; i++) {
+    void* p = mi_malloc_aligned(1024, align);
+    ok = (p != NULL);
+    mi_free(p);
+  }
+  ok = ok && mi_stats_get(&after, sizeof(after)) && after.reserved.current == before.reserved.current;
+  if (mi_option_get(mi_option_os_reserve) > 0) {
+    // a freed range in the reservation is reused, also when it is not the last one (lowest ranges are used first)
+    void* p1 = mi_malloc_aligned(1024, align);
+    void* p2 = mi_malloc_aligned(1024, align);
+    mi_free(p1);
+    void* p3 = mi_malloc_aligned(1024, align);
+    ok = ok && p1 != NULL && p2 != NULL && p3 != NULL && (uint8_t*)p3 <= (uint8_t*)p1;
+    mi_free(p2);
+    mi_free(p3);
+  }
+  uint8_t* q = (uint8_t*)mi_malloc(64);
+  ok = ok && mi_is_in_heap_region(q);
+  #if (MI_INTPTR_SIZE >= 8)
+  ok = ok && !mi_is_in_heap_region(q + 8 * (size_t)MI_GiB);   // never handed out
+  #endif
+  mi_free(q);
+  return ok;
+}
+
+#ifndef _WIN32
+#define PURGE_THREADS  (4)
+#define PURGE_BLOCKS   (8)
+#define PURGE_SIZE     (1024 * 1024)
+
+static pthread_mutex_t purge_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  purge_cond  = PTHREAD_COND_INITIALIZER;
+static int purge_ready;
+
+// allocate blocks and free every other one so the abandoned segment has separate ranges to purge
+static void* purge_thread(void* arg) {
+  void** live = (void**)arg;
+  void* p[PURGE_BLOCKS];
+  for (int i = 0; i < PURGE_BLOCKS; i++) { p[i] = mi_malloc(PURGE_SIZE); memset(p[i], 1, PURGE_SIZE); }
+  for (int i = 0; i < PURGE_BLOCKS; i++) {
+    if (i % 2 == 0) { mi_free(p[i]); } else { live[i/2] = p[i]; }
+  }
+  // wait until all threads allocated so no thread reclaims the segment of another
+  pthread_mutex_lock(&purge_mutex);
+  purge_ready++;
+  pthread_cond_broadcast(&purge_cond);
+  while (purge_ready < PURGE_THREADS) { pthread_cond_wait(&purge_cond, &purge_mutex); }
+  pthread_mutex_unlock(&purge_mutex);
+  return NULL;
+}
+
+// a forced collect in a thread other than the main thread purges the abandoned segments (without reclaiming them)
+static void* purge_collect(void* arg) {
+  mi_thread_init();  // without allocating (which could reclaim a segment)
+  mi_collect(true);
+  return arg;
+}
+#endif
+
+// the delayed purges of the segments abandoned by several threads are batched
+bool test_purge_batch(void) {
+  #ifdef _WIN32
+  return true;
+  #else
+  if (mi_option_is_enabled(mi_option_percpu_heaps)) return true;  // threads do not own (and abandon) segments
+  const long delay = mi_option_get(mi_option_purge_delay);
+  mi_option_set(mi_option_purge_delay, 1000000);  // only purge when forced
+  if (mi_option_get(mi_option_purge_delay) != 1000000) return true;  // options are constant (on Android)
+  void* live[PURGE_THREADS][PURGE_BLOCKS / 2];
+  pthread_t threads[PURGE_THREADS];
+  for (int t = 0; t < PURGE_THREADS; t++) {
+    if (pthread_create(&threads[t], NULL, &purge_thread, live[t]) != 0) return false;
+  }
+  for (int t = 0; t < PURGE_THREADS; t++) { pthread_join(threads[t], NULL); }
+  mi_stats_snapshot_t before, after;
+  bool ok = mi_stats_get(&before, sizeof(before));
+  pthread_t collector;
+  if (pthread_create(&collector, NULL, &purge_collect, NULL) != 0) return false;
+  pthread_join(collector, NULL);
+  ok = ok && mi_stats_get(&after, sizeof(after));
+  const long long ranges = PURGE_THREADS * (PURGE_BLOCKS / 2);
+  const long long calls  = after.purge_calls.total - before.purge_calls.total;
+  const long long purged = after.purged.allocated - before.purged.allocated;
+  // either all ranges are purged with one `process_madvise` call, or one by one
+  ok = ok && purged >= ranges * (PURGE_SIZE / 2) && (calls == 1 || calls >= ranges);
+  for (int t = 0; t < PURGE_THREADS; t++) {
+    for (int i = 0; i < PURGE_BLOCKS / 2; i++) { mi_free(live[t][i]); }
+  }
+  mi_option_set(mi_option_purge_delay, delay);
+  return ok;
+  #endif
+}
+
+// purged memory is no longer counted as committed (also when it does not need a recommit, e.g. `MADV_DONTNEED`)
+// (in an exclusive arena so the memory left by the earlier tests is not reused)
+bool test_purge_commit(void) {
+  mi_arena_id_t arena_id;
+  if (mi_reserve_os_memory_ex(128 * 1024 * 1024, false /* commit */, false /* allow large */, true /* exclusive */, &arena_id) != 0) return false;
+  mi_heap_t* heap = mi_heap_new_in_arena(arena_id);
+  if (heap == NULL) return false;
+  void* p[64];
+  size_t used, freed;
+  for (int i = 0; i < 64; i++) {
+    p[i] = mi_heap_malloc(heap, 1024 * 1024);
+    if (p[i] != NULL) { memset(p[i], 0, 1024 * 1024); }
+  }
+  mi_process_info(NULL, NULL, NULL, NULL, NULL, &used, NULL, NULL);
+  for (int i = 0; i < 64; i++) { mi_free(p[i]); }
+  mi_heap_delete(heap);
+  mi_collect(true);
+  mi_process_info(NULL, NULL, NULL, NULL, NULL, &freed, NULL, NULL);
+  return ((ptrdiff_t)(used - freed) >= 32 * 1024 * 1024);  // signed, in case it does not drop
+}
+
+// a thread that stays on one cpu never sees a numa migration nor allocates remote pages
+// (also run with `MIMALLOC_USE_NUMA_NODES` set (see `test-api-numa`) to check the numa node logic on one node)
+bool test_numa_local(void) {
+  #if defined(__linux__)
+  cpu_set_t cpus, pinned;
+  const int cpu = sched_getcpu();
+  if (cpu < 0 || sched_getaffinity(0, sizeof(cpus), &cpus) != 0) return true;
+  CPU_ZERO(&pinned);
+  CPU_SET(cpu, &pinned);
+  if (sched_setaffinity(0, sizeof(pinned), &pinned) != 0) return true;
+  mi_stats_snapshot_t before, after;
+  bool ok = mi_stats_get(&before, sizeof(before));
+  void* p[256];
+  for (int n = 0; n < 8; n++) {
+    for (int i = 0; i < 256; i++) { p[i] = mi_malloc(16 * 1024 + (size_t)i * 1024); }
+    for (int i = 0; i < 256; i++) { mi_free(p[i]); }
+  }
+  ok = ok && mi_stats_get(&after, sizeof(after));
+  ok = ok && after.numa_migrations.total == before.numa_migrations.total && after.pages_remote.total == before.pages_remote.total;
+  sched_setaffinity(0, sizeof(cpus), &cpus);
+  return ok;
+  #else
+  return true;
+  #endif
+}
+
+// reserve huge OS pages on two numa nodes in parallel (on helper threads); without huge OS pages this fails with ENOMEM
+// (also run with `MIMALLOC_RESERVE_HUGE_OS_PAGES` set (see `test-api-huge`) to reserve on two nodes at startup)
+bool test_reserve_huge(void) {
+  size_t before = 0;
+  size_t after = 0;
+  if (!mi_arenas_visit(&count_arena, &before)) return false;
+  const int err = mi_reserve_huge_os_pages_interleave(2, 2, 2000);
+  if (!mi_arenas_visit(&count_arena, &after)) return false;
+  return ((err == 0 && after == before + 2) || (err == ENOMEM && after < before + 2));
+}
+
+typedef struct json_output_s {
+  char   start[16];  // the first characters
+  size_t len;
+  size_t total;
+  char   last;
+} json_output_t;
+
+static void json_out(const char* msg, void* arg) {
+  json_output_t* json = (json_output_t*)arg;
+  for (; *msg != 0; msg++) {
+    if (json->len < sizeof(json->start) - 1) { json->start[json->len++] = *msg; }
+    json->last = *msg;
+    json->total++;
+  }
+}
+
+bool test_stats_get(void) {
+  void* p = mi_malloc(1024);
+  mi_stats_snapshot_t stats;
+  bool ok = mi_stats_get(&stats, sizeof(stats));
+  ok = ok && stats.version == MI_STATS_SNAPSHOT_VERSION && stats.size == sizeof(stats);
+  ok = ok && stats.mmap_calls.total > 0 && stats.reserved.allocated > 0;
+  ok = ok && stats.reserved.peak >= stats.reserved.current && stats.committed.peak >= stats.committed.current;
+  ok = ok && mi_stats_get(&stats, offsetof(mi_stats_snapshot_t, pages)) && stats.size == offsetof(mi_stats_snapshot_t, pages);
+  ok = ok && !mi_stats_get(&stats, sizeof(size_t));
+  json_output_t json = { {0}, 0, 0, 0 };
+  mi_stats_print_json(&json_out, &json);
+  ok = ok && strncmp(json.start, "{\"version\":", 11) == 0 && json.last == '\n' && json.total > 100;
+  mi_free(p);
+  return ok;
+}
+
+// allocate 100 blocks of 1MiB and free them again; returns NULL on success
+static void* stats_peak_alloc(void* arg) {
+  (void)arg;
+  void* p[100];
+  for (size_t i = 0; i < 100; i++) { p[i] = mi_malloc(1024*1024); }
+  for (size_t i = 0; i < 100; i++) { mi_free(p[i]); }
+  return NULL;
+}
+
+// after freeing everything, the peak still reflects the memory that was in use
+static bool stats_peak_check(void) {
+  mi_stats_snapshot_t stats;
+  return (mi_stats_get(&stats, sizeof(stats)) &&
+          stats.segments.peak >= 2 && stats.segments.peak > stats.segments.current &&
+          stats.large.peak >= stats.large.allocated);   // only maintained with detailed statistics (MI_STAT>1)
+}
+
+bool test_stats_peak(void) {
+  bool ok = true;
+  #ifndef _WIN32
+  // in a thread that terminates
+  mi_stats_reset();
+  pthread_t thread;
+  ok = (pthread_create(&thread, NULL, &stats_peak_alloc, NULL) == 0 && pthread_join(thread, NULL) == 0);
+  ok = ok && stats_peak_check();
+  #endif
+  // and in the main thread
+  mi_stats_reset();
+  stats_peak_alloc(NULL);
+  return (ok && stats_peak_check());
+}
+
+// returns the number of samples in the heap profile (or SIZE_MAX on error)
+static size_t heap_profile_samples(void) {
+  FILE* f = tmpfile();
+  if (f == NULL) return SIZE_MAX;
+  const int err = mi_heap_profile_dump(fileno(f));
+  char buf[128] = { 0 };
+  rewind(f);
+  const size_t n = fread(buf, 1, sizeof(buf) - 1, f);
+  fclose(f);
+  unsigned long count = 0;
+  if (err != 0 || n == 0 || sscanf(buf, "heap profile: %lu:", &count) != 1 || strstr(buf, "@ heap_v2/1024\n") == NULL) return SIZE_MAX;
+  if (count > 0 && strstr(buf, "\n# dropped: 0\n") == NULL) return SIZE_MAX;
+  return (size_t)count;
+}
+
+bool test_heap_profile(void) {
+  mi_option_set(mi_option_profile_interval, 1);  // sample every 1KiB on average
+  if (mi_option_get(mi_option_profile_interval) != 1) return true;  // options are constant (on Android)
+  mi_heap_t* heap = mi_heap_new();               // a new heap re-reads the interval
+  void* p[256];
+  for (size_t i = 0; i < 256; i++) { p[i] = mi_heap_malloc(heap, 1024); }
+  const size_t sampled = heap_profile_samples();
+  for (size_t i = 0; i < 256; i += 2) { mi_free(p[i]); }
+  const size_t halved = heap_profile_samples();
+  mi_heap_destroy(heap);
+  const size_t destroyed = heap_profile_samples();
+  mi_option_set(mi_option_profile_interval, 0);
+  return (sampled > 0 && sampled != SIZE_MAX && halved < sampled && destroyed == 0);
+}
+
+bool test_stats_latency(void) {
+  mi_option_enable(mi_option_latency_stats);
+  if (!mi_option_is_enabled(mi_option_latency_stats)) return true;  // options are constant (on Android)
+  mi_heap_t* heap = mi_heap_new();
+  for (size_t i = 0; i < 64; i++) {
+    void* p = mi_heap_malloc(heap, 64*1024);  // each needs a fresh page
+    (void)p;
+  }
+  mi_heap_destroy(heap);
+  mi_option_disable(mi_option_latency_stats);
+  mi_stats_snapshot_t stats;
+  bool ok = mi_stats_get(&stats, sizeof(stats));
+  const mi_stat_latency_snapshot_t* lat = &stats.latency[mi_latency_malloc_generic];
+  int64_t sum = 0;
+  for (size_t i = 0; i < MI_STATS_LATENCY_BUCKETS; i++) { sum += lat->buckets[i]; }
+  ok = ok && lat->count >= 64 && sum == lat->count && lat->total > 0;
+  return ok;
+}
+
+static bool frag_count_pages(const mi_frag_segment_t* segment, const mi_frag_page_t* page, void* arg) {
+  if (page != NULL && page->used <= page->capacity && page->capacity <= page->reserved && segment->used_slices <= segment->slices) {
+    *((size_t*)arg) += 1;
+  }
+  return true;
+}
+
+bool test_frag_report(void) {
+  mi_heap_t* heap = mi_heap_new();
+  void* p[4096];
+  for (size_t i = 0; i < 4096; i++) { p[i] = mi_heap_malloc(heap, 64); }
+  for (size_t i = 0; i < 4096; i++) {
+    if (i % 8 != 0) { mi_free(p[i]); }   // leave the pages 1/8th used
+  }
+  mi_frag_report_t report;
+  mi_frag_get(&report);
+  size_t pages = 0;
+  bool ok = mi_frag_visit(&frag_count_pages, &pages);
+  ok = ok && report.segments > 0 && report.pages > 0 && pages == report.pages;
+  ok = ok && report.used_slices + report.free_slices <= report.slices && report.largest_free_spans <= report.free_slices;
+  const mi_frag_bin_t* bin = NULL;
+  for (size_t i = 0; i < MI_STATS_SNAPSHOT_BINS; i++) {
+    if (bin == NULL && report.bins[i].block_size >= 64 + MI_PADDING_SIZE) { bin = &report.bins[i]; }
+  }
+  ok = ok && bin != NULL && bin->used >= 512 && bin->sparse_pages > 0 && bin->sparse_free > 0 && report.sparse_free >= bin->sparse_free;
+  json_output_t json = { {0}, 0, 0, 0 };
+  mi_frag_print_json(&json_out, &json);
+  ok = ok && strncmp(json.start, "{\"segments\":", 12) == 0 && json.last == '\n';
+  mi_heap_destroy(heap);
+  return ok;
+}
+
+typedef struct alloc_tags_count_s {
+  size_t tagged;
+  size_t tagged_size;
+  size_t tagged_max;  // with the largest tag
+  size_t total;
+} alloc_tags_count_t;
+
+static bool alloc_tags_count(const mi_heap_t* heap, const mi_alloc_site_t* site, void* arg) {
+  (void)heap;
+  alloc_tags_count_t* count = (alloc_tags_count_t*)arg;
+  if (site->tag == 42) { count->tagged += site->count; count->tagged_size += site->size; }
+  if (site->tag == 0x7FFFFFFF && site->id != MI_ALLOC_SITE_OTHER) { count->tagged_max += site->count; }
+  count->total += site->count;
+  return true;
+}
+
+bool test_alloc_tags(void) {
+  mi_option_enable(mi_option_alloc_tags);
+  if (!mi_option_is_enabled(mi_option_alloc_tags)) return true;  // options are constant (on Android)
+  mi_heap_t* heap = mi_heap_new();   // a new heap re-reads the option
+  void* p[16];
+  mi_set_alloc_tag(42);
+  for (size_t i = 0; i < 10; i++) { p[i] = mi_heap_malloc(heap, 100); }
+  const uint32_t prev = mi_set_alloc_tag(0);
+  for (size_t i = 10; i < 15; i++) { p[i] = mi_heap_malloc(heap, 100); }
+  mi_set_alloc_tag(0x7FFFFFFF);  // the largest tag is not taken for the site of other sites
+  p[15] = mi_heap_malloc(heap, 100);
+  mi_set_alloc_tag(0);
+  mi_free(p[0]);
+  alloc_tags_count_t count = { 0, 0, 0, 0 };
+  bool ok = prev == 42 && mi_heap_dump_live(heap, &alloc_tags_count, &count);
+  ok = ok && count.tagged == 9 && count.tagged_size >= 900 && count.tagged_max == 1 && count.total == 15;
+  // the tags move along with the pages into the backing heap
+  mi_heap_delete(heap);
+  count.tagged = 0;
+  ok = ok && mi_heap_dump_live(mi_heap_get_backing(), &alloc_tags_count, &count) && count.tagged == 9;
+  for (size_t i = 1; i < 16; i++) { mi_free(p[i]); }
+  mi_option_disable(mi_option_alloc_tags);
+  return ok;
+}
+
+static void count_event(mi_event_t event, void* p, size_t size, void* arg) {
+  size_t* counts = (size_t*)arg;
+  if (p != NULL && size > 0) { counts[event]++; }
+  void* q = mi_malloc(8*1024*1024);  // allocating in the callback does not raise events
+  mi_free(q);
+}
+
+bool test_events(void) {
+  size_t counts[_mi_event_last] = { 0 };
+  mi_register_event(&count_event, counts);
+  void* p = mi_malloc(64*1024*1024);  // a huge block in its own segment
+  mi_free(p);
+  mi_register_event(NULL, NULL);
+  void* q = mi_malloc(64*1024*1024);
+  mi_free(q);
+  return (counts[mi_event_huge_alloc] == 1 && counts[mi_event_huge_free] == 1 &&
+          counts[mi_event_segment_alloc] == 1 && counts[mi_event_segment_free] == 1 &&
+          counts[mi_event_page_alloc] == 1 && counts[mi_event_page_retire] == 1);
+}
+
+#ifndef _WIN32
+static int event_arg_a;
+static int event_arg_b;
+static volatile bool event_arg_mismatch;
+
+static void event_a(mi_event_t event, void* p, size_t size, void* arg) {
+  (void)event; (void)p; (void)size;
+  if (arg != &event_arg_a) { event_arg_mismatch = true; }
+}
+
+static void event_b(mi_event_t event, void* p, size_t size, void* arg) {
+  (void)event; (void)p; (void)size;
+  if (arg != &event_arg_b) { event_arg_mismatch = true; }
+}
+
+static void* event_alloc(void* arg) {
+  (void)arg;
+  for (int i = 0; i < 2000; i++) {  // each allocates and retires a large page
+    void* p = mi_malloc(1024*1024);
+    mi_free(p);
+  }
+  return NULL;
+}
+#endif
+
+bool test_events_register(void) {
+  #ifdef _WIN32
+  return true;
+  #else
+  // re-register while another thread raises events: a callback never sees the argument of the other
+  event_arg_mismatch = false;
+  pthread_t thread;
+  if (pthread_create(&thread, NULL, &event_alloc, NULL) != 0) return false;
+  for (int i = 0; i < 20000; i++) {
+    mi_register_event(&event_a, &event_arg_a);
+    mi_register_event(&event_b, &event_arg_b);
+  }
+  mi_register_event(NULL, NULL);
+  pthread_join(thread, NULL);
+  return !event_arg_mismatch;
+  #endif
+}
+
+#ifndef _WIN32
+static void* percpu_free(void* p) {
+  mi_free(p);
+  return NULL;
+}
+#endif
+
+bool test_percpu_heaps(void) {
+  if (!mi_option_is_enabled(mi_option_percpu_heaps)) return true;
+  void* p = mi_malloc(64);
+  const bool redirected = (p != NULL && !mi_heap_check_owned(mi_heap_get_backing(), p));
+  mi_free(p);
+  if (!redirected) return true;  // no cheap processor id on this platform
+  #ifndef _WIN32
+  // a huge block freed by another thread is released right away
+  size_t counts[_mi_event_last] = { 0 };
+  mi_register_event(&count_event, counts);
+  void* q = mi_malloc(64*1024*1024);
+  pthread_t thread;
+  bool ok = (q != NULL && pthread_create(&thread, NULL, &percpu_free, q) == 0 && pthread_join(thread, NULL) == 0);
+  mi_register_event(NULL, NULL);
+  return (ok && counts[mi_event_huge_free] == 1 && counts[mi_event_segment_free] == 1);
+  #else
+  return true;
+  #endif
+}
+
+bool test_memory_limit(void) {
+  if (mi_option_get(mi_option_memory_limit) == 0) return true;  // only with a limit set at process start
+  size_t fired = 0;
+  if (!mi_register_watermark(50, &test_watermark, &fired)) return false;
+  const size_t block_size = 8*1024*1024;
+  void* blocks[256];
+  size_t n = 0;
+  errno = 0;
+  for (; n < 256; n++) {
+    blocks[n] = mi_malloc(block_size);
+    if (blocks[n] == NULL) break;
+    memset(blocks[n], 1, block_size);  // make it resident
+  }
+  const bool ok = (n > 0 && n < 256 && errno == ENOMEM && fired == 1);
+  for (size_t i = 0; i < n; i++) { mi_free(blocks[i]); }
+  return ok;
+}
+
 bool test_stl_allocator1(void) {
 #ifdef __cplusplus
   std::vector<int, mi_stl_allocator<int> > vec;